@@ -0,0 +1,512 @@
+/* ARD batch runner
+ *
+ * Headless entry point for compute nodes: no window, no font, no Windows API, and no Vulkan when
+ * built with ARD_NO_VULKAN. Everything main.cpp fixes at compile time (scene, sources, recorders,
+ * dh/dt/duration, backend, outputs) comes from the command line or a config file of
+ * "key = value" lines with the same names as the options ('#' starts a comment). Options are
+ * applied in order, so arguments after --config override the file.
+ *
+ * Usage: ard-batch --scene scene.txt --sources sources.txt [--recorders recorders.txt] [--config run.cfg]
+ *                  [--dh 0.1] [--dt 0.000125] [--duration 2] [--backend cpu|gpu] [--threads N] [--output DIR] ...
+ *
+ * --package FILE maps a compiled scene package (see ScenePackage) instead of laying the scene out
+ * again, compiling it first when it is missing or was built for another scene or grid.
+ *
+ * --sweep FILE runs every variant of the file (see ParameterSweep) on the one scene instead, --jobs
+ * of them at a time within the --threads budget.
+ *
+ * Prints steps/s and Mcell-updates/s at the end. Exit codes (see ExitCode) let pipelines tell
+ * bad arguments from bad inputs, unwritable outputs and a missing GPU.
+ */
+
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <future>
+#include <filesystem>
+#include <cstdlib>
+#include <cstring>
+#include <omp.h>
+
+#include "simulation.h"
+#include "partition.h"
+#include "sound_source.h"
+#include "recorder.h"
+#include "field_encoder.h"
+#include "record_writer.h"
+#include "receiver_array.h"
+#include "snapshot.h"
+#include "frame_exporter.h"
+#include "dct_partition.h"
+#include "impulse_response.h"
+#include "room_metrics.h"
+#include "termination.h"
+#include "parameter_sweep.h"
+#include "scene_package.h"
+#include "partition_index.h"
+#include "tracer.h"
+
+#include "utils_VkFFT.h"
+
+enum ExitCode
+{
+	EXIT_OK = 0,
+	EXIT_USAGE = 1,		// unknown option, missing or malformed value, unreadable config file
+	EXIT_INPUT = 2,		// scene without partitions, no sources
+	EXIT_OUTPUT = 3,	// output directory or files cannot be written
+	EXIT_GPU = 4		// --backend gpu without a usable Vulkan device (or a CPU-only build)
+};
+
+struct BatchOptions
+{
+	SimulationConfig config;		// defaults as in the simulator (main.cpp)
+	std::string scene;
+	std::string package;			// compiled scene package, built on first use
+	std::string sources;
+	std::string recorders;
+	std::string receivers;			// dense receivers, metres, one per line
+	real_t receiver_grid = 0.0f;	// > 0: a receiver every that many metres over the air partitions
+	std::string output = "./output";
+	std::string backend = "cpu";
+	int threads = 0;				// 0: OpenMP default
+	bool batched = false;
+	bool reciprocal = false;
+	bool lazy_idct = false;
+	bool early_stop = false;
+	bool record = true;				// <output>/record.bin when there are recorders
+	bool metrics = false;
+	bool ir = false;
+	bool trace = false;
+	int progress = 10;				// progress line every that many percent, 0 for none
+	int snapshot_every = 0;			// > 0: <output>/snapshots.bin every that many steps
+	int snapshot_bits = 8;
+	int video_every = 0;			// > 0: a video frame every that many steps
+	std::string video_format = "y4m";	// <output>/field.y4m, or png: <output>/frame_NNNNNN.png
+	int video_plane = 0;			// 0: xy, 1: yz, 2: xz
+	int video_slice = -1;			// < 0: through the first source
+	bool video_projection = false;
+	int video_workers = 2;
+	std::string sweep;				// variant file: run a parameter sweep instead of one simulation
+	int jobs = 1;					// sweep variants run at once
+};
+
+static const char* usage =
+	"Usage: ard-batch [--config FILE] --scene FILE [--package FILE] --sources FILE [--recorders FILE]\n"
+	"                 [--receivers FILE] [--receiver-grid METRES] [--output DIR]\n"
+	"                 [--dh M] [--dt S] [--duration S] [--absorption A] [--pml-layers N]\n"
+	"                 [--backend cpu|gpu] [--threads N] [--progress PERCENT]\n"
+	"                 [--batched] [--reciprocal] [--lazy-idct] [--early-stop]\n"
+	"                 [--no-record] [--metrics] [--ir] [--trace]\n"
+	"                 [--snapshot-every STEPS] [--snapshot-bits 8|16]\n"
+	"                 [--video-every STEPS] [--video-format y4m|png] [--video-plane 0|1|2]\n"
+	"                 [--video-slice CELL] [--video-projection] [--video-workers N]\n"
+	"                 [--sweep VARIANTS --jobs N]\n"
+	"Exit codes: 0 ok, 1 usage, 2 input, 3 output, 4 GPU unavailable.";
+
+static bool IsFlag(const std::string& key)
+{
+	return key == "batched" || key == "reciprocal" || key == "lazy-idct" || key == "early-stop"
+		|| key == "no-record" || key == "metrics" || key == "ir" || key == "trace" || key == "video-projection";
+}
+
+static bool ParseReal(const std::string& value, real_t& out)
+{
+	char* end = nullptr;
+	out = strtof(value.c_str(), &end);
+	return !value.empty() && *end == 0;
+}
+
+static bool ParseInt(const std::string& value, int& out)
+{
+	char* end = nullptr;
+	out = (int)strtol(value.c_str(), &end, 10);
+	return !value.empty() && *end == 0;
+}
+
+static bool ParseFlag(const std::string& value, bool& out)
+{
+	if (value == "1" || value == "true" || value == "yes" || value == "on") out = true;
+	else if (value == "0" || value == "false" || value == "no" || value == "off") out = false;
+	else return false;
+	return true;
+}
+
+static bool ReadConfig(const std::string& path, BatchOptions& options);
+
+// Shared by the command line (--key value) and the config file (key = value).
+static bool SetOption(BatchOptions& options, const std::string& key, const std::string& value)
+{
+	if (key == "config") return ReadConfig(value, options);
+	if (key == "scene") options.scene = value;
+	else if (key == "package") options.package = value;
+	else if (key == "sources") options.sources = value;
+	else if (key == "recorders") options.recorders = value;
+	else if (key == "receivers") options.receivers = value;
+	else if (key == "receiver-grid") return ParseReal(value, options.receiver_grid);
+	else if (key == "output") options.output = value;
+	else if (key == "backend") options.backend = value;
+	else if (key == "threads") return ParseInt(value, options.threads);
+	else if (key == "progress") return ParseInt(value, options.progress);
+	else if (key == "snapshot-every") return ParseInt(value, options.snapshot_every);
+	else if (key == "snapshot-bits") return ParseInt(value, options.snapshot_bits) && (options.snapshot_bits == 8 || options.snapshot_bits == 16);
+	else if (key == "dh") return ParseReal(value, options.config.dh) && options.config.dh > 0.0f;
+	else if (key == "dt") return ParseReal(value, options.config.dt) && options.config.dt > 0.0f;
+	else if (key == "duration") return ParseReal(value, options.config.duration) && options.config.duration > 0.0f;
+	else if (key == "absorption") return ParseReal(value, options.config.absorption);
+	else if (key == "pml-layers") return ParseInt(value, options.config.pml_layers) && options.config.pml_layers > 0;
+	else if (key == "batched") return ParseFlag(value, options.batched);
+	else if (key == "reciprocal") return ParseFlag(value, options.reciprocal);
+	else if (key == "lazy-idct") return ParseFlag(value, options.lazy_idct);
+	else if (key == "early-stop") return ParseFlag(value, options.early_stop);
+	else if (key == "no-record")
+	{
+		bool off;
+		if (!ParseFlag(value, off)) return false;
+		options.record = !off;
+	}
+	else if (key == "video-every") return ParseInt(value, options.video_every);
+	else if (key == "video-format")
+	{
+		options.video_format = value;
+		return value == "y4m" || value == "png";
+	}
+	else if (key == "video-plane") return ParseInt(value, options.video_plane) && options.video_plane >= 0 && options.video_plane <= 2;
+	else if (key == "video-slice") return ParseInt(value, options.video_slice);
+	else if (key == "video-projection") return ParseFlag(value, options.video_projection);
+	else if (key == "video-workers") return ParseInt(value, options.video_workers) && options.video_workers > 0;
+	else if (key == "sweep") options.sweep = value;
+	else if (key == "jobs") return ParseInt(value, options.jobs) && options.jobs > 0;
+	else if (key == "metrics") return ParseFlag(value, options.metrics);
+	else if (key == "ir") return ParseFlag(value, options.ir);
+	else if (key == "trace") return ParseFlag(value, options.trace);
+	else return false;
+	return true;
+}
+
+static std::string Trim(const std::string& s)
+{
+	size_t first = s.find_first_not_of(" \t\r");
+	size_t last = s.find_last_not_of(" \t\r");
+	return first == std::string::npos ? "" : s.substr(first, last - first + 1);
+}
+
+static bool ReadConfig(const std::string& path, BatchOptions& options)
+{
+	std::ifstream file(path);
+	if (!file)
+	{
+		std::cout << "Cannot read config " << path << std::endl;
+		return false;
+	}
+	std::string line;
+	int number = 0;
+	while (std::getline(file, line))
+	{
+		number++;
+		line = Trim(line.substr(0, line.find('#')));
+		if (line.empty())
+		{
+			continue;
+		}
+		size_t equals = line.find('=');
+		std::string key = Trim(line.substr(0, equals));
+		std::string value = equals == std::string::npos ? "1" : Trim(line.substr(equals + 1));
+		if (!SetOption(options, key, value))
+		{
+			std::cout << path << ":" << number << ": bad option \"" << line << "\"" << std::endl;
+			return false;
+		}
+	}
+	return true;
+}
+
+int main(int argc, char** argv)
+{
+	double time1 = omp_get_wtime();
+
+	BatchOptions options;
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		std::string key = arg.size() > 2 && arg.compare(0, 2, "--") == 0 ? arg.substr(2) : "";
+		bool has_value = i + 1 < argc;
+		bool ok;
+		if (IsFlag(key))
+			ok = SetOption(options, key, "1");
+		else if (!key.empty() && key != "help" && has_value)
+			ok = SetOption(options, key, argv[++i]);
+		else
+			ok = false;
+		if (!ok)
+		{
+			std::cout << "Bad argument: " << arg << std::endl << usage << std::endl;
+			return EXIT_USAGE;
+		}
+	}
+	if (options.scene.empty() || options.sources.empty() || (options.backend != "cpu" && options.backend != "gpu"))
+	{
+		std::cout << usage << std::endl;
+		return EXIT_USAGE;
+	}
+	if (options.threads > 0)
+	{
+		omp_set_num_threads(options.threads);
+	}
+
+	std::error_code error;
+	std::filesystem::create_directories(options.output, error);
+	if (error || !std::filesystem::is_directory(options.output))
+	{
+		std::cout << "Cannot create output directory " << options.output << ": " << error.message() << std::endl;
+		return EXIT_OUTPUT;
+	}
+	const std::string& dir_name = options.output;
+	SimulationConfig& config = options.config;
+
+	if (options.trace)
+	{
+		Tracer::Enable();
+	}
+
+	if (!options.sweep.empty())
+	{
+		std::vector<ParameterSweep::Variant> variants;
+		if (!ParameterSweep::ReadVariants(options.sweep, variants) || variants.empty())
+		{
+			std::cout << "No variants in " << options.sweep << std::endl;
+			return EXIT_USAGE;
+		}
+		if (options.backend != "cpu")
+		{
+			std::cout << "The sweep runs on the CPU backend." << std::endl;
+		}
+		ParameterSweep sweep(config, options.scene, options.sources, options.recorders);
+		if (sweep.num_partitions() == 0)
+		{
+			std::cout << "No partitions in " << options.scene << std::endl;
+			return EXIT_INPUT;
+		}
+		ParameterSweep::Settings settings;
+		settings.jobs = options.jobs;
+		settings.threads = options.threads;
+		settings.ir = options.ir;
+		settings.output = dir_name;
+		int status = EXIT_OK;
+		for (auto& result : sweep.Run(variants, settings))
+		{
+			if (!result.ok)
+			{
+				status = result.steps == 0 ? EXIT_INPUT : EXIT_OUTPUT;
+			}
+		}
+		return status;
+	}
+
+	VkGPU vkGPU = {};
+	bool use_gpu = options.backend == "gpu";
+	if (use_gpu && initVkGPU(&vkGPU) != VKFFT_SUCCESS)
+	{
+		std::cout << "GPU backend requested but no Vulkan device is available." << std::endl;
+		return EXIT_GPU;
+	}
+
+	std::vector<std::shared_ptr<Partition>> partitions;
+	std::vector<std::shared_ptr<SoundSource>> sources;
+	std::vector<std::shared_ptr<Recorder>> recorders;
+
+	if (options.reciprocal && !options.recorders.empty())
+	{
+		sources = SoundSource::ImportSources(config, options.recorders);	// listeners as sources, see main.cpp
+		SoundSource::BatchSources(sources, true, config);
+		recorders = Recorder::ImportRecorders(config, options.sources, dir_name, config.fields);
+	}
+	else
+	{
+		sources = SoundSource::ImportSources(config, options.sources);
+		SoundSource::BatchSources(sources, options.batched, config);
+		if (!options.recorders.empty())
+		{
+			recorders = Recorder::ImportRecorders(config, options.recorders, dir_name);
+		}
+	}
+	ScenePackage package;
+	if (!options.package.empty() && package.Load(options.package, config, options.scene))
+	{
+		partitions = package.Partitions(config, use_gpu ? &vkGPU : nullptr);
+	}
+	else
+	{
+		partitions = Partition::ImportPartitions(config, options.scene, use_gpu ? &vkGPU : nullptr);
+	}
+
+	int status = EXIT_OK;
+	if (partitions.empty() || sources.empty())
+	{
+		std::cout << (partitions.empty() ? "No partitions in " + options.scene : "No sources in " + options.sources) << std::endl;
+		status = EXIT_INPUT;
+	}
+
+	if (status == EXIT_OK)
+	{
+		PartitionIndex partition_index(partitions);
+		for (auto record : recorders)
+		{
+			record->FindPartition(partition_index);
+			if (options.metrics)
+			{
+				record->EnableMetrics(!options.record);	// --no-record: only feed the metrics
+			}
+			record->SetEncoding(FieldEncoder::AMBISONICS, 1);
+		}
+
+		RecordWriter record_writer(dir_name + "/record.bin", config, FieldEncoder(config, FieldEncoder::AMBISONICS, 1).channels(), FieldEncoder::AMBISONICS);
+		if (options.record && !recorders.empty())
+		{
+			for (auto record : recorders)
+			{
+				record->Attach(&record_writer);
+			}
+			if (!record_writer.Start())
+			{
+				std::cout << "Cannot write " << dir_name << "/record.bin" << std::endl;
+				status = EXIT_OUTPUT;
+			}
+		}
+
+		auto simulation = std::make_shared<Simulation>(config, partitions, sources, package.is_open() ? &package : nullptr);
+		simulation->render_ = false;
+		simulation->Info();
+
+		std::future<bool> source_export = SoundSource::ExportSources(sources, dir_name + "/sources.bin", config);
+
+		if (options.lazy_idct)
+		{
+			for (auto& partition : partitions)
+			{
+				if (auto dct = std::dynamic_pointer_cast<DctPartition>(partition))
+				{
+					dct->set_lazy_idct(true);
+				}
+			}
+		}
+
+		auto receivers = std::make_shared<ReceiverArray>(config);
+		if (!options.receivers.empty() || options.receiver_grid > 0.0f)
+		{
+			if (!options.receivers.empty())
+			{
+				receivers->ImportReceivers(options.receivers);
+			}
+			if (options.receiver_grid > 0.0f)
+			{
+				receivers->AddGrid(partitions, options.receiver_grid);
+			}
+			receivers->Build(partitions);
+			if (!receivers->Open(dir_name + "/receivers.bin"))
+			{
+				status = EXIT_OUTPUT;
+			}
+			receivers->Info();
+			simulation->SetReceivers(receivers);
+		}
+
+		SnapshotWriter::Settings snapshot_settings;
+		snapshot_settings.every = options.snapshot_every;
+		snapshot_settings.bits = options.snapshot_bits;
+		SnapshotWriter snapshots(dir_name + "/snapshots.bin", snapshot_settings);
+		if (options.snapshot_every > 0 && !snapshots.Start(partitions))
+		{
+			status = EXIT_OUTPUT;
+		}
+
+		FrameExporter::Settings video_settings;
+		bool png = options.video_format == "png";
+		video_settings.format = png ? FrameExporter::PNG : FrameExporter::Y4M;
+		video_settings.look_from = options.video_plane;
+		video_settings.slice = options.video_slice;
+		video_settings.projection = options.video_projection;
+		video_settings.every = options.video_every;
+		video_settings.workers = options.video_workers;
+		FrameExporter video(*simulation, dir_name + (png ? "/frame_" : "/field.y4m"), video_settings);
+		if (options.video_every > 0 && !video.Start())
+		{
+			status = EXIT_OUTPUT;
+		}
+
+		TerminationController termination(simulation, recorders, TerminationController::Settings());
+		int total_time_steps = config.total_steps();
+		int report_every = options.progress > 0 ? std::max(1, total_time_steps * options.progress / 100) : 0;
+
+		double time2 = omp_get_wtime();
+		std::cout << "Initialization finished. (" << time2 - time1 << " s)" << std::endl;
+		std::cout << "############################################################" << std::endl;
+
+		int steps = 0;
+		while (status == EXIT_OK && steps < total_time_steps)
+		{
+			int time_step = simulation->Update();
+			steps++;
+			snapshots.Capture(partitions, time_step);
+			video.Capture(partitions, time_step);
+			if (options.record || options.metrics)
+			{
+				for (auto record : recorders)
+				{
+					record->RecordField(time_step);
+				}
+			}
+			if (options.early_stop && termination.Update(time_step))
+			{
+				break;
+			}
+			if (report_every && steps % report_every == 0)
+			{
+				std::cout << steps << "/" << total_time_steps << " (" << omp_get_wtime() - time2 << " s)" << std::endl;
+			}
+		}
+		double seconds = omp_get_wtime() - time2;
+
+		record_writer.Close();
+		snapshots.Close();
+		video.Close();
+		receivers->Close();
+		if (!source_export.get())
+		{
+			std::cout << "Cannot write " << dir_name << "/sources.bin" << std::endl;
+			status = EXIT_OUTPUT;
+		}
+		if (status == EXIT_OK && options.metrics)
+		{
+			RoomMetrics::ExportRecorders(recorders, dir_name);
+		}
+		if (status == EXIT_OK && options.ir)
+		{
+			ImpulseResponse::ExportRecorders(recorders, sources[0], dir_name, ImpulseResponse::Settings());
+		}
+
+		// One update of one field of one cell (DCT or PML) per step.
+		double updates = (double)simulation->num_cells() * config.fields * steps;
+		std::cout << "# Throughput. ##############################################" << std::endl;
+		std::cout << steps << " steps in " << seconds << " s on " << omp_get_max_threads() << " threads (" << options.backend << ")" << std::endl;
+		std::cout << steps / std::max(seconds, 1e-9) << " steps/s, " << updates / std::max(seconds, 1e-9) / 1e6 << " Mcell-updates/s" << std::endl;
+		std::cout << "############################################################" << std::endl;
+
+		for (auto& partition : partitions)
+			partition.reset();
+		simulation.reset();
+	}
+
+	if (use_gpu)
+	{
+		destroyVkGPU(&vkGPU);
+	}
+	if (options.trace)
+	{
+		Tracer::Export(dir_name + "/trace.json");
+	}
+	return status;
+}
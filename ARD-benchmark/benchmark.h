@@ -0,0 +1,10 @@
+#pragma once
+#include <vector>
+#include <string>
+
+// Comma separated command line lists: "1,2,4" / "corridor,grid".
+std::vector<int> ParseList(const char* arg);
+std::vector<std::string> ParseNames(const char* arg);
+
+// ARD-benchmark scaling ...: whole Simulation::Update on generated scenes, see scaling_benchmark.cpp.
+int RunScalingBenchmark(int argc, char** argv);
@@ -0,0 +1,302 @@
+/* ARD kernel benchmark
+ *
+ * Builds isolated DctVolume, DctPartition, PmlPartition (every PmlType) and Boundary objects
+ * at parametric sizes and times their update kernels on the FFTW and VkFFT backends and at
+ * different OpenMP thread counts. Reports cells/s, bytes/s (analytic model, see
+ * PerfCounters::ModelBytesPerCell) and ns/cell, and writes the same rows as JSON so runs can
+ * be compared across versions.
+ *
+ * Usage: ARD-benchmark [--sizes 16,32,64] [--threads 1,2,4,8] [--steps 50] [--warmup 5]
+ *                      [--no-gpu] [--out ./output/kernel_benchmark.json]
+ *        ARD-benchmark scaling ...	(whole simulation, see scaling_benchmark.cpp)
+ */
+
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <cstdlib>
+#include <cstring>
+#include <omp.h>
+
+#include "benchmark.h"
+#include "simulation.h"
+#include "partition.h"
+#include "dct_partition.h"
+#include "dct_volume.h"
+#include "pml_partition.h"
+#include "boundary.h"
+#include "perf_counters.h"
+
+#include "utils_VkFFT.h"
+
+/* Same constants as the simulator (main.cpp). */
+
+static const SimulationConfig config;
+
+struct BenchResult
+{
+	std::string kernel;		// volume, dct, pml, interface
+	std::string variant;	// PML type or boundary axis
+	std::string backend;	// fftw, vkfft or cpu
+	int size;				// edge length of the DCT cube the object is built from
+	int threads;
+	uint64_t cells;			// cells touched per call
+	int calls;
+	double seconds;
+	double bytes_per_cell;
+};
+
+std::vector<int> ParseList(const char* arg)
+{
+	std::vector<int> values;
+	std::stringstream ss(arg);
+	std::string item;
+	while (std::getline(ss, item, ','))
+	{
+		if (!item.empty())
+			values.push_back(atoi(item.c_str()));
+	}
+	return values;
+}
+
+std::vector<std::string> ParseNames(const char* arg)
+{
+	std::vector<std::string> names;
+	std::stringstream ss(arg);
+	std::string item;
+	while (std::getline(ss, item, ','))
+	{
+		if (!item.empty())
+			names.push_back(item);
+	}
+	return names;
+}
+
+// Fill every cell through the public setter so the kernels do not run on zeros (denormals, trivially predictable branches).
+static void FillForce(Partition* partition, int w, int h, int d)
+{
+	unsigned int seed = 12345u;
+	for (int z = 0; z < d; z++)
+		for (int y = 0; y < h; y++)
+			for (int x = 0; x < w; x++)
+			{
+				seed = seed * 1664525u + 1013904223u;
+				partition->set_force(x, y, z, ((seed >> 8) & 0xffff) / 65536.0f - 0.5f);
+			}
+}
+
+static double TimeCalls(const std::function<void()>& call, int warmup, int steps)
+{
+	for (int i = 0; i < warmup; i++)
+		call();
+	double start = omp_get_wtime();
+	for (int i = 0; i < steps; i++)
+		call();
+	return omp_get_wtime() - start;
+}
+
+static void PrintResult(const BenchResult& r)
+{
+	double cells = (double)r.cells * r.calls;
+	double seconds = r.seconds > 0 ? r.seconds : 1e-12;
+	std::cout << std::left << std::setw(10) << r.kernel << std::setw(10) << r.variant << std::setw(7) << r.backend
+		<< std::right << std::setw(6) << r.size << std::setw(5) << r.threads << std::setw(10) << r.cells
+		<< std::fixed
+		<< std::setw(10) << std::setprecision(2) << seconds * 1e9 / cells
+		<< std::setw(12) << std::setprecision(2) << cells / seconds * 1e-6
+		<< std::setw(10) << std::setprecision(2) << r.bytes_per_cell * cells / seconds * 1e-9
+		<< std::endl;
+	std::cout.unsetf(std::ios::fixed);
+}
+
+static bool WriteJson(const std::string& path, const std::vector<BenchResult>& results, int steps, int warmup, bool gpu)
+{
+	std::ofstream out(path);
+	if (!out.is_open())
+	{
+		std::cout << "Cannot write " << path << std::endl;
+		return false;
+	}
+	out << "{\n";
+	out << "\"dh\":" << config.dh << ",\"dt\":" << config.dt << ",\"pml_layers\":" << config.pml_layers
+		<< ",\"steps\":" << steps << ",\"warmup\":" << warmup << ",\"gpu\":" << (gpu ? "true" : "false")
+		<< ",\"max_threads\":" << omp_get_num_procs() << ",\n";
+	out << "\"results\":[\n";
+	out << std::setprecision(6);
+	for (size_t i = 0; i < results.size(); i++)
+	{
+		const BenchResult& r = results[i];
+		double cells = (double)r.cells * r.calls;
+		double seconds = r.seconds > 0 ? r.seconds : 1e-12;
+		out << "{\"kernel\":\"" << r.kernel << "\",\"variant\":\"" << r.variant << "\",\"backend\":\"" << r.backend
+			<< "\",\"size\":" << r.size << ",\"threads\":" << r.threads << ",\"cells\":" << r.cells << ",\"calls\":" << r.calls
+			<< ",\"seconds\":" << r.seconds
+			<< ",\"ns_per_cell\":" << seconds * 1e9 / cells
+			<< ",\"cells_per_s\":" << cells / seconds
+			<< ",\"bytes_per_cell\":" << r.bytes_per_cell
+			<< ",\"bytes_per_s\":" << r.bytes_per_cell * cells / seconds
+			<< "}" << (i + 1 < results.size() ? "," : "") << "\n";
+	}
+	out << "]\n}\n";
+	return true;
+}
+
+int main(int argc, char** argv)
+{
+	if (argc > 1 && !strcmp(argv[1], "scaling"))
+	{
+		return RunScalingBenchmark(argc - 2, argv + 2);
+	}
+
+	std::vector<int> sizes = { 16, 32, 64 };
+	std::vector<int> thread_counts;
+	for (int t = 1; t <= omp_get_num_procs(); t *= 2)
+		thread_counts.push_back(t);
+	int steps = 50;
+	int warmup = 5;
+	bool use_gpu = true;
+	std::string out_path = "./output/kernel_benchmark.json";
+
+	for (int i = 1; i < argc; i++)
+	{
+		bool has_value = i + 1 < argc;
+		if (!strcmp(argv[i], "--sizes") && has_value) sizes = ParseList(argv[++i]);
+		else if (!strcmp(argv[i], "--threads") && has_value) thread_counts = ParseList(argv[++i]);
+		else if (!strcmp(argv[i], "--steps") && has_value) steps = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--warmup") && has_value) warmup = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--out") && has_value) out_path = argv[++i];
+		else if (!strcmp(argv[i], "--no-gpu")) use_gpu = false;
+		else
+		{
+			std::cout << "Usage: " << argv[0] << " [--sizes 16,32,64] [--threads 1,2,4] [--steps 50] [--warmup 5] [--no-gpu] [--out path]" << std::endl;
+			return 1;
+		}
+	}
+	if (sizes.empty() || thread_counts.empty() || steps <= 0)
+	{
+		std::cout << "Nothing to run." << std::endl;
+		return 1;
+	}
+
+	VkGPU vkGPU = {};
+	if (use_gpu && initVkGPU(&vkGPU) != VKFFT_SUCCESS)
+	{
+		std::cout << "No Vulkan device, VkFFT backend skipped." << std::endl;
+		use_gpu = false;
+	}
+
+	const char* pml_names[] = { "P_LEFT", "P_RIGHT", "P_TOP", "P_BOTTOM", "P_FRONT", "P_BACK" };
+	const int layers = config.pml_layers;
+	std::vector<BenchResult> results;
+
+	std::cout << "############################################################" << std::endl;
+	std::cout << std::left << std::setw(10) << "kernel" << std::setw(10) << "variant" << std::setw(7) << "backend"
+		<< std::right << std::setw(6) << "size" << std::setw(5) << "thr" << std::setw(10) << "cells"
+		<< std::setw(10) << "ns/cell" << std::setw(12) << "Mcells/s" << std::setw(10) << "GB/s" << std::endl;
+	std::cout << "------------------------------------------------------------" << std::endl;
+
+	for (int n : sizes)
+	{
+		uint64_t cube = (uint64_t)n * n * n;
+
+		// DctVolume and DctPartition are single threaded (the simulation runs partitions in parallel instead),
+		// so they are timed once per size and backend rather than per thread count.
+
+		// Transform pair on its own. Bytes: each transform streams input and output once, then one normalisation pass.
+		for (int gpu = 0; gpu <= (use_gpu ? 1 : 0); gpu++)
+		{
+			DctVolume volume(n, n, n, gpu ? &vkGPU : nullptr);
+			double seconds = TimeCalls([&]() { volume.ExecuteDct(); volume.ExecuteIdct(); }, warmup, steps);
+			results.push_back({ "volume", "dct+idct", gpu ? "vkfft" : "fftw", n, 1, cube, steps, seconds, 4.0 * (2 + 2 + 2 + 2) });
+			PrintResult(results.back());
+		}
+
+		// Full DCT partition step; the GPU variant runs DCT, mode update and IDCT in one submit.
+		for (int gpu = 0; gpu <= (use_gpu ? 1 : 0); gpu++)
+		{
+			auto partition = std::make_shared<DctPartition>(config, 0, 0, 0, n, n, n, gpu ? &vkGPU : nullptr);
+			FillForce(partition.get(), n, n, n);
+			double seconds = TimeCalls([&]() { partition->Update(); }, warmup, steps);
+			results.push_back({ "dct", "partition", gpu ? "vkfft" : "fftw", n, 1, cube, steps, seconds,
+				PerfCounters::ModelBytesPerCell(PerfCounters::K_DCT) });
+			PrintResult(results.back());
+		}
+
+		// PML slabs of every orientation around an n^3 partition, as Simulation builds them.
+		auto neighbor = std::make_shared<DctPartition>(config, 0, 0, 0, n, n, n, nullptr);
+		for (int type = PmlPartition::P_LEFT; type <= PmlPartition::P_BACK; type++)
+		{
+			int w = n, h = n, d = n;
+			int xs = 0, ys = 0, zs = 0;
+			switch (type)
+			{
+			case PmlPartition::P_LEFT:		w = layers; xs = -layers; break;
+			case PmlPartition::P_RIGHT:		w = layers; xs = n; break;
+			case PmlPartition::P_TOP:		h = layers; ys = -layers; break;
+			case PmlPartition::P_BOTTOM:	h = layers; ys = n; break;
+			case PmlPartition::P_FRONT:		d = layers; zs = -layers; break;
+			case PmlPartition::P_BACK:		d = layers; zs = n; break;
+			}
+			auto pml = std::make_shared<PmlPartition>(neighbor, (PmlPartition::PmlType)type, xs, ys, zs, w, h, d);
+			uint64_t cells = (uint64_t)w * h * d;
+			for (int t : thread_counts)
+			{
+				omp_set_num_threads(t);
+				// Update clears the force after the first call, later calls propagate what is left in p and phi.
+				FillForce(pml.get(), w, h, d);
+				double seconds = TimeCalls([&]() { pml->Update(); }, warmup, steps);
+				results.push_back({ "pml", pml_names[type], "cpu", n, t, cells, steps, seconds,
+					PerfCounters::ModelBytesPerCell(PerfCounters::K_PML) });
+				PrintResult(results.back());
+			}
+		}
+
+		// Interfaces: X and Y between two DCT partitions, Z between a front PML and a DCT partition.
+		{
+			auto a = std::make_shared<DctPartition>(config, 0, 0, 0, n, n, n, nullptr);
+			auto right = std::make_shared<DctPartition>(config, n, 0, 0, n, n, n, nullptr);
+			auto below = std::make_shared<DctPartition>(config, 0, n, 0, n, n, n, nullptr);
+			auto front = std::make_shared<PmlPartition>(a, PmlPartition::P_FRONT, 0, 0, -layers, n, n, layers);
+			FillForce(a.get(), n, n, n);
+			FillForce(right.get(), n, n, n);
+			FillForce(below.get(), n, n, n);
+
+			std::shared_ptr<Boundary> boundaries[] = {
+				Boundary::FindBoundary(a, right),
+				Boundary::FindBoundary(a, below),
+				std::make_shared<Boundary>(Boundary::Z_BOUNDARY, config.absorption, front, a, 0, n, 0, n, -3, 3) };
+			const char* axis_names[] = { "X", "Y", "Z" };
+			uint64_t face = (uint64_t)n * n;
+			for (int b = 0; b < 3; b++)
+			{
+				for (int t : thread_counts)
+				{
+					omp_set_num_threads(t);
+					double seconds = TimeCalls([&]() { boundaries[b]->ComputeForcingTerms(); }, warmup, steps);
+					results.push_back({ "interface", axis_names[b], "cpu", n, t, face, steps, seconds,
+						PerfCounters::ModelBytesPerCell(PerfCounters::K_INTERFACE) });
+					PrintResult(results.back());
+				}
+			}
+		}
+	}
+
+	std::cout << "############################################################" << std::endl;
+
+	if (use_gpu)
+	{
+		destroyVkGPU(&vkGPU);
+	}
+
+	if (!WriteJson(out_path, results, steps, warmup, use_gpu))
+	{
+		return 1;
+	}
+	std::cout << "Results written to " << out_path << std::endl;
+	return 0;
+}
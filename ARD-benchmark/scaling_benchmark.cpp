@@ -0,0 +1,235 @@
+/* Whole-simulation scaling benchmark
+ *
+ * Generates scenes with SceneGenerator, loads them back through the regular importers and runs
+ * Simulation::Update headless (no visualisation) for a fixed number of steps.
+ *
+ * strong: every scene size is run at every thread count.
+ * weak:   the scene scale grows with the thread count (scale = first scale * threads / first thread count).
+ *
+ * Parallel efficiency is (cell updates/s per thread) relative to the first thread count of the same
+ * scene kind (and scale, for strong scaling), so 1.0 is perfect scaling.
+ *
+ * Usage: ARD-benchmark scaling [--scenes corridor,grid,hall,long-hall] [--scales 1,2,4] [--threads 1,2,4,8]
+ *                              [--steps 50] [--warmup 5] [--gpu] [--out ./output/scaling_benchmark.json]
+ */
+
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdlib>
+#include <cstring>
+#include <omp.h>
+
+#include "benchmark.h"
+#include "simulation.h"
+#include "partition.h"
+#include "sound_source.h"
+#include "scene_generator.h"
+
+#include "utils_VkFFT.h"
+
+static const SimulationConfig config;	// same constants as the simulator (main.cpp)
+
+struct ScalingResult
+{
+	std::string mode;		// strong or weak
+	std::string scene;
+	int scale;
+	int threads;
+	int partitions;
+	uint64_t cells;			// DCT + PML cells per step
+	int steps;
+	double seconds;
+	double efficiency;
+};
+
+static std::shared_ptr<Simulation> LoadScene(const std::string& kind, int scale, VkGPU* vkGPU, std::vector<std::shared_ptr<Partition>>& partitions,
+	std::vector<std::shared_ptr<SoundSource>>& sources)
+{
+	auto boxes = SceneGenerator::Build(kind, scale);
+	std::string base = "./output/scene_" + kind + "_" + std::to_string(scale);
+	if (boxes.empty() || !SceneGenerator::Write(base + ".txt", boxes) || !SceneGenerator::WriteSource(base + "-sources.txt", boxes))
+	{
+		return nullptr;
+	}
+	partitions = Partition::ImportPartitions(config, base + ".txt", vkGPU);
+	sources = SoundSource::ImportSources(config, base + "-sources.txt");
+	if (partitions.empty() || sources.empty())
+	{
+		return nullptr;
+	}
+	auto simulation = std::make_shared<Simulation>(config, partitions, sources);
+	simulation->render_ = false;
+	return simulation;
+}
+
+static double RunSteps(Simulation* simulation, int warmup, int steps)
+{
+	for (int i = 0; i < warmup; i++)
+		simulation->Update();
+	double start = omp_get_wtime();
+	for (int i = 0; i < steps; i++)
+		simulation->Update();
+	return omp_get_wtime() - start;
+}
+
+static void PrintResult(const ScalingResult& r)
+{
+	double updates = (double)r.cells * r.steps;
+	std::cout << std::left << std::setw(8) << r.mode << std::setw(11) << r.scene
+		<< std::right << std::setw(6) << r.scale << std::setw(5) << r.threads << std::setw(6) << r.partitions
+		<< std::setw(11) << r.cells << std::fixed
+		<< std::setw(10) << std::setprecision(2) << r.steps / r.seconds
+		<< std::setw(11) << std::setprecision(2) << updates / r.seconds * 1e-6
+		<< std::setw(7) << std::setprecision(2) << r.efficiency
+		<< std::endl;
+	std::cout.unsetf(std::ios::fixed);
+}
+
+static bool WriteJson(const std::string& path, const std::vector<ScalingResult>& results, int steps, int warmup, bool gpu)
+{
+	std::ofstream out(path);
+	if (!out.is_open())
+	{
+		std::cout << "Cannot write " << path << std::endl;
+		return false;
+	}
+	out << "{\n";
+	out << "\"dh\":" << config.dh << ",\"dt\":" << config.dt << ",\"steps\":" << steps << ",\"warmup\":" << warmup
+		<< ",\"gpu\":" << (gpu ? "true" : "false") << ",\"max_threads\":" << omp_get_num_procs() << ",\n";
+	out << "\"results\":[\n";
+	out << std::setprecision(6);
+	for (size_t i = 0; i < results.size(); i++)
+	{
+		const ScalingResult& r = results[i];
+		double updates = (double)r.cells * r.steps;
+		out << "{\"mode\":\"" << r.mode << "\",\"scene\":\"" << r.scene << "\",\"scale\":" << r.scale << ",\"threads\":" << r.threads
+			<< ",\"partitions\":" << r.partitions << ",\"cells\":" << r.cells << ",\"steps\":" << r.steps << ",\"seconds\":" << r.seconds
+			<< ",\"steps_per_s\":" << r.steps / r.seconds
+			<< ",\"cell_updates_per_s\":" << updates / r.seconds
+			<< ",\"efficiency\":" << r.efficiency
+			<< "}" << (i + 1 < results.size() ? "," : "") << "\n";
+	}
+	out << "]\n}\n";
+	return true;
+}
+
+int RunScalingBenchmark(int argc, char** argv)
+{
+	std::vector<std::string> scenes = { "corridor", "grid", "hall", "long-hall" };
+	std::vector<int> scales = { 1, 2, 4 };
+	std::vector<int> thread_counts;
+	for (int t = 1; t <= omp_get_num_procs(); t *= 2)
+		thread_counts.push_back(t);
+	int steps = 50;
+	int warmup = 5;
+	bool use_gpu = false;
+	std::string out_path = "./output/scaling_benchmark.json";
+
+	for (int i = 0; i < argc; i++)
+	{
+		bool has_value = i + 1 < argc;
+		if (!strcmp(argv[i], "--scenes") && has_value) scenes = ParseNames(argv[++i]);
+		else if (!strcmp(argv[i], "--scales") && has_value) scales = ParseList(argv[++i]);
+		else if (!strcmp(argv[i], "--threads") && has_value) thread_counts = ParseList(argv[++i]);
+		else if (!strcmp(argv[i], "--steps") && has_value) steps = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--warmup") && has_value) warmup = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--out") && has_value) out_path = argv[++i];
+		else if (!strcmp(argv[i], "--gpu")) use_gpu = true;
+		else
+		{
+			std::cout << "Usage: ARD-benchmark scaling [--scenes corridor,grid,hall,long-hall] [--scales 1,2,4] [--threads 1,2,4] "
+				"[--steps 50] [--warmup 5] [--gpu] [--out path]" << std::endl;
+			return 1;
+		}
+	}
+	if (scenes.empty() || scales.empty() || thread_counts.empty() || steps <= 0)
+	{
+		std::cout << "Nothing to run." << std::endl;
+		return 1;
+	}
+
+	VkGPU vkGPU = {};
+	if (use_gpu && initVkGPU(&vkGPU) != VKFFT_SUCCESS)
+	{
+		std::cout << "No Vulkan device, running on the CPU." << std::endl;
+		use_gpu = false;
+	}
+
+	std::vector<ScalingResult> results;
+	bool ok = true;
+
+	std::cout << "############################################################" << std::endl;
+	std::cout << std::left << std::setw(8) << "mode" << std::setw(11) << "scene"
+		<< std::right << std::setw(6) << "scale" << std::setw(5) << "thr" << std::setw(6) << "parts"
+		<< std::setw(11) << "cells" << std::setw(10) << "steps/s" << std::setw(11) << "Mupd/s" << std::setw(7) << "eff" << std::endl;
+	std::cout << "------------------------------------------------------------" << std::endl;
+
+	for (auto& kind : scenes)
+	{
+		// Strong scaling: same scene, more threads.
+		for (int scale : scales)
+		{
+			std::vector<std::shared_ptr<Partition>> partitions;
+			std::vector<std::shared_ptr<SoundSource>> sources;
+			auto simulation = LoadScene(kind, scale, use_gpu ? &vkGPU : nullptr, partitions, sources);
+			if (!simulation)
+			{
+				ok = false;
+				continue;
+			}
+			double base_rate = 0.0;
+			for (int t : thread_counts)
+			{
+				omp_set_num_threads(t);
+				ScalingResult r = { "strong", kind, scale, t, (int)partitions.size(), simulation->num_cells(), steps, 0.0, 1.0 };
+				r.seconds = RunSteps(simulation.get(), warmup, steps);
+				double rate = (double)r.cells * steps / r.seconds / t;
+				if (base_rate == 0.0) base_rate = rate;
+				r.efficiency = rate / base_rate;
+				results.push_back(r);
+				PrintResult(r);
+			}
+		}
+
+		// Weak scaling: the scene grows with the thread count.
+		double base_rate = 0.0;
+		for (int t : thread_counts)
+		{
+			int scale = scales.front() * t / thread_counts.front();
+			std::vector<std::shared_ptr<Partition>> partitions;
+			std::vector<std::shared_ptr<SoundSource>> sources;
+			auto simulation = LoadScene(kind, scale, use_gpu ? &vkGPU : nullptr, partitions, sources);
+			if (!simulation)
+			{
+				ok = false;
+				continue;
+			}
+			omp_set_num_threads(t);
+			ScalingResult r = { "weak", kind, scale, t, (int)partitions.size(), simulation->num_cells(), steps, 0.0, 1.0 };
+			r.seconds = RunSteps(simulation.get(), warmup, steps);
+			double rate = (double)r.cells * steps / r.seconds / t;
+			if (base_rate == 0.0) base_rate = rate;
+			r.efficiency = rate / base_rate;
+			results.push_back(r);
+			PrintResult(r);
+		}
+	}
+
+	std::cout << "############################################################" << std::endl;
+
+	if (use_gpu)
+	{
+		destroyVkGPU(&vkGPU);
+	}
+
+	if (!WriteJson(out_path, results, steps, warmup, use_gpu))
+	{
+		return 1;
+	}
+	std::cout << "Results written to " << out_path << std::endl;
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,117 @@
+#define _USE_MATH_DEFINES
+#include <cmath>
+#include "auralizer.h"
+#include "convolver.h"
+#include "impulse_response.h"
+#include "tracer.h"
+#include "wav_file.h"
+#include <algorithm>
+#include <iostream>
+#include <iomanip>
+#include <memory>
+#include <omp.h>
+
+
+static std::string BaseName(const std::string& path)
+{
+	size_t slash = path.find_last_of("/\\");
+	std::string name = (slash == std::string::npos) ? path : path.substr(slash + 1);
+	size_t dot = name.find_last_of('.');
+	return (dot == std::string::npos) ? name : name.substr(0, dot);
+}
+
+bool Auralizer::Run(const std::string& dry_path, const std::vector<std::string>& ir_paths, const std::string& out_dir, const SimulationConfig& config, const Settings& settings)
+{
+	WavReader dry;
+	if (!dry.Open(dry_path))
+	{
+		return false;
+	}
+	int channels = dry.channels();
+	int rate = dry.sample_rate();
+	size_t frames = dry.frames();
+	int block = settings.block_size;
+	int order = settings.fir_order & ~1;	// even order: integer group delay
+	int delay = order / 2;
+
+	real_t fcut = settings.fcut > 0.0f ? settings.fcut : config.c0 / (2.3f * config.dh);
+	fcut = std::min(fcut, 0.5f * rate);
+
+	// fir1(order, fcut, 'high') = delta(delay) - low-pass.
+	std::vector<float> highpass = ImpulseResponse::Fir1Lowpass(order, fcut / (0.5f * rate));
+	for (float& h : highpass)
+		h = -h;
+	highpass[delay] += 1.0f;
+
+	std::vector<char> ok(ir_paths.size(), 0);
+	double start = omp_get_wtime();
+
+#pragma omp parallel for schedule(dynamic)
+	for (int n = 0; n < (int)ir_paths.size(); n++)
+	{
+		TraceSpan span("auralize", n);
+		WavReader ir_file;
+		if (!ir_file.Open(ir_paths[n]))
+		{
+			continue;
+		}
+		std::vector<float> ir = ir_file.ReadChannel(0);
+		ir = ImpulseResponse::Resample(ir, ir_file.sample_rate(), rate);
+
+		// Combined filter: IR delayed to line up with the (causal) high-pass, plus the dry path.
+		std::vector<float> filter(std::max(ir.size() + delay, highpass.size()), 0.0f);
+		for (size_t i = 0; i < ir.size(); i++)
+			filter[i + delay] = ir[i];
+		for (size_t i = 0; i < highpass.size(); i++)
+			filter[i] += settings.dry_gain * highpass[i];
+
+		std::vector<std::unique_ptr<PartitionedConvolver>> convolvers;
+		for (int c = 0; c < channels; c++)
+			convolvers.push_back(std::make_unique<PartitionedConvolver>(filter, block));
+
+		std::string out_path = out_dir + "/" + BaseName(dry_path) + "-" + BaseName(ir_paths[n]) + ".wav";
+		WavWriter out;
+		if (!out.Open(out_path, channels, rate))
+		{
+			continue;
+		}
+
+		// Same length as the input (like fftfilt), shifted by the group delay: run delay samples past the end.
+		std::vector<float> in(block), wet(block), interleaved((size_t)block * channels);
+		size_t produced = 0;
+		float peak = 0.0f;
+		for (size_t first = 0; produced < frames + delay; first += block)
+		{
+			for (int c = 0; c < channels; c++)
+			{
+				dry.Read(c, first, block, in.data());
+				convolvers[c]->Process(in.data(), wet.data());
+				for (int i = 0; i < block; i++)
+					interleaved[(size_t)i * channels + c] = wet[i];
+			}
+			// Keep output samples [delay, delay + frames).
+			size_t skip = produced < (size_t)delay ? std::min((size_t)block, delay - produced) : 0;
+			size_t keep = std::min((size_t)block - skip, frames + delay - std::max(produced, (size_t)delay));
+			for (size_t i = 0; i < keep * channels; i++)
+				peak = std::max(peak, fabsf(interleaved[skip * channels + i]));
+			out.Write(&interleaved[skip * channels], keep);
+			produced += block;
+		}
+		ok[n] = out.Close(settings.normalise && peak > 0.0f ? 1.0f / peak : 1.0f);
+	}
+
+	double seconds = omp_get_wtime() - start;
+	double audio = (double)frames / rate * ir_paths.size();
+	int written = (int)std::count(ok.begin(), ok.end(), 1);
+
+	std::cout << "# Auralization. ############################################" << std::endl;
+	std::cout << BaseName(dry_path) << ": " << channels << " ch, " << rate << " Hz, " << (double)frames / rate << " s" << std::endl;
+	std::cout << written << "/" << ir_paths.size() << " impulse responses, high-pass " << fcut << " Hz, dry gain " << settings.dry_gain << std::endl;
+	std::ios::fmtflags flags = std::cout.flags();
+	std::streamsize precision = std::cout.precision();
+	std::cout << std::fixed << std::setprecision(2) << seconds << " s, " << (seconds > 0 ? audio / seconds : 0.0) << "x real time" << std::endl;
+	std::cout.flags(flags);
+	std::cout.precision(precision);
+	std::cout << "############################################################" << std::endl;
+	return written == (int)ir_paths.size();
+}
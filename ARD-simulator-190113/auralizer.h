@@ -0,0 +1,30 @@
+#pragma once
+#include <string>
+#include <vector>
+#include "types.h"
+#include "simulation_config.h"
+
+/* Auralisation: the second half of matlab/auralization.m in native code.
+ *
+ * For every impulse response: y = ir * x + dry_gain * highpass(x), normalised to peak 1, where the
+ * high-pass is fir1(fir_order, fcut, 'high') of the dry signal. Both terms are linear, so they are
+ * folded into one filter (IR delayed by the high-pass' group delay, plus the high-pass) and run
+ * through one PartitionedConvolver per channel; the group delay is trimmed from the output.
+ * The dry file is memory mapped and streamed block by block; impulse responses are processed in
+ * parallel, each writing its own float WAV.
+ */
+class Auralizer
+{
+public:
+	struct Settings
+	{
+		real_t fcut{ 0.0f };		// Hz; 0: c0 / (2.3 dh) of the simulation, the band limit ImpulseResponse low-passes at
+		real_t dry_gain{ 0.9f };
+		int fir_order{ 1024 };
+		int block_size{ 1024 };
+		bool normalise{ true };
+	};
+
+	// Writes <out_dir>/<dry name>-<ir name>.wav for every impulse response; false if any failed.
+	static bool Run(const std::string& dry_path, const std::vector<std::string>& ir_paths, const std::string& out_dir, const SimulationConfig& config, const Settings& settings);
+};
@@ -1,6 +1,7 @@
 #include "boundary.h"
 #include "partition.h"
-#include "simulation.h"
+#include "tracer.h"
+#include "perf_counters.h"
 #include <algorithm>
 
 
@@ -8,8 +9,7 @@ Boundary::Boundary(BoundaryType type, real_t absorp, std::shared_ptr<Partition>
 	int xs, int xe, int ys, int ye, int zs, int ze)
 	: type_(type), absorption_(absorp), a_(a), b_(b), x_start_(xs), x_end_(xe), y_start_(ys), y_end_(ye), z_start_(zs), z_end_(ze)
 {
-	static int id_generator = 0;
-	info_.id = id_generator++;
+	info_.id = 0;	// numbered by Simulation
 	info_.a_id = a_->info_.id;
 	info_.b_id = b_->info_.id;
 }
@@ -18,8 +18,65 @@ Boundary::~Boundary()
 {
 }
 
+int Boundary::CellIndex(const Partition* part, int x, int y, int z)
+{
+	if (x < 0 || x >= part->width_ || y < 0 || y >= part->height_ || z < 0 || z >= part->depth_)
+		return -1;
+	return (z * part->height_ + y) * part->width_ + x;
+}
+
+/* One face cell: lo[] are the three cells of the first partition nearest the interface (outermost last),
+ * hi[] the three of the second (innermost last). The indices are computed once and reused for every field.
+ * Cells outside a partition read as zero and are not written, as the PML's spare cell did before.
+ */
+void Boundary::Exchange(const Side& first, const Side& second, const int lo[3], const int hi[3], const real_t coefs[6][6], real_t scale)
+{
+	const int fields = a_->config_.fields;
+	for (int f = 0; f < fields; f++)
+	{
+		size_t first_offset = (size_t)f * first.stride;
+		size_t second_offset = (size_t)f * second.stride;
+		real_t values[6];
+		for (int n = 0; n < 3; n++)
+		{
+			values[n] = lo[n] < 0 ? 0.0f : first.pressure[first_offset + lo[n]];
+			values[n + 3] = hi[n] < 0 ? 0.0f : second.pressure[second_offset + hi[n]];
+		}
+		for (int m = -3; m < 3; m++)
+		{
+			real_t sip1 = 0.0;
+			real_t sip2 = 0.0;
+			for (int n = 0; n < 3; n++)
+			{
+				sip1 += coefs[m + 3][n] * values[n];
+			}
+			for (int n = 3; n < 6; n++)
+			{
+				sip2 += coefs[m + 3][n] * values[n];
+			}
+			if (m < 0)
+			{
+				real_t sip = first.self_terms ? (sip1 + sip2) : sip2;
+				if (lo[m + 3] >= 0)
+					first.force[first_offset + lo[m + 3]] = absorption_ * (sip * scale);
+			}
+			else
+			{
+				real_t sip = second.self_terms ? (sip1 + sip2) : sip1;
+				if (hi[m] >= 0)
+					second.force[second_offset + hi[m]] = absorption_ * (sip * scale);
+			}
+		}
+	}
+}
+
 void Boundary::ComputeForcingTerms()
 {
+	TraceSpan span("interface", info_.id);
+	uint64_t face_cells = (type_ == X_BOUNDARY) ? (uint64_t)(y_end_ - y_start_) * (z_end_ - z_start_)
+						: (type_ == Y_BOUNDARY) ? (uint64_t)(x_end_ - x_start_) * (z_end_ - z_start_)
+						: (uint64_t)(x_end_ - x_start_) * (y_end_ - y_start_);
+	PerfScope perf(PerfCounters::K_INTERFACE, info_.id, face_cells * a_->config_.fields);
 	real_t coefs[6][6] = {
 		{  0.0,   0.0,   -2.0,    2.0,   0.0,  0.0 },
 		{  0.0,  -2.0,   27.0,  -27.0,   2.0,  0.0 },
@@ -27,11 +84,18 @@ void Boundary::ComputeForcingTerms()
 		{  2.0, -27.0,  270.0, -270.0,  27.0, -2.0 },
 		{  0.0,   2.0,  -27.0,   27.0,  -2.0,  0.0 },
 		{  0.0,   0.0,    2.0,   -2.0,   0.0,  0.0 } };
+	const SimulationConfig& config = a_->config_;
+	real_t scale = (config.c0*config.c0) / (180.0f*config.dh*config.dh);
+	auto side = [](const std::shared_ptr<Partition>& part)
+	{
+		return Side{ part->get_pressure_field(), part->get_force_field(), part->field_stride_, part->include_self_terms_ };
+	};
 	if (type_ == X_BOUNDARY)
 	{
 		bool is_a_left = (x_start_ <= a_->x_end_&&x_end_ >= a_->x_end_);
 		auto left = is_a_left ? a_ : b_;
 		auto right = is_a_left ? b_ : a_;
+		Side first = side(left), second = side(right);
 #pragma omp parallel for
 		for (int i = y_start_; i < y_end_; i++)
 		{
@@ -41,37 +105,13 @@ void Boundary::ComputeForcingTerms()
 				int right_y = i - right->y_start_;
 				int left_z = j - left->z_start_;
 				int right_z = j - right->z_start_;
-				for (int m = -3; m < 3; m++)
+				int lo[3], hi[3];
+				for (int n = 0; n < 3; n++)
 				{
-					int left_x = left->width_ + m;
-					int right_x = m;
-					real_t sip = 0.0;
-					real_t sip1 = 0.0;
-					real_t sip2 = 0.0;
-					real_t fi = 0.0;
-					for (int n = 0; n < 3; n++)
-					{
-						sip1 += coefs[m + 3][n] * left->get_pressure(left->width_ - 3 + n, left_y, left_z);
-					}
-					for (int n = 3; n < 6; n++)
-					{
-						sip2 += coefs[m + 3][n] * right->get_pressure(n - 3, right_y, right_z);
-					}
-					if (m < 0)
-					{
-						//sip = sip1 + sip2;
-						sip = left->include_self_terms_ ? (sip1 + sip2) : sip2;
-						fi = sip * (Simulation::m_c0*Simulation::m_c0) / (180.0f*Simulation::m_dh*Simulation::m_dh);
-						left->set_force(left_x, left_y, left_z, absorption_*fi);
-					}
-					else {
-						//sip = sip1 + sip2;
-						sip = right->include_self_terms_ ? (sip1 + sip2) : sip1;
-						fi = sip * (Simulation::m_c0*Simulation::m_c0) / (180.0f*Simulation::m_dh*Simulation::m_dh);
-						right->set_force(right_x, right_y, right_z, absorption_*fi);
-					}
+					lo[n] = CellIndex(left.get(), left->width_ - 3 + n, left_y, left_z);
+					hi[n] = CellIndex(right.get(), n, right_y, right_z);
 				}
-
+				Exchange(first, second, lo, hi, coefs, scale);
 			}
 		}
 	}
@@ -80,6 +120,7 @@ void Boundary::ComputeForcingTerms()
 		bool is_a_top = (y_start_ <= a_->y_end_ && y_end_ >= a_->y_end_);
 		auto top = is_a_top ? a_ : b_;
 		auto bottom = is_a_top ? b_ : a_;
+		Side first = side(top), second = side(bottom);
 #pragma omp parallel for
 		for (int i = x_start_; i < x_end_; i++)
 		{
@@ -89,37 +130,13 @@ void Boundary::ComputeForcingTerms()
 				int bottom_x = i - bottom->x_start_;
 				int top_z = j - top->z_start_;
 				int bottom_z = j - bottom->z_start_;
-				for (int m = -3; m < 3; m++)
+				int lo[3], hi[3];
+				for (int n = 0; n < 3; n++)
 				{
-					int top_y = top->height_ + m;
-					int bottom_y = m;
-					real_t sip = 0.0;
-					real_t sip1 = 0.0;
-					real_t sip2 = 0.0;
-					real_t fi = 0.0;
-					for (int n = 0; n < 3; n++)
-					{
-						sip1 += coefs[m + 3][n] * top->get_pressure(top_x, top->height_ - 3 + n, top_z);
-					}
-					for (int n = 3; n < 6; n++)
-					{
-						sip2 += coefs[m + 3][n] * bottom->get_pressure(bottom_x, n - 3, bottom_z);
-					}
-					if (m < 0)
-					{
-						//sip = sip1 + sip2;
-						sip = top->include_self_terms_ ? (sip1 + sip2) : sip2;
-						fi = sip * (Simulation::m_c0*Simulation::m_c0) / (180.0f*Simulation::m_dh*Simulation::m_dh);
-						top->set_force(top_x, top_y, top_z, absorption_*fi);
-					}
-					else {
-						//sip = sip1 + sip2;
-						sip = bottom->include_self_terms_ ? (sip1 + sip2) : sip1;
-						fi = sip * (Simulation::m_c0*Simulation::m_c0) / (180.0f*Simulation::m_dh*Simulation::m_dh);
-						bottom->set_force(bottom_x, bottom_y, bottom_z, absorption_*fi);
-					}
+					lo[n] = CellIndex(top.get(), top_x, top->height_ - 3 + n, top_z);
+					hi[n] = CellIndex(bottom.get(), bottom_x, n, bottom_z);
 				}
-
+				Exchange(first, second, lo, hi, coefs, scale);
 			}
 		}
 	}
@@ -128,6 +145,7 @@ void Boundary::ComputeForcingTerms()
 		bool is_a_front = (z_start_ <= a_->z_end_ && z_end_ >= a_->z_end_);
 		auto front = is_a_front ? a_ : b_;
 		auto back = is_a_front ? b_ : a_;
+		Side first = side(front), second = side(back);
 #pragma omp parallel for
 		for (int i = x_start_; i < x_end_; i++)
 		{
@@ -137,37 +155,13 @@ void Boundary::ComputeForcingTerms()
 				int back_x = i - back->x_start_;
 				int front_y = j - front->y_start_;
 				int back_y = j - back->y_start_;
-				for (int m = -3; m < 3; m++)
+				int lo[3], hi[3];
+				for (int n = 0; n < 3; n++)
 				{
-					int front_z = front->depth_ + m;
-					int back_z = m;
-					real_t sip = 0.0;
-					real_t sip1 = 0.0;
-					real_t sip2 = 0.0;
-					real_t fi = 0.0;
-					for (int n = 0; n < 3; n++)
-					{
-						sip1 += coefs[m + 3][n] * front->get_pressure(front_x, front_y, front->depth_ - 3 + n);
-					}
-					for (int n = 3; n < 6; n++)
-					{
-						sip2 += coefs[m + 3][n] * back->get_pressure(back_x, back_y, n - 3);
-					}
-					if (m < 0)
-					{
-						//sip = sip1 + sip2;
-						sip = front->include_self_terms_ ? (sip1 + sip2) : sip2;
-						fi = sip * (Simulation::m_c0*Simulation::m_c0) / (180.0f*Simulation::m_dh*Simulation::m_dh);
-						front->set_force(front_x, front_y, front_z, absorption_*fi);
-					}
-					else {
-						//sip = sip1 + sip2;
-						sip = back->include_self_terms_ ? (sip1 + sip2) : sip1;
-						fi = sip * (Simulation::m_c0*Simulation::m_c0) / (180.0f*Simulation::m_dh*Simulation::m_dh);
-						back->set_force(back_x, back_y, back_z, absorption_*fi);
-					}
+					lo[n] = CellIndex(front.get(), front_x, front_y, front->depth_ - 3 + n);
+					hi[n] = CellIndex(back.get(), back_x, back_y, n);
 				}
-
+				Exchange(first, second, lo, hi, coefs, scale);
 			}
 		}
 	}
@@ -24,6 +24,16 @@ class Boundary
 
 	real_t absorption_{ 1.0 };
 
+	struct Side
+	{
+		const real_t* pressure;
+		real_t* force;
+		int stride;			// between fields
+		bool self_terms;
+	};
+	static int CellIndex(const Partition* part, int x, int y, int z);
+	void Exchange(const Side& first, const Side& second, const int lo[3], const int hi[3], const real_t coefs[6][6], real_t scale);
+
 public:
 
 
@@ -43,5 +53,7 @@ public:
 	void Info();
 
 	friend class Partition;
+	friend class Simulation;
+	friend class ScenePackage;
 };
 
@@ -0,0 +1,127 @@
+#include "convolver.h"
+#include <algorithm>
+#include <cstring>
+#if defined(_M_X64) || defined(__SSE2__)
+#include <xmmintrin.h>
+#define CONVOLVER_SSE
+#endif
+
+
+std::mutex& PartitionedConvolver::PlanMutex()
+{
+	static std::mutex mutex;
+	return mutex;
+}
+
+// acc += x * h over n complex values in split form, n a multiple of 4, arrays 16-byte aligned.
+static void ComplexMac(const float* xr, const float* xi, const float* hr, const float* hi, float* ar, float* ai, int n)
+{
+#ifdef CONVOLVER_SSE
+	for (int k = 0; k < n; k += 4)
+	{
+		__m128 a = _mm_load_ps(xr + k);
+		__m128 b = _mm_load_ps(xi + k);
+		__m128 c = _mm_load_ps(hr + k);
+		__m128 d = _mm_load_ps(hi + k);
+		__m128 re = _mm_sub_ps(_mm_mul_ps(a, c), _mm_mul_ps(b, d));
+		__m128 im = _mm_add_ps(_mm_mul_ps(a, d), _mm_mul_ps(b, c));
+		_mm_store_ps(ar + k, _mm_add_ps(_mm_load_ps(ar + k), re));
+		_mm_store_ps(ai + k, _mm_add_ps(_mm_load_ps(ai + k), im));
+	}
+#else
+	for (int k = 0; k < n; k++)
+	{
+		ar[k] += xr[k] * hr[k] - xi[k] * hi[k];
+		ai[k] += xr[k] * hi[k] + xi[k] * hr[k];
+	}
+#endif
+}
+
+PartitionedConvolver::PartitionedConvolver(const std::vector<float>& ir, int block_size)
+	: block_(block_size)
+{
+	int n = 2 * block_;
+	partitions_ = std::max(1, (int)((ir.size() + block_ - 1) / block_));
+	stride_ = (block_ + 1 + 15) & ~15;	// 64-byte rows: every slot keeps the alignment FFTW planned with
+
+	size_t spectra = (size_t)partitions_ * stride_;
+	input_ = (float*)fftwf_malloc(sizeof(float) * n);
+	output_ = (float*)fftwf_malloc(sizeof(float) * n);
+	ir_re_ = (float*)fftwf_malloc(sizeof(float) * spectra);
+	ir_im_ = (float*)fftwf_malloc(sizeof(float) * spectra);
+	fdl_re_ = (float*)fftwf_malloc(sizeof(float) * spectra);
+	fdl_im_ = (float*)fftwf_malloc(sizeof(float) * spectra);
+	acc_re_ = (float*)fftwf_malloc(sizeof(float) * stride_);
+	acc_im_ = (float*)fftwf_malloc(sizeof(float) * stride_);
+
+	fftwf_iodim dim = { n, 1, 1 };
+	{
+		std::lock_guard<std::mutex> lock(PlanMutex());
+		forward_ = fftwf_plan_guru_split_dft_r2c(1, &dim, 0, nullptr, input_, fdl_re_, fdl_im_, FFTW_MEASURE);
+		inverse_ = fftwf_plan_guru_split_dft_c2r(1, &dim, 0, nullptr, acc_re_, acc_im_, output_, FFTW_MEASURE);
+	}
+
+	// Planning may scribble over the arrays, so fill them afterwards. Padding bins stay zero.
+	memset(ir_re_, 0, sizeof(float) * spectra);
+	memset(ir_im_, 0, sizeof(float) * spectra);
+	memset(fdl_re_, 0, sizeof(float) * spectra);
+	memset(fdl_im_, 0, sizeof(float) * spectra);
+	memset(input_, 0, sizeof(float) * n);
+
+	// Each partition is zero padded to 2B; the 1 / 2B of the unnormalised inverse is folded in here.
+	float scale = 1.0f / n;
+	for (int p = 0; p < partitions_; p++)
+	{
+		memset(output_, 0, sizeof(float) * n);
+		size_t first = (size_t)p * block_;
+		size_t count = first < ir.size() ? std::min((size_t)block_, ir.size() - first) : 0;
+		for (size_t i = 0; i < count; i++)
+			output_[i] = ir[first + i] * scale;
+		fftwf_execute_split_dft_r2c(forward_, output_, ir_re_ + (size_t)p * stride_, ir_im_ + (size_t)p * stride_);
+	}
+	memset(fdl_re_, 0, sizeof(float) * spectra);
+	memset(fdl_im_, 0, sizeof(float) * spectra);
+}
+
+PartitionedConvolver::~PartitionedConvolver()
+{
+	{
+		std::lock_guard<std::mutex> lock(PlanMutex());
+		fftwf_destroy_plan(forward_);
+		fftwf_destroy_plan(inverse_);
+	}
+	fftwf_free(input_);
+	fftwf_free(output_);
+	fftwf_free(ir_re_);
+	fftwf_free(ir_im_);
+	fftwf_free(fdl_re_);
+	fftwf_free(fdl_im_);
+	fftwf_free(acc_re_);
+	fftwf_free(acc_im_);
+}
+
+void PartitionedConvolver::Process(const float* in, float* out)
+{
+	// Slide the 2B input window by one block and transform it into the newest delay line slot.
+	memmove(input_, input_ + block_, sizeof(float) * block_);
+	memcpy(input_ + block_, in, sizeof(float) * block_);
+	float* slot_re = fdl_re_ + (size_t)fdl_pos_ * stride_;
+	float* slot_im = fdl_im_ + (size_t)fdl_pos_ * stride_;
+	fftwf_execute_split_dft_r2c(forward_, input_, slot_re, slot_im);
+
+	memset(acc_re_, 0, sizeof(float) * stride_);
+	memset(acc_im_, 0, sizeof(float) * stride_);
+	for (int p = 0; p < partitions_; p++)
+	{
+		int slot = fdl_pos_ - p;
+		if (slot < 0) slot += partitions_;
+		ComplexMac(fdl_re_ + (size_t)slot * stride_, fdl_im_ + (size_t)slot * stride_,
+			ir_re_ + (size_t)p * stride_, ir_im_ + (size_t)p * stride_, acc_re_, acc_im_, stride_);
+	}
+
+	// Overlap-save: the first half of the circular result is aliased, keep the second.
+	fftwf_execute_split_dft_c2r(inverse_, acc_re_, acc_im_, output_);
+	memcpy(out, output_ + block_, sizeof(float) * block_);
+
+	fdl_pos_ = (fdl_pos_ + 1) % partitions_;
+}
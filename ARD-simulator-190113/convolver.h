@@ -0,0 +1,50 @@
+#pragma once
+#include <fftw3.h>
+#include <mutex>
+#include <vector>
+
+/* Uniformly partitioned overlap-save convolution (UPOLS).
+ *
+ * The impulse response is cut into P partitions of block_size samples, each transformed once
+ * (FFT size 2 * block_size). Every input block is transformed once into a frequency-domain delay
+ * line; an output block is the inverse transform of sum_p X[k - p] * H[p]. Spectra are kept in
+ * split real/imaginary arrays padded to a multiple of 16, so the complex multiply-accumulate is a
+ * plain SSE loop. Latency is one block; cost per sample is O(log B + P).
+ */
+class PartitionedConvolver
+{
+public:
+	PartitionedConvolver(const std::vector<float>& ir, int block_size = 1024);
+	~PartitionedConvolver();
+	PartitionedConvolver(const PartitionedConvolver&) = delete;
+	PartitionedConvolver& operator=(const PartitionedConvolver&) = delete;
+
+	// Consumes block_size input samples and produces block_size output samples.
+	void Process(const float* in, float* out);
+
+	int block_size() const
+	{
+		return block_;
+	}
+
+	// FFTW planning is not thread safe (executing plans is); every planner in the simulator takes this lock.
+	static std::mutex& PlanMutex();
+
+private:
+	int block_;
+	int partitions_;
+	int stride_;		// padded number of bins (block + 1 rounded up to 16)
+	int fdl_pos_{ 0 };
+
+	float* input_;		// last two input blocks
+	float* output_;
+	float* ir_re_;		// partitions x stride
+	float* ir_im_;
+	float* fdl_re_;		// frequency-domain delay line, partitions x stride
+	float* fdl_im_;
+	float* acc_re_;
+	float* acc_im_;
+
+	fftwf_plan forward_;
+	fftwf_plan inverse_;
+};
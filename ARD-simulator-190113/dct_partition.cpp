@@ -1,53 +1,116 @@
 #define _USE_MATH_DEFINES
 #include <cmath>
 #include "dct_partition.h"
+#include "tracer.h"
+#include "perf_counters.h"
+#include <cstring>
 #include <iostream>
+#include <map>
+#include <tuple>
 
 
-DctPartition::DctPartition(int xs, int ys, int zs, int w, int h, int d, VkGPU* vkGPU)
-	: Partition(xs, ys, zs, w, h, d)
-	, m_pressure(w, h, d, vkGPU)
-	, m_force(w, h, d, vkGPU)
-{
-	should_render_ = true;
-	info_.type = "DCT";
-
-	prev_modes_ = (real_t*)calloc(width_*height_*depth_, sizeof(real_t));
-	next_modes_ = (real_t*)calloc(width_*height_*depth_, sizeof(real_t));
-	cwt_ = (real_t*)calloc(width_*height_*depth_, sizeof(real_t));
-	w2_ = (real_t*)calloc(width_*height_*depth_, sizeof(real_t));
+// Weak references: a table lives as long as some partition (or ShareCoefficients handle) uses it.
+typedef std::tuple<int, int, int, real_t, real_t, real_t> CoefficientKey;
+static std::mutex coefficient_mutex;
+static std::map<CoefficientKey, std::weak_ptr<const void>> coefficient_tables;
 
-	lx2_ = width_ * width_*dh_*dh_;
-	ly2_ = height_ * height_*dh_*dh_;
-	lz2_ = depth_ * depth_*dh_*dh_;
+std::shared_ptr<const DctPartition::ModeCoefficients> DctPartition::Coefficients(int w, int h, int d, const SimulationConfig& config)
+{
+	CoefficientKey key(w, h, d, config.dh, config.dt, config.c0);
+	std::lock_guard<std::mutex> lock(coefficient_mutex);
+	if (auto table = coefficient_tables[key].lock())
+	{
+		return std::static_pointer_cast<const ModeCoefficients>(table);
+	}
 
-	for (int i = 1; i <= depth_; i++)
+	auto table = std::make_shared<ModeCoefficients>();
+	size_t cells = (size_t)w * h * d;
+	table->storage.resize(2 * cells);
+	real_t* cwt = table->storage.data();
+	real_t* w2 = cwt + cells;
+	table->cwt = cwt;
+	table->w2 = w2;
+	real_t lx2 = w * w * config.dh * config.dh;	// actual length ^2
+	real_t ly2 = h * h * config.dh * config.dh;
+	real_t lz2 = d * d * config.dh * config.dh;
+	for (int i = 1; i <= d; i++)
 	{
-		for (int j = 1; j <= height_; j++)
+		for (int j = 1; j <= h; j++)
 		{
-			for (int k = 1; k <= width_; k++)
+			for (int k = 1; k <= w; k++)
 			{
-				int idx = (i - 1) * height_ * width_ + (j - 1) * width_ + (k - 1);
-				real_t w = c0_ * (float)M_PI * sqrtf(i * i / lz2_ + j * j / ly2_ + k * k / lx2_);
-				w2_[idx] = w * w;
-				cwt_[idx] = cosf(w * dt_);
+				int idx = (i - 1) * h * w + (j - 1) * w + (k - 1);
+				real_t omega = config.c0 * (float)M_PI * sqrtf(i * i / lz2 + j * j / ly2 + k * k / lx2);
+				w2[idx] = omega * omega;
+				cwt[idx] = cosf(omega * config.dt);
 			}
 		}
 	}
+	coefficient_tables[key] = std::static_pointer_cast<const void>(table);
+	return table;
+}
+
+std::shared_ptr<const void> DctPartition::ShareCoefficients(int w, int h, int d, const SimulationConfig& config,
+	const real_t* cwt, const real_t* w2, std::shared_ptr<const void> owner)
+{
+	CoefficientKey key(w, h, d, config.dh, config.dt, config.c0);
+	std::lock_guard<std::mutex> lock(coefficient_mutex);
+	if (auto table = coefficient_tables[key].lock())
+	{
+		return table;
+	}
+	auto table = std::make_shared<ModeCoefficients>();
+	table->owner = owner;
+	table->cwt = cwt;
+	table->w2 = w2;
+	coefficient_tables[key] = std::static_pointer_cast<const void>(table);
+	return table;
+}
+
+DctPartition::DctPartition(const SimulationConfig& config, int xs, int ys, int zs, int w, int h, int d, VkGPU* vkGPU)
+	: Partition(config, xs, ys, zs, w, h, d)
+	, m_pressure(w, h, d, nullptr, config.fields)	// CPU transforms only, the GPU path runs through gpu_step_
+	, m_force(w, h, d, nullptr, config.fields)
+{
+	should_render_ = true;
+	info_.type = "DCT";
+	field_stride_ = width_ * height_ * depth_;
+
+	prev_modes_ = (real_t*)calloc((size_t)field_stride_ * config_.fields, sizeof(real_t));
+	next_modes_ = (real_t*)calloc((size_t)field_stride_ * config_.fields, sizeof(real_t));
+	coefficients_ = Coefficients(width_, height_, depth_, config_);
+	cwt_ = coefficients_->cwt;
+	w2_ = coefficients_->w2;
+
+	if (vkGPU && config_.fields == 1)
+	{
+		gpu_step_ = new VkFFT_ArdStep(vkGPU, width_, height_, depth_, cwt_, w2_, m_force.m_values, m_pressure.m_values);
+	}
 }
 
 
 DctPartition::~DctPartition()
 {
+	delete gpu_step_;
 	free(prev_modes_);
 	free(next_modes_);
-	free(cwt_);
-	free(w2_);
 }
 
 void DctPartition::Update()
 {
-	m_force.ExecuteDct();
+	PerfScope perf(PerfCounters::K_DCT, info_.id, (uint64_t)width_ * height_ * depth_ * config_.fields);
+	if (gpu_step_)
+	{
+		// Same update as below, but the modes only live on the GPU (m_pressure.m_modes is not kept in sync).
+		TraceSpan span("gpu step", info_.id);
+		gpu_step_->execute();
+		return;
+	}
+
+	{
+		TraceSpan span("forward dct", info_.id);
+		m_force.ExecuteDct();
+	}
 #if 0
 	for (int i = 0; i < depth_; i++)
 	{
@@ -63,28 +126,103 @@ void DctPartition::Update()
 	memcpy((void*)prev_modes_, (void*)pressure_.modes_, depth_ * width_ * height_ * sizeof(real_t));
 	memcpy((void*)pressure_.modes_, (void*)next_modes_, depth_ * width_ * height_ * sizeof(real_t));
 #else
-	int total = depth_ * height_ * width_;
-	for (int idx = 0; idx < total; idx++)
-		next_modes_[idx] = 0.999f * (2.0f * m_pressure.m_modes[idx] * cwt_[idx] - prev_modes_[idx] + (2.0f * m_force.m_modes[idx] / w2_[idx]) * (1.0f - cwt_[idx]));
-	memcpy((void*)prev_modes_, (void*)m_pressure.m_modes, depth_ * width_ * height_ * sizeof(real_t));
-	memcpy((void*)m_pressure.m_modes, (void*)next_modes_, depth_ * width_ * height_ * sizeof(real_t));
+	{
+		TraceSpan span("mode update", info_.id);
+		int total = depth_ * height_ * width_;
+		for (int f = 0; f < config_.fields; f++)
+		{
+			// Fields share the mode frequencies, so cwt_ and w2_ stay in cache across them.
+			const real_t* pressure = m_pressure.m_modes + (size_t)f * total;
+			const real_t* force = m_force.m_modes + (size_t)f * total;
+			const real_t* prev = prev_modes_ + (size_t)f * total;
+			real_t* next = next_modes_ + (size_t)f * total;
+			for (int idx = 0; idx < total; idx++)
+				next[idx] = 0.999f * (2.0f * pressure[idx] * cwt_[idx] - prev[idx] + (2.0f * force[idx] / w2_[idx]) * (1.0f - cwt_[idx]));
+		}
+		memcpy((void*)prev_modes_, (void*)m_pressure.m_modes, (size_t)total * config_.fields * sizeof(real_t));
+		memcpy((void*)m_pressure.m_modes, (void*)next_modes_, (size_t)total * config_.fields * sizeof(real_t));
+	}
 #endif
-	m_pressure.ExecuteIdct();
+	if (lazy_idct_)
+	{
+		values_stale_.store(true, std::memory_order_release);
+		return;
+	}
+	{
+		TraceSpan span("idct", info_.id);
+		m_pressure.ExecuteIdct();
+	}
+}
+
+void DctPartition::Materialize()
+{
+	if (!values_stale_.load(std::memory_order_acquire))
+	{
+		return;
+	}
+	std::lock_guard<std::mutex> lock(idct_mutex_);
+	if (values_stale_.load(std::memory_order_relaxed))
+	{
+		TraceSpan span("idct", info_.id);
+		m_pressure.ExecuteIdct();
+		values_stale_.store(false, std::memory_order_release);
+	}
+}
+
+void DctPartition::set_lazy_idct(bool lazy)
+{
+	Materialize();
+	lazy_idct_ = lazy && !gpu_step_;
+}
+
+/* Every mode follows M[n+1] = 2 cos(w dt) M[n] - M[n-1], which conserves
+ * M[n]^2 + M[n-1]^2 - 2 cos(w dt) M[n] M[n-1] = A^2 sin^2(w dt) for M = A cos(w n dt).
+ * Dividing by sin^2 gives the mode's squared amplitude, i.e. its energy. DctVolume scales the
+ * transform pair orthonormally, so by Parseval the plain sum over modes is the partition's energy
+ * and partitions of different sizes add up in Simulation::Energy().
+ * The GPU path keeps the modes on the device, so it is not tracked there.
+ */
+double DctPartition::ModeEnergy()
+{
+	if (gpu_step_)
+	{
+		return -1.0;
+	}
+	int total = depth_ * height_ * width_;
+	double energy = 0.0;
+	for (int f = 0; f < config_.fields; f++)
+	{
+		const real_t* modes = m_pressure.m_modes + (size_t)f * total;
+		const real_t* prev = prev_modes_ + (size_t)f * total;
+		for (int idx = 0; idx < total; idx++)
+		{
+			double m = modes[idx], p = prev[idx], c = cwt_[idx];
+			energy += (m * m + p * p - 2.0 * c * m * p) / (1.0 - c * c);
+		}
+	}
+	return energy;
 }
 
 real_t* DctPartition::get_pressure_field()
 {
+	Materialize();
 	return m_pressure.m_values;
 }
 
-real_t DctPartition::get_pressure(int x, int y, int z)
+real_t* DctPartition::get_force_field()
+{
+	return m_force.m_values;
+}
+
+real_t DctPartition::get_pressure(int x, int y, int z, int field)
 {
-	return m_pressure.get_value(x, y, z);
+	Materialize();
+	return m_pressure.get_value(x, y, z, field);
 }
 
-void DctPartition::set_force(int x, int y, int z, real_t f)
+void DctPartition::set_force(int x, int y, int z, real_t f, int field)
 {
-	m_force.set_value(x, y, z, f);
+	m_force.set_value(x, y, z, f, field);
 }
 
 std::vector<real_t> DctPartition::get_xy_forcing_plane(int z)
@@ -117,6 +255,5 @@ std::vector<real_t> DctPartition::get_xy_force_plane(int z)
 void DctPartition::Info()
 {
 	Partition::Info();
-	std::cout << "pressure on " << (m_pressure.is_gpu() ? "GPU" : "CPU") << std::endl;
-	std::cout << "force on " << (m_force.is_gpu() ? "GPU" : "CPU") << std::endl;
+	std::cout << "update on " << (gpu_step_ ? "GPU (DCT, mode update, IDCT in one submit)" : "CPU") << std::endl;
 }
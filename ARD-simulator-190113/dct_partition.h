@@ -1,13 +1,28 @@
 #pragma once
 
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
 #include "partition.h"
 #include "dct_volume.h"
 
 class DctPartition : public Partition
 {
-	real_t lx2_, ly2_, lz2_;	// actual length ^2
-	real_t *cwt_{ nullptr };	// cos(wt)
-	real_t *w2_{ nullptr };		// w^2
+	// Mode frequencies depend only on the size and on dh, dt and c0, so partitions of the same
+	// size share one immutable table (e.g. every variant of a parameter sweep).
+	struct ModeCoefficients
+	{
+		std::vector<real_t> storage;		// cwt then w2, unless the table lives in a mapped file
+		std::shared_ptr<const void> owner;	// keeps a mapped table alive
+		const real_t* cwt{ nullptr };		// cos(wt)
+		const real_t* w2{ nullptr };		// w^2
+	};
+	static std::shared_ptr<const ModeCoefficients> Coefficients(int w, int h, int d, const SimulationConfig& config);
+
+	std::shared_ptr<const ModeCoefficients> coefficients_;
+	const real_t *cwt_{ nullptr };
+	const real_t *w2_{ nullptr };
 
 	DctVolume m_pressure;
 	DctVolume m_force;
@@ -15,19 +30,57 @@ class DctPartition : public Partition
 	real_t *prev_modes_{ nullptr };
 	real_t *next_modes_{ nullptr };
 
+	VkFFT_ArdStep* gpu_step_{ nullptr };	// DCT -> mode update -> IDCT on the GPU, modes stay on the device
+
+	// Lazy IDCT: Update() leaves the pressure stale, the first reader of the step transforms it.
+	bool lazy_idct_{ false };
+	std::atomic<bool> values_stale_{ false };
+	std::mutex idct_mutex_;
+
+	void Materialize();
+
 public:
-	DctPartition(int xs, int ys, int zs, int w, int h, int d, VkGPU* vkGPU);
+	DctPartition(const SimulationConfig& config, int xs, int ys, int zs, int w, int h, int d, VkGPU* vkGPU);
 	~DctPartition();
 
+	/* Precomputed tables (w * h * d values each, e.g. in a ScenePackage) for partitions of this size and
+	 * grid built while the returned handle or any such partition lives; owner keeps cwt and w2 valid.
+	 * If the size already has a table, that one is kept.
+	 */
+	static std::shared_ptr<const void> ShareCoefficients(int w, int h, int d, const SimulationConfig& config,
+		const real_t* cwt, const real_t* w2, std::shared_ptr<const void> owner);
+	// The table for partitions of this size and grid, computed now and kept while the handle lives.
+	static std::shared_ptr<const void> HoldCoefficients(int w, int h, int d, const SimulationConfig& config)
+	{
+		return Coefficients(w, h, d, config);
+	}
+
 	virtual void Update();
 
 	virtual real_t* get_pressure_field();
-	virtual real_t get_pressure(int x, int y, int z);
-	virtual void set_force(int x, int y, int z, real_t f);
+	virtual real_t* get_force_field();
+	virtual real_t get_pressure(int x, int y, int z, int field = 0);
+	virtual void set_force(int x, int y, int z, real_t f, int field = 0);
 	virtual std::vector<real_t> get_xy_forcing_plane(int z);
 	virtual void Info();
+	virtual double ModeEnergy();
+
+	// CPU path only. Whatever reads the pressure (boundaries, recorders, rendering) still gets it, so
+	// this only saves work in partitions nobody reads but mode-space receivers (ModeEvaluator).
+	// Every partition of an imported scene has boundaries (interfaces or PML) reading it each step,
+	// so at present every IDCT still runs: this saves nothing yet, it only moves the transform.
+	void set_lazy_idct(bool lazy);
+	bool lazy_idct() const
+	{
+		return lazy_idct_;
+	}
+	const real_t* modes(int field = 0) const
+	{
+		return m_pressure.m_modes + (size_t)field * field_stride_;
+	}
 
 	real_t get_force(int x, int y, int z);
 	std::vector<real_t> get_xy_force_plane(int z);
 	friend class Boundary;
+	friend class ScenePackage;
 };
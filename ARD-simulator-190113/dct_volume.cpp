@@ -1,36 +1,61 @@
 #include "dct_volume.h"
+#include "convolver.h"
 #include <assert.h>
+#include <mutex>
 
-DctVolume::DctVolume(int w, int h, int d, VkGPU* vkGPU) 
+DctVolume::DctVolume(int w, int h, int d, VkGPU* vkGPU, int fields) 
 	: m_width(w)
 	, m_height(h)
 	, m_depth(d)
-	, m_gpu(true)
+	, m_fields(fields)
+	, m_gpu(vkGPU != nullptr)
 {
+	assert(m_fields >= 1);
+	assert(!m_gpu || m_fields == 1);
 	int numCells = m_width * m_height * m_depth;
 
-	m_values = (real_t*)calloc(numCells, sizeof(real_t));
-	m_modes = (real_t*)calloc(numCells, sizeof(real_t));
+	m_values = (real_t*)calloc((size_t)numCells * m_fields, sizeof(real_t));
+	m_modes = (real_t*)calloc((size_t)numCells * m_fields, sizeof(real_t));
 
-	// FFTW plans
-	// FFTW_REDFT10 == DCT-II (the DCT)
-	m_dct = fftwf_plan_r2r_3d(m_depth, m_height, m_width, m_values, m_modes, FFTW_REDFT10, FFTW_REDFT10, FFTW_REDFT10, FFTW_MEASURE);
-	// FFTW_REDFT01 == IDCT-III (the IDCT)
-	m_idct = fftwf_plan_r2r_3d(m_depth, m_height, m_width, m_modes, m_values, FFTW_REDFT01, FFTW_REDFT01, FFTW_REDFT01, FFTW_MEASURE);
+	// FFTW plans; the planner is shared by every simulation in the process.
+	std::unique_lock<std::mutex> lock(PartitionedConvolver::PlanMutex());
+	if (m_fields == 1)
+	{
+		// FFTW_REDFT10 == DCT-II (the DCT)
+		m_dct = fftwf_plan_r2r_3d(m_depth, m_height, m_width, m_values, m_modes, FFTW_REDFT10, FFTW_REDFT10, FFTW_REDFT10, FFTW_MEASURE);
+		// FFTW_REDFT01 == IDCT-III (the IDCT)
+		m_idct = fftwf_plan_r2r_3d(m_depth, m_height, m_width, m_modes, m_values, FFTW_REDFT01, FFTW_REDFT01, FFTW_REDFT01, FFTW_MEASURE);
+	}
+	else
+	{
+		// One plan for all fields, so FFTW can interleave the volumes' passes.
+		int n[3] = { m_depth, m_height, m_width };
+		fftwf_r2r_kind dct[3] = { FFTW_REDFT10, FFTW_REDFT10, FFTW_REDFT10 };
+		fftwf_r2r_kind idct[3] = { FFTW_REDFT01, FFTW_REDFT01, FFTW_REDFT01 };
+		m_dct = fftwf_plan_many_r2r(3, n, m_fields, m_values, nullptr, 1, numCells, m_modes, nullptr, 1, numCells, dct, FFTW_MEASURE);
+		m_idct = fftwf_plan_many_r2r(3, n, m_fields, m_modes, nullptr, 1, numCells, m_values, nullptr, 1, numCells, idct, FFTW_MEASURE);
+	}
+	lock.unlock();
 
-	// vkFFT applications
-	m_vkFFTdct = new VkFFT_DCT(vkGPU, 2, m_width, m_height, m_depth, m_values, m_modes);
-	assert(m_vkFFTdct != nullptr);
-	m_vkFFTidct = new VkFFT_DCT(vkGPU, 3, m_width, m_height, m_depth, m_modes, m_values);
-	assert(m_vkFFTidct != nullptr);
+	// vkFFT applications, only when a GPU is given
+	if (m_gpu)
+	{
+		m_vkFFTdct = new VkFFT_DCT(vkGPU, 2, m_width, m_height, m_depth, m_values, m_modes);
+		assert(m_vkFFTdct != nullptr);
+		m_vkFFTidct = new VkFFT_DCT(vkGPU, 3, m_width, m_height, m_depth, m_modes, m_values);
+		assert(m_vkFFTidct != nullptr);
+	}
 }
 
 DctVolume::~DctVolume()
 {
 	delete m_vkFFTdct;
 	delete m_vkFFTidct;
-	fftwf_destroy_plan(m_dct);
-	fftwf_destroy_plan(m_idct);
+	{
+		std::lock_guard<std::mutex> lock(PartitionedConvolver::PlanMutex());
+		fftwf_destroy_plan(m_dct);
+		fftwf_destroy_plan(m_idct);
+	}
 	free(m_values);
 	free(m_modes);
 }
@@ -44,9 +69,9 @@ void DctVolume::ExecuteDct()
 		fftwf_execute(m_dct);
 
 	// FFTW3 does not normalize values, so we must perform this step, or values will be wacky.
-	int const total = m_depth * m_height * m_width;
+	size_t const total = (size_t)m_depth * m_height * m_width * m_fields;
 	float const scale = 1.0f / (2.0f * sqrtf(2.0f * m_depth * m_width * m_height));
-	for (int i = 0; i < total; i++) {
+	for (size_t i = 0; i < total; i++) {
 		m_modes[i] *= scale;
 	}
 }
@@ -60,29 +85,29 @@ void DctVolume::ExecuteIdct()
 		fftwf_execute(m_idct);
 
 	// Normalization
-	int const total = m_depth * m_height * m_width;
+	size_t const total = (size_t)m_depth * m_height * m_width * m_fields;
 	float const scale = 1.0f / sqrtf(2.0f * m_depth * m_width * m_height);
-	for (int i = 0; i < total; i++)	{
+	for (size_t i = 0; i < total; i++)	{
 		m_values[i] *= scale;
 	}
 }
 
-real_t DctVolume::get_value(int x, int y, int z)
+real_t DctVolume::get_value(int x, int y, int z, int field)
 {
-	return m_values[z * m_height * m_width + y * m_width + x];
+	return m_values[((size_t)field * m_depth + z) * m_height * m_width + y * m_width + x];
 }
 
-real_t DctVolume::get_mode(int x, int y, int z)
+real_t DctVolume::get_mode(int x, int y, int z, int field)
 {
-	return m_modes[z * m_height * m_width + y * m_width + x];
+	return m_modes[((size_t)field * m_depth + z) * m_height * m_width + y * m_width + x];
 }
 
-void DctVolume::set_value(int x, int y, int z, real_t v)
+void DctVolume::set_value(int x, int y, int z, real_t v, int field)
 {
-	m_values[z * m_height * m_width + y * m_width + x] = v;
+	m_values[((size_t)field * m_depth + z) * m_height * m_width + y * m_width + x] = v;
 }
 
-void DctVolume::set_mode(int x, int y, int z, real_t m)
+void DctVolume::set_mode(int x, int y, int z, real_t m, int field)
 {
-	m_modes[z * m_height * m_width + y * m_width + x] = m;
+	m_modes[((size_t)field * m_depth + z) * m_height * m_width + y * m_width + x] = m;
 }
@@ -6,32 +6,36 @@
 #include "types.h"
 #include "utils_VkFFT.h"
 
+/* fields > 1 stacks that many independent volumes of the same size (field-major, one after the
+ * other), transformed together by one batched FFTW plan. The GPU path is single-field.
+ */
 class DctVolume
 {
 public:
-	DctVolume(int w, int h, int d, VkGPU* vkGPU);
+	DctVolume(int w, int h, int d, VkGPU* vkGPU, int fields = 1);
 	~DctVolume();
 
 	void ExecuteDct();
 	void ExecuteIdct();
 
-	real_t get_value(int x, int y, int z);
-	real_t get_mode(int x, int y, int z);
-	void set_value(int x, int y, int z, real_t v);
-	void set_mode(int x, int y, int z, real_t m);
+	real_t get_value(int x, int y, int z, int field = 0);
+	real_t get_mode(int x, int y, int z, int field = 0);
+	void set_value(int x, int y, int z, real_t v, int field = 0);
+	void set_mode(int x, int y, int z, real_t m, int field = 0);
 	bool is_gpu() const { return m_gpu; }
 
 private:
 	int			m_width;
 	int			m_height;
 	int			m_depth;
+	int			m_fields;
 	real_t*		m_values;
 	real_t*		m_modes;
 	fftwf_plan	m_dct;
 	fftwf_plan	m_idct;
-	VkFFT_DCT*	m_vkFFTdct;		// forward DCT (DCT-II)
-	VkFFT_DCT*	m_vkFFTidct;	// inverse DCT (DCT-III)
-	bool		m_gpu{ true };	// use GPU or CPU
+	VkFFT_DCT*	m_vkFFTdct{ nullptr };	// forward DCT (DCT-II)
+	VkFFT_DCT*	m_vkFFTidct{ nullptr };	// inverse DCT (DCT-III)
+	bool		m_gpu{ true };	// use GPU or CPU, GPU when constructed with a VkGPU
 
 	friend class Partition;
 	friend class DctPartition;
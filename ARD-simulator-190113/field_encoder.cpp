@@ -0,0 +1,112 @@
+#define _USE_MATH_DEFINES
+#include <cmath>
+#include "field_encoder.h"
+#include "partition.h"
+#include <algorithm>
+#include <cassert>
+
+
+namespace
+{
+	// 1D central differences of order 0..3 on offsets -2..2, per unit spacing; 4th-order accurate
+	// except the third derivative (2nd-order, the best a 5-point stencil allows).
+	const double kDerivative[4][5] = {
+		{ 0.0, 0.0, 1.0, 0.0, 0.0 },
+		{ 1.0 / 12, -2.0 / 3, 0.0, 2.0 / 3, -1.0 / 12 },
+		{ -1.0 / 12, 4.0 / 3, -5.0 / 2, 4.0 / 3, -1.0 / 12 },
+		{ -0.5, 1.0, 0.0, -1.0, 0.5 },
+	};
+
+	struct Term
+	{
+		int a, b, c;	// powers of x, y, z
+		double coefficient;
+	};
+
+	// Real SN3D spherical harmonics in ACN order as homogeneous polynomials in the unit direction.
+	std::vector<std::vector<Term>> Harmonics()
+	{
+		const double s3 = sqrt(3.0), s15 = sqrt(15.0), s38 = sqrt(3.0 / 8), s58 = sqrt(5.0 / 8);
+		return {
+			{ { 0, 0, 0, 1.0 } },													// W
+			{ { 0, 1, 0, 1.0 } },													// Y
+			{ { 0, 0, 1, 1.0 } },													// Z
+			{ { 1, 0, 0, 1.0 } },													// X
+			{ { 1, 1, 0, s3 } },													// V
+			{ { 0, 1, 1, s3 } },													// T
+			{ { 0, 0, 2, 1.0 }, { 2, 0, 0, -0.5 }, { 0, 2, 0, -0.5 } },				// R
+			{ { 1, 0, 1, s3 } },													// S
+			{ { 2, 0, 0, s3 / 2 }, { 0, 2, 0, -s3 / 2 } },							// U
+			{ { 2, 1, 0, 3 * s58 }, { 0, 3, 0, -s58 } },							// Q
+			{ { 1, 1, 1, s15 } },													// O
+			{ { 0, 1, 2, 4 * s38 }, { 2, 1, 0, -s38 }, { 0, 3, 0, -s38 } },			// M
+			{ { 0, 0, 3, 1.0 }, { 2, 0, 1, -1.5 }, { 0, 2, 1, -1.5 } },				// K
+			{ { 1, 0, 2, 4 * s38 }, { 3, 0, 0, -s38 }, { 1, 2, 0, -s38 } },			// L
+			{ { 2, 0, 1, s15 / 2 }, { 0, 2, 1, -s15 / 2 } },						// N
+			{ { 3, 0, 0, s58 }, { 1, 2, 0, -3 * s58 } },							// P
+		};
+	}
+}
+
+FieldEncoder::FieldEncoder(const SimulationConfig& config, Encoding encoding, int order)
+	: encoding_(encoding)
+	, dt_(config.dt)
+{
+	assert(encoding != RAW_CUBE);
+	order = std::max(1, std::min(3, order));
+
+	auto harmonics = Harmonics();
+	std::vector<std::vector<Term>> channels;
+	if (encoding_ == PRESSURE_VELOCITY)
+	{
+		// p, then rho0 c0 v = -c0 * integral(grad p) = -(X, Y, Z)
+		channels = { harmonics[0], { { 1, 0, 0, -1.0 } }, { { 0, 1, 0, -1.0 } }, { { 0, 0, 1, -1.0 } } };
+	}
+	else
+	{
+		channels.assign(harmonics.begin(), harmonics.begin() + (order + 1) * (order + 1));
+	}
+
+	for (auto& terms : channels)
+	{
+		int n = terms[0].a + terms[0].b + terms[0].c;
+		double scale = pow(config.c0 / config.dh, n);	// c0^n and the 1 / dh^n of the differences
+		std::vector<real_t> kernel(125, 0.0f);
+		for (auto& term : terms)
+		{
+			for (int i = 0; i < 5; i++)
+				for (int j = 0; j < 5; j++)
+					for (int k = 0; k < 5; k++)
+						kernel[(i * 5 + j) * 5 + k] += (real_t)(scale * term.coefficient
+							* kDerivative[term.c][i] * kDerivative[term.b][j] * kDerivative[term.a][k]);
+		}
+		degree_.push_back(n);
+		kernels_.push_back(kernel);
+	}
+	state_.assign(degree_.size() * 3, 0.0);
+	leak_ = expf(-2.0f * (float)M_PI * 10.0f * dt_);	// 10 Hz high-pass keeps the integrators from drifting
+}
+
+void FieldEncoder::Encode(Partition* part, int x, int y, int z, real_t* out, int field)
+{
+	int n = 0;
+	for (int i = -2; i <= 2; i++)
+		for (int j = -2; j <= 2; j++)
+			for (int k = -2; k <= 2; k++)
+				neighbourhood_[n++] = part->get_pressure(x + k, y + j, z + i, field);
+
+	for (int ch = 0; ch < channels(); ch++)
+	{
+		const real_t* kernel = kernels_[ch].data();
+		double value = 0.0;
+		for (int i = 0; i < 125; i++)
+			value += kernel[i] * neighbourhood_[i];
+		double* state = &state_[ch * 3];
+		for (int d = 0; d < degree_[ch]; d++)
+		{
+			state[d] = leak_ * state[d] + dt_ * value;
+			value = state[d];
+		}
+		out[ch] = (real_t)value;
+	}
+}
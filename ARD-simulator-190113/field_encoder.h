@@ -0,0 +1,50 @@
+#pragma once
+#include <memory>
+#include <vector>
+#include "types.h"
+#include "simulation_config.h"
+
+class Partition;
+
+/* Directional encoding at a recorder, computed from the local stencil instead of dumping the
+ * 10x10x10 pressure neighbourhood.
+ *
+ * A plane wave arriving from direction d is p = f(t + d.x / c0), so an n-th order mixed derivative
+ * d^n p / dx^a dy^b dz^c, multiplied by c0^n and integrated n times in time, is dx^a dy^b dz^c f.
+ * Every real spherical harmonic of degree n is a homogeneous polynomial of degree n in d on the unit
+ * sphere, so each ambisonic channel is one fixed 5x5x5 stencil of central differences (4th-order
+ * accurate for the first and second derivatives, 2nd-order for the third, which would need 7 points
+ * for more) followed by n leaky integrators. Channels are ACN ordered, SN3D normalised (AmbiX),
+ * orders 1 to 3. PRESSURE_VELOCITY writes p and rho0 c0 v, which is minus the first-order X, Y, Z.
+ *
+ * Finite differences lose accuracy towards the grid's band limit (the first derivative is 15% of its
+ * true value at 2.3 cells per wavelength), so directional data is reliable well below c0 / (2.3 dh).
+ */
+class FieldEncoder
+{
+public:
+	enum Encoding { RAW_CUBE, PRESSURE_VELOCITY, AMBISONICS };	// values stored in record.bin
+
+	FieldEncoder(const SimulationConfig& config, Encoding encoding, int order = 1);
+
+	int channels() const
+	{
+		return (int)degree_.size();
+	}
+	Encoding encoding() const
+	{
+		return encoding_;
+	}
+
+	// Reads the 5x5x5 neighbourhood of (x, y, z) and writes channels() values.
+	void Encode(Partition* part, int x, int y, int z, real_t* out, int field = 0);
+
+private:
+	Encoding encoding_;
+	std::vector<int> degree_;					// per channel: number of time integrations
+	std::vector<std::vector<real_t>> kernels_;	// per channel: 125 weights, z, y, x order
+	std::vector<double> state_;					// per channel: 3 integrator states
+	real_t leak_;
+	real_t dt_;
+	real_t neighbourhood_[125];
+};
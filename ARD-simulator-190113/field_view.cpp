@@ -0,0 +1,198 @@
+#include "field_view.h"
+#include "simulation.h"
+#include "partition.h"
+#include "sound_source.h"
+#include "tracer.h"
+#include <algorithm>
+#include <cmath>
+#if defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+
+FieldView::FieldView(Simulation& simulation, const Settings& settings)
+	: settings_(settings), plane_(PlaneOf(simulation, settings.look_from, settings.slice))
+{
+	width_ = plane_.width;
+	height_ = plane_.height;
+	for (auto& slice : slices_)
+		slice.assign((size_t)width_ * height_, 0.0f);
+
+	interval_ = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+		std::chrono::duration<double>(1.0 / std::max(1.0f, settings.frames_per_second)));
+	next_frame_ = std::chrono::steady_clock::now();
+}
+
+FieldView::Plane FieldView::PlaneOf(Simulation& simulation, int look_from, int slice)
+{
+	Plane plane;
+	plane.look_from = look_from;
+	plane.slice = slice;
+	if (plane.slice < 0 && !simulation.m_sources.empty())
+	{
+		auto& source = simulation.m_sources[0];
+		plane.slice = look_from == 0 ? source->z() : (look_from == 1 ? source->x() : source->y());
+	}
+	plane.slice = std::max(plane.slice, 0);
+	plane.x0 = simulation.x_start_;
+	plane.y0 = simulation.y_start_;
+	plane.z0 = simulation.z_start_;
+	plane.width = look_from == 1 ? simulation.size_y() : simulation.size_x();
+	plane.height = look_from == 0 ? simulation.size_y() : simulation.size_z();
+	return plane;
+}
+
+void FieldView::CopyPlane(const std::vector<std::shared_ptr<Partition>>& partitions, const Plane& plane, real_t* out)
+{
+	int axis = plane.look_from;
+	for (auto& partition : partitions)
+	{
+		if (!partition->should_render_)
+		{
+			continue;
+		}
+		// Strided view straight into the partition's pressure array (field 0); partitions off the plane cost nothing.
+		int origin = axis == 0 ? partition->z_start_ : (axis == 1 ? partition->x_start_ : partition->y_start_);
+		PlaneView view = partition->plane(axis, plane.slice - origin);
+		if (view.empty())
+		{
+			continue;
+		}
+		int u = axis == 1 ? partition->y_start_ - plane.y0 : partition->x_start_ - plane.x0;
+		int v = axis == 0 ? partition->y_start_ - plane.y0 : partition->z_start_ - plane.z0;
+		view.CopyTo(out + (size_t)v * plane.width + u, plane.width);
+	}
+}
+
+void FieldView::ProjectPlane(const std::vector<std::shared_ptr<Partition>>& partitions, const Plane& plane, real_t* out)
+{
+	int axis = plane.look_from;
+	std::fill(out, out + (size_t)plane.width * plane.height, 0.0f);
+	for (auto& partition : partitions)
+	{
+		if (!partition->should_render_)
+		{
+			continue;
+		}
+		int extent = axis == 0 ? partition->depth_ : (axis == 1 ? partition->width_ : partition->height_);
+		int u0 = axis == 1 ? partition->y_start_ - plane.y0 : partition->x_start_ - plane.x0;
+		int v0 = axis == 0 ? partition->y_start_ - plane.y0 : partition->z_start_ - plane.z0;
+		std::vector<PlaneView> views(extent);	// before the parallel loop: plane() may materialise the field
+		for (int n = 0; n < extent; n++)
+			views[n] = partition->plane(axis, n);
+		// Rows of one partition are disjoint in the image, so they can go in parallel.
+#pragma omp parallel for
+		for (int v = 0; v < views[0].height; v++)
+		{
+			real_t* row = out + (size_t)(v0 + v) * plane.width + u0;
+			for (const PlaneView& view : views)
+			{
+				for (int u = 0; u < view.width; u++)
+				{
+					real_t value = view(u, v);
+					if (std::fabs(value) > std::fabs(row[u]))
+						row[u] = value;
+				}
+			}
+		}
+	}
+}
+
+const std::array<uint32_t, FieldView::kLutSize>& FieldView::Lut()
+{
+	// Blue (negative) - white - red (positive), as the per-pixel colouring had it.
+	static const std::array<uint32_t, kLutSize> lut = []()
+	{
+		std::array<uint32_t, kLutSize> table;
+		for (int i = 0; i < kLutSize; i++)
+		{
+			real_t norm = (real_t)i / (kLutSize - 1);
+			int r, g, b;
+			if (norm >= 0.5f)
+			{
+				r = 255;
+				g = b = static_cast<int>(255 - roundf(255.0f * 2.0f * (norm - 0.5f)));
+			}
+			else
+			{
+				r = g = static_cast<int>(255 - roundf(255.0f * (1.0f - 2.0f * norm)));
+				b = 255;
+			}
+			table[i] = 0xFF000000u | ((uint32_t)r << 16) | ((uint32_t)g << 8) | (uint32_t)b;
+		}
+		return table;
+	}();
+	return lut;
+}
+
+void FieldView::Capture(const std::vector<std::shared_ptr<Partition>>& partitions, int time_step)
+{
+	auto now = std::chrono::steady_clock::now();
+	if (now < next_frame_)
+	{
+		return;
+	}
+	int back = 1 - front_.load(std::memory_order_relaxed);
+	std::unique_lock<std::mutex> lock(locks_[back], std::try_to_lock);
+	if (!lock.owns_lock())
+	{
+		return;		// still being coloured, skip this frame
+	}
+	next_frame_ = now + interval_;
+	TraceSpan span("visualisation");
+
+	CopyPlane(partitions, plane_, slices_[back].data());
+	steps_[back] = time_step;
+	lock.unlock();
+	front_.store(back, std::memory_order_release);
+	fresh_.store(true, std::memory_order_release);
+}
+
+bool FieldView::Render(std::vector<uint32_t>& pixels, int* time_step)
+{
+	if (!fresh_.exchange(false, std::memory_order_acq_rel))
+	{
+		return false;
+	}
+	int front = front_.load(std::memory_order_acquire);
+	std::lock_guard<std::mutex> lock(locks_[front]);
+	const real_t* slice = slices_[front].data();
+	size_t n = slices_[front].size();
+	pixels.resize(n);
+	if (time_step)
+	{
+		*time_step = steps_[front];
+	}
+
+	Colourise(slice, n, settings_.gain, pixels.data());
+	return true;
+}
+
+void FieldView::Colourise(const real_t* values, size_t n, real_t gain, uint32_t* pixels)
+{
+	const std::array<uint32_t, kLutSize>& lut = Lut();
+	// index = clamp((p * gain * 0.5 + 0.5) * (size - 1), 0, size - 1)
+	float scale = 0.5f * gain * (kLutSize - 1);
+	float offset = 0.5f * (kLutSize - 1) + 0.5f;	// + 0.5: round to nearest with the truncating conversion
+	size_t i = 0;
+#if defined(_M_X64) || defined(__SSE2__)
+	__m128 vscale = _mm_set1_ps(scale), voffset = _mm_set1_ps(offset);
+	__m128 vmin = _mm_setzero_ps(), vmax = _mm_set1_ps((float)(kLutSize - 1));
+	for (; i + 4 <= n; i += 4)
+	{
+		__m128 v = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(values + i), vscale), voffset);
+		v = _mm_min_ps(_mm_max_ps(v, vmin), vmax);		// also turns NaN into 0
+		alignas(16) int32_t index[4];
+		_mm_store_si128((__m128i*)index, _mm_cvttps_epi32(v));
+		pixels[i] = lut[index[0]];
+		pixels[i + 1] = lut[index[1]];
+		pixels[i + 2] = lut[index[2]];
+		pixels[i + 3] = lut[index[3]];
+	}
+#endif
+	for (; i < n; i++)
+	{
+		float v = values[i] * scale + offset;
+		pixels[i] = lut[v > 0.0f ? (int)std::min(v, (float)(kLutSize - 1)) : 0];
+	}
+}
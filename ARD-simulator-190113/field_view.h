@@ -0,0 +1,86 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "types.h"
+
+class Partition;
+class Simulation;
+
+/* Preview of one plane of the field, decoupled from the solver.
+ *
+ * The solver calls Capture() after a step; when a frame is due (frames_per_second) it copies the
+ * plane from the partitions' pressure arrays (Partition::plane, strided views, no per-cell calls)
+ * into the back slice and publishes it. Only partitions crossing the plane are touched, so several
+ * views (Simulation::AddView) cost their own pixels each. It
+ * never waits: if the render side still holds that slice, the frame is skipped. The render thread
+ * calls Render(), which turns the newest slice into pixels through a colormap lookup table
+ * (SSE2 clamp and index computation, four cells at a time).
+ */
+class FieldView
+{
+public:
+	struct Settings
+	{
+		int look_from{ 0 };				// 0: xy plane at slice z, 1: yz plane at slice x, 2: xz plane at slice y
+		int slice{ -1 };				// cell along the normal, < 0: through the first source
+		real_t frames_per_second{ 30.0f };
+		real_t gain{ 10.0f };			// pressure * gain = +-1 saturates the colormap
+	};
+
+	// Where a plane of the simulation lands in an image: u along the first axis, v along the second.
+	struct Plane
+	{
+		int look_from;
+		int slice;			// global cell along the normal
+		int x0, y0, z0;		// simulation origin (cells)
+		int width, height;
+	};
+
+	FieldView(Simulation& simulation, const Settings& settings);
+
+	// Also used by FrameExporter.
+	static Plane PlaneOf(Simulation& simulation, int look_from, int slice);	// slice < 0: through the first source
+	// The plane of every rendered partition crossing it (field 0) into out, width x height.
+	static void CopyPlane(const std::vector<std::shared_ptr<Partition>>& partitions, const Plane& plane, real_t* out);
+	// Per pixel, the value of largest magnitude along the normal (sign kept), over every rendered partition.
+	static void ProjectPlane(const std::vector<std::shared_ptr<Partition>>& partitions, const Plane& plane, real_t* out);
+	// Blue (negative) - white - red (positive) colormap, 0xFFRRGGBB; value * gain = +-1 saturates.
+	static void Colourise(const real_t* values, size_t n, real_t gain, uint32_t* pixels);
+
+	int width() const
+	{
+		return width_;
+	}
+	int height() const
+	{
+		return height_;
+	}
+
+	// Solver thread, after each step.
+	void Capture(const std::vector<std::shared_ptr<Partition>>& partitions, int time_step);
+	// Render thread: colours the newest slice into pixels (width x height, SDL_PIXELFORMAT_RGB888).
+	// Returns false, and leaves pixels alone, when nothing new was captured since the last call.
+	bool Render(std::vector<uint32_t>& pixels, int* time_step = nullptr);
+
+private:
+	static const int kLutSize = 1024;
+	static const std::array<uint32_t, kLutSize>& Lut();
+
+	Settings settings_;
+	Plane plane_;
+	int width_, height_;
+
+	std::chrono::steady_clock::duration interval_;
+	std::chrono::steady_clock::time_point next_frame_;
+
+	std::vector<real_t> slices_[2];
+	int steps_[2]{ 0, 0 };
+	std::mutex locks_[2];
+	std::atomic<int> front_{ 0 };
+	std::atomic<bool> fresh_{ false };
+};
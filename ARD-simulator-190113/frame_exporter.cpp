@@ -0,0 +1,271 @@
+#include "frame_exporter.h"
+#include "simulation.h"
+#include "partition.h"
+#include "tracer.h"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+
+static void PutU32Be(std::vector<uint8_t>& out, uint32_t v)
+{
+	out.push_back((v >> 24) & 0xff);
+	out.push_back((v >> 16) & 0xff);
+	out.push_back((v >> 8) & 0xff);
+	out.push_back(v & 0xff);
+}
+
+static uint32_t Crc32(const uint8_t* data, size_t n, uint32_t crc = 0)
+{
+	static const std::vector<uint32_t> table = []()
+	{
+		std::vector<uint32_t> t(256);
+		for (uint32_t i = 0; i < 256; i++)
+		{
+			uint32_t c = i;
+			for (int k = 0; k < 8; k++)
+				c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+			t[i] = c;
+		}
+		return t;
+	}();
+	crc = ~crc;
+	for (size_t i = 0; i < n; i++)
+		crc = table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+	return ~crc;
+}
+
+static void PutChunk(std::vector<uint8_t>& out, const char* type, const std::vector<uint8_t>& data)
+{
+	PutU32Be(out, (uint32_t)data.size());
+	size_t start = out.size();
+	out.insert(out.end(), type, type + 4);
+	out.insert(out.end(), data.begin(), data.end());
+	PutU32Be(out, Crc32(&out[start], out.size() - start));
+}
+
+std::vector<uint8_t> FrameExporter::EncodePng(const uint32_t* pixels, int width, int height)
+{
+	// Raw scanlines: filter byte 0, then RGB.
+	std::vector<uint8_t> raw;
+	raw.reserve((size_t)height * (1 + 3 * (size_t)width));
+	for (int y = 0; y < height; y++)
+	{
+		raw.push_back(0);
+		for (int x = 0; x < width; x++)
+		{
+			uint32_t p = pixels[(size_t)y * width + x];
+			raw.push_back((p >> 16) & 0xff);
+			raw.push_back((p >> 8) & 0xff);
+			raw.push_back(p & 0xff);
+		}
+	}
+
+	// zlib stream of stored deflate blocks (at most 65535 bytes each) and the Adler-32 of the data.
+	std::vector<uint8_t> z = { 0x78, 0x01 };
+	z.reserve(raw.size() + raw.size() / 65535 * 5 + 16);
+	uint32_t a = 1, b = 0;
+	for (size_t pos = 0; pos < raw.size() || pos == 0; )
+	{
+		size_t n = std::min<size_t>(65535, raw.size() - pos);
+		bool last = pos + n == raw.size();
+		z.push_back(last ? 1 : 0);
+		z.push_back(n & 0xff);
+		z.push_back((n >> 8) & 0xff);
+		z.push_back(~n & 0xff);
+		z.push_back((~n >> 8) & 0xff);
+		z.insert(z.end(), raw.begin() + pos, raw.begin() + pos + n);
+		for (size_t i = pos; i < pos + n; i++)
+		{
+			a = (a + raw[i]) % 65521;
+			b = (b + a) % 65521;
+		}
+		pos += n;
+		if (last)
+		{
+			break;
+		}
+	}
+	PutU32Be(z, (b << 16) | a);
+
+	std::vector<uint8_t> png = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+	std::vector<uint8_t> header;
+	PutU32Be(header, width);
+	PutU32Be(header, height);
+	header.insert(header.end(), { 8, 2, 0, 0, 0 });	// 8-bit RGB, deflate, no interlace
+	PutChunk(png, "IHDR", header);
+	PutChunk(png, "IDAT", z);
+	PutChunk(png, "IEND", {});
+	return png;
+}
+
+FrameExporter::FrameExporter(Simulation& simulation, const std::string& path, const Settings& settings)
+	: path_(path)
+	, settings_(settings)
+	, plane_(FieldView::PlaneOf(simulation, settings.look_from, settings.slice))
+{
+	settings_.every = std::max(1, settings.every);
+	settings_.workers = std::max(1, settings.workers);
+	settings_.buffers = std::max(settings_.workers, settings.buffers);
+}
+
+FrameExporter::~FrameExporter()
+{
+	Close();
+}
+
+bool FrameExporter::Start()
+{
+	if (settings_.format == Y4M)
+	{
+		file_ = fopen(path_.c_str(), "wb");
+		if (!file_)
+		{
+			std::cout << "Cannot open " << path_ << " for the video." << std::endl;
+			return false;
+		}
+		fprintf(file_, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C444\n", plane_.width, plane_.height, std::max(1, settings_.frames_per_second));
+	}
+	size_t n = (size_t)plane_.width * plane_.height;
+	for (int i = 0; i < settings_.buffers; i++)
+	{
+		auto frame = std::make_unique<Frame>();
+		frame->values.resize(n);
+		frame->pixels.resize(n);
+		free_.push_back(frame.get());
+		storage_.push_back(std::move(frame));
+	}
+	running_ = true;
+	stopping_ = false;
+	for (int i = 0; i < settings_.workers; i++)
+	{
+		workers_.emplace_back(&FrameExporter::Work, this);
+	}
+	std::cout << "Video: " << (settings_.projection ? "projection along " : "slice of ") << "axis " << settings_.look_from
+		<< ", every " << settings_.every << " steps, " << plane_.width << "x" << plane_.height
+		<< (settings_.format == Y4M ? " Y4M" : " PNG") << " on " << settings_.workers << " workers" << std::endl;
+	return true;
+}
+
+void FrameExporter::Capture(const std::vector<std::shared_ptr<Partition>>& partitions, int time_step)
+{
+	if (!running_ || time_step % settings_.every != 0)
+	{
+		return;
+	}
+	TraceSpan span("video frame");
+	Frame* frame;
+	{
+		std::unique_lock<std::mutex> lock(mutex_);
+		frame_free_.wait(lock, [this]() { return !free_.empty(); });
+		frame = free_.front();
+		free_.pop_front();
+	}
+	frame->index = next_index_++;
+	frame->time_step = time_step;
+	if (settings_.projection)
+		FieldView::ProjectPlane(partitions, plane_, frame->values.data());
+	else
+		FieldView::CopyPlane(partitions, plane_, frame->values.data());
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		queue_.push_back(frame);
+	}
+	work_ready_.notify_one();
+}
+
+void FrameExporter::Close()
+{
+	if (!running_)
+	{
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		stopping_ = true;
+	}
+	work_ready_.notify_all();
+	for (auto& worker : workers_)
+		worker.join();
+	workers_.clear();
+	running_ = false;
+	if (file_)
+	{
+		fclose(file_);
+		file_ = nullptr;
+	}
+	if (failed_)
+	{
+		std::cout << "Writing the video to " << path_ << " failed, it is incomplete." << std::endl;
+	}
+}
+
+void FrameExporter::Work()
+{
+	for (;;)
+	{
+		Frame* frame;
+		{
+			std::unique_lock<std::mutex> lock(mutex_);
+			work_ready_.wait(lock, [this]() { return !queue_.empty() || stopping_; });
+			if (queue_.empty())
+			{
+				return;		// stopping and drained
+			}
+			frame = queue_.front();
+			queue_.pop_front();
+		}
+
+		FieldView::Colourise(frame->values.data(), frame->values.size(), settings_.gain, frame->pixels.data());
+		bool ok = Write(*frame);
+
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			failed_ = failed_ || !ok;
+			free_.push_back(frame);
+		}
+		frame_free_.notify_one();
+	}
+}
+
+bool FrameExporter::Write(Frame& frame)
+{
+	size_t n = frame.pixels.size();
+	if (settings_.format == PNG)
+	{
+		frame.encoded = EncodePng(frame.pixels.data(), plane_.width, plane_.height);
+		char number[16];
+		snprintf(number, sizeof(number), "%06d", frame.index);
+		FILE* file = fopen((path_ + number + ".png").c_str(), "wb");
+		bool ok = file && fwrite(frame.encoded.data(), 1, frame.encoded.size(), file) == frame.encoded.size();
+		if (file)
+		{
+			fclose(file);
+		}
+		return ok;
+	}
+
+	// YUV4MPEG2 4:4:4, BT.601 studio range: "FRAME\n", then the Y, Cb and Cr planes.
+	const char tag[] = "FRAME\n";
+	frame.encoded.resize(sizeof(tag) - 1 + 3 * n);
+	memcpy(frame.encoded.data(), tag, sizeof(tag) - 1);
+	uint8_t* y = frame.encoded.data() + sizeof(tag) - 1;
+	uint8_t* cb = y + n;
+	uint8_t* cr = cb + n;
+	for (size_t i = 0; i < n; i++)
+	{
+		int r = (frame.pixels[i] >> 16) & 0xff, g = (frame.pixels[i] >> 8) & 0xff, b = frame.pixels[i] & 0xff;
+		y[i] = (uint8_t)(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+		cb[i] = (uint8_t)(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+		cr[i] = (uint8_t)(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+	}
+
+	// One stream: wait for the previous frame's turn, so the file is in step order.
+	std::unique_lock<std::mutex> lock(write_mutex_);
+	turn_.wait(lock, [this, &frame]() { return next_write_ == frame.index; });
+	bool ok = fwrite(frame.encoded.data(), 1, frame.encoded.size(), file_) == frame.encoded.size();
+	next_write_++;
+	lock.unlock();
+	turn_.notify_all();
+	return ok;
+}
@@ -0,0 +1,100 @@
+#pragma once
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "types.h"
+#include "field_view.h"
+
+class Partition;
+class Simulation;
+
+/* Headless video of one plane of the field, or of its max-intensity projection along the normal.
+ *
+ * Capture() runs on the solver thread every `every` steps and only copies: the plane through the
+ * partitions' strided views (FieldView::CopyPlane) or the projection (FieldView::ProjectPlane) into
+ * a free frame buffer, which is queued for a pool of worker threads. The workers colour it with the
+ * preview's colormap and encode it: a numbered PNG per frame (<path>NNNNNN.png, written by whichever
+ * worker encoded it), or one raw YUV4MPEG2 stream (4:4:4, BT.601) whose frames are appended in step
+ * order. There are `buffers` frames in total, so memory is bounded; the solver waits only when all of
+ * them are still queued or being encoded.
+ */
+class FrameExporter
+{
+public:
+	enum Format
+	{
+		Y4M,
+		PNG
+	};
+
+	struct Settings
+	{
+		Format format{ Y4M };
+		int look_from{ 0 };				// 0: xy, 1: yz, 2: xz (as FieldView)
+		int slice{ -1 };				// cell along the normal, < 0: through the first source
+		bool projection{ false };		// max |p| along the normal instead of one slice
+		int every{ 10 };				// solver steps per frame
+		int frames_per_second{ 30 };	// playback rate in the Y4M header
+		real_t gain{ 10.0f };			// as FieldView::Settings::gain
+		int workers{ 2 };
+		int buffers{ 4 };
+	};
+
+	// path: the .y4m file, or the prefix of the PNG files.
+	FrameExporter(Simulation& simulation, const std::string& path, const Settings& settings);
+	~FrameExporter();
+	FrameExporter(const FrameExporter&) = delete;
+	FrameExporter& operator=(const FrameExporter&) = delete;
+
+	bool Start();
+	void Capture(const std::vector<std::shared_ptr<Partition>>& partitions, int time_step);	// solver thread, after Update()
+	void Close();	// encodes and writes the queued frames, joins the workers
+
+	int frames() const
+	{
+		return next_index_;
+	}
+
+	// 8-bit RGB PNG of 0xFFRRGGBB pixels; stored (uncompressed) deflate blocks, so no zlib is needed.
+	static std::vector<uint8_t> EncodePng(const uint32_t* pixels, int width, int height);
+
+private:
+	struct Frame
+	{
+		int index{ 0 };
+		int time_step{ 0 };
+		std::vector<real_t> values;
+		std::vector<uint32_t> pixels;
+		std::vector<uint8_t> encoded;
+	};
+
+	void Work();
+	bool Write(Frame& frame);
+
+	std::string path_;
+	Settings settings_;
+	FieldView::Plane plane_;
+
+	std::vector<std::unique_ptr<Frame>> storage_;
+	std::deque<Frame*> queue_;		// captured, waiting for a worker
+	std::deque<Frame*> free_;
+	std::mutex mutex_;
+	std::condition_variable work_ready_;
+	std::condition_variable frame_free_;
+	std::mutex write_mutex_;
+	std::condition_variable turn_;	// Y4M: frames are written in index order
+	int next_index_{ 0 };
+	int next_write_{ 0 };
+	bool running_{ false };
+	bool stopping_{ false };
+	bool failed_{ false };
+
+	FILE* file_{ nullptr };			// Y4M stream
+	std::vector<std::thread> workers_;
+};
@@ -4,9 +4,12 @@
 class GaussianSource :public SoundSource
 {
 public:
-	GaussianSource(int x, int y,int z);
+	GaussianSource(int x, int y, int z, const SimulationConfig& config);
 	~GaussianSource();
 
 	virtual real_t SampleValue(real_t t);
+
+private:
+	real_t courant_;	// c0 dt / dh, the pulse width is fixed in cells
 };
 
@@ -0,0 +1,215 @@
+#define _USE_MATH_DEFINES
+#include <cmath>
+#include "impulse_response.h"
+#include "recorder.h"
+#include "sound_source.h"
+#include "tracer.h"
+#include "convolver.h"
+#include <fftw3.h>
+#include <algorithm>
+#include <complex>
+#include <iostream>
+#include <omp.h>
+
+
+std::vector<float> ImpulseResponse::Extract(const std::vector<real_t>& response, const std::vector<real_t>& source, const SimulationConfig& config, const Settings& settings)
+{
+	int n = (int)response.size();
+	if (n == 0 || source.empty())
+	{
+		return {};
+	}
+
+	real_t sample_rate = 1.0f / config.dt;
+	real_t fcut = config.c0 / (settings.cells_per_wavelength * config.dh);
+	bool lowpass = fcut < 0.5f * sample_rate;
+	int order = lowpass ? settings.fir_order : 0;
+
+	// Linear (not circular) products: room for the response, the source and the FIR.
+	int nfft = 1;
+	while (nfft < 2 * n + order) nfft <<= 1;
+	int nbins = nfft / 2 + 1;
+
+	float* time = (float*)fftwf_malloc(sizeof(float) * nfft);
+	fftwf_complex* r = (fftwf_complex*)fftwf_malloc(sizeof(fftwf_complex) * nbins);
+	fftwf_complex* s = (fftwf_complex*)fftwf_malloc(sizeof(fftwf_complex) * nbins);
+	fftwf_plan forward, inverse;
+	{
+		std::lock_guard<std::mutex> lock(PartitionedConvolver::PlanMutex());
+		forward = fftwf_plan_dft_r2c_1d(nfft, time, r, FFTW_ESTIMATE);
+		inverse = fftwf_plan_dft_c2r_1d(nfft, r, time, FFTW_ESTIMATE);
+	}
+
+	std::fill(time, time + nfft, 0.0f);
+	std::copy(response.begin(), response.end(), time);
+	fftwf_execute_dft_r2c(forward, time, r);
+
+	std::fill(time, time + nfft, 0.0f);
+	std::copy(source.begin(), source.begin() + std::min((int)source.size(), n), time);
+	fftwf_execute_dft_r2c(forward, time, s);
+
+	// H = R S* / (|S|^2 + eps max|S|^2)
+	float max_power = 0.0f;
+	for (int k = 0; k < nbins; k++)
+		max_power = std::max(max_power, s[k][0] * s[k][0] + s[k][1] * s[k][1]);
+	float noise_floor = settings.regularisation * max_power;
+	for (int k = 0; k < nbins; k++)
+	{
+		std::complex<float> rk(r[k][0], r[k][1]);
+		std::complex<float> sk(s[k][0], s[k][1]);
+		std::complex<float> h = rk * std::conj(sk) / (std::norm(sk) + noise_floor);
+		r[k][0] = h.real();
+		r[k][1] = h.imag();
+	}
+
+	// FIR low-pass, applied in the same spectrum.
+	if (lowpass)
+	{
+		std::vector<float> fir = Fir1Lowpass(order, fcut / (0.5f * sample_rate));
+		std::fill(time, time + nfft, 0.0f);
+		std::copy(fir.begin(), fir.end(), time);
+		fftwf_execute_dft_r2c(forward, time, s);
+		for (int k = 0; k < nbins; k++)
+		{
+			std::complex<float> h(r[k][0], r[k][1]);
+			h *= std::complex<float>(s[k][0], s[k][1]);
+			r[k][0] = h.real();
+			r[k][1] = h.imag();
+		}
+	}
+
+	fftwf_execute_dft_c2r(inverse, r, time);
+
+	// Drop the FIR's group delay (order / 2), FFTW's inverse is unnormalised.
+	std::vector<float> ir(n);
+	for (int i = 0; i < n; i++)
+		ir[i] = time[i + order / 2] / nfft;
+
+	{
+		std::lock_guard<std::mutex> lock(PartitionedConvolver::PlanMutex());
+		fftwf_destroy_plan(forward);
+		fftwf_destroy_plan(inverse);
+	}
+	fftwf_free(time);
+	fftwf_free(r);
+	fftwf_free(s);
+
+	// Truncate where the Schroeder (backward integrated) energy has decayed by decay_db.
+	std::vector<double> energy(n + 1, 0.0);
+	for (int i = n - 1; i >= 0; i--)
+		energy[i] = energy[i + 1] + (double)ir[i] * ir[i];
+	if (energy[0] > 0.0)
+	{
+		double limit = energy[0] * pow(10.0, -settings.decay_db / 10.0);
+		int end = n;
+		while (end > 1 && energy[end - 1] < limit) end--;
+		ir.resize(end);
+	}
+
+	float peak = 0.0f;
+	for (float v : ir)
+		peak = std::max(peak, fabsf(v));
+	if (peak > 0.0f)
+	{
+		for (float& v : ir)
+			v /= peak;
+	}
+	return ir;
+}
+
+std::vector<float> ImpulseResponse::Fir1Lowpass(int order, float wc)
+{
+	std::vector<float> h(order + 1);
+	float sum = 0.0f;
+	for (int i = 0; i <= order; i++)
+	{
+		float m = i - 0.5f * order;
+		float sinc = (m == 0.0f) ? wc : sinf((float)M_PI * wc * m) / ((float)M_PI * m);
+		float window = 0.54f - 0.46f * cosf(2.0f * (float)M_PI * i / order);
+		h[i] = sinc * window;
+		sum += h[i];
+	}
+	for (int i = 0; i <= order; i++)
+		h[i] /= sum;
+	return h;
+}
+
+std::vector<float> ImpulseResponse::Resample(const std::vector<float>& x, double in_rate, double out_rate)
+{
+	if (x.empty() || in_rate == out_rate)
+	{
+		return x;
+	}
+	const int half_width = 32;							// input samples on each side
+	double ratio = out_rate / in_rate;
+	double cutoff = std::min(1.0, ratio);				// relative to the input Nyquist, lower it when decimating
+	double support = half_width / cutoff;				// kernel half-width in input samples
+	size_t n_out = (size_t)floor(x.size() * ratio);
+	std::vector<float> y(n_out);
+
+#pragma omp parallel for
+	for (long long m = 0; m < (long long)n_out; m++)
+	{
+		double t = m / ratio;
+		long long first = std::max(0LL, (long long)ceil(t - support));
+		long long last = std::min((long long)x.size() - 1, (long long)floor(t + support));
+		double acc = 0.0;
+		for (long long k = first; k <= last; k++)
+		{
+			acc += x[k] * SincKernel(t - k, cutoff, support);
+		}
+		y[m] = (float)acc;
+	}
+	return y;
+}
+
+double ImpulseResponse::SincKernel(double d, double cutoff, double support)
+{
+	double u = d / support;			// -1 .. 1
+	if (fabs(u) > 1.0)
+	{
+		return 0.0;
+	}
+	double arg = M_PI * cutoff * d;
+	double sinc = (d == 0.0) ? 1.0 : sin(arg) / arg;
+	double window = 0.42 + 0.5 * cos(M_PI * u) + 0.08 * cos(2.0 * M_PI * u);	// Blackman
+	return cutoff * sinc * window;
+}
+
+void ImpulseResponse::ExportRecorders(const std::vector<std::shared_ptr<Recorder>>& recorders, std::shared_ptr<SoundSource> source,
+	const std::string& dir, const Settings& settings)
+{
+	if (recorders.empty() || !source)
+	{
+		return;
+	}
+	size_t steps = 0;
+	for (auto& recorder : recorders)
+		steps = std::max(steps, recorder->response().size());
+	std::vector<real_t> source_signal(steps);
+	source->Fill(0, (int)steps, source_signal.data());
+
+	std::vector<size_t> lengths(recorders.size(), 0);
+	std::vector<char> written(recorders.size(), 0);	// not vector<bool>: written from several threads
+
+#pragma omp parallel for schedule(dynamic)
+	for (int i = 0; i < (int)recorders.size(); i++)
+	{
+		TraceSpan span("impulse response", recorders[i]->id());
+		const SimulationConfig& config = recorders[i]->config();
+		auto ir = Extract(recorders[i]->response(), source_signal, config, settings);
+		ir = Resample(ir, 1.0 / config.dt, settings.sample_rate);
+		std::string path = dir + "/ir_" + std::to_string(recorders[i]->id()) + ".wav";
+		written[i] = !ir.empty() && WavFile::Write(path, ir, 1, settings.sample_rate, settings.format);
+		lengths[i] = ir.size();
+	}
+
+	std::cout << "# Impulse responses. #######################################" << std::endl;
+	for (size_t i = 0; i < recorders.size(); i++)
+	{
+		std::cout << "Recorder " << recorders[i]->id() << ": "
+			<< (written[i] ? "ir_" + std::to_string(recorders[i]->id()) + ".wav, " + std::to_string(lengths[i]) + " samples at "
+				+ std::to_string(settings.sample_rate) + " Hz" : std::string("not written")) << std::endl;
+	}
+	std::cout << "############################################################" << std::endl;
+}
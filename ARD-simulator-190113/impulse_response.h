@@ -0,0 +1,45 @@
+#pragma once
+#include <memory>
+#include <string>
+#include <vector>
+#include "types.h"
+#include "simulation_config.h"
+#include "wav_file.h"
+
+class Recorder;
+class SoundSource;
+
+/* Room impulse responses from recorded pressure, the in-engine version of matlab/auralization.m.
+ *
+ * The recorded response is the room's answer to the (Gaussian) source signal, so the impulse
+ * response is obtained by regularised spectral division (FFTW), low-passed with a Hamming
+ * windowed-sinc FIR at the grid's valid bandwidth, truncated where the Schroeder decay curve
+ * has fallen by decay_db, normalised and resampled to the output rate.
+ */
+class ImpulseResponse
+{
+public:
+	struct Settings
+	{
+		int sample_rate{ 48000 };						// output rate (44100 or 48000)
+		WavFile::Format format{ WavFile::PCM_24 };
+		real_t cells_per_wavelength{ 2.3f };			// low-pass at c0 / (cells_per_wavelength * dh): 1.5 kHz at 10 cm, 3 kHz at 5 cm
+		int fir_order{ 1024 };
+		real_t decay_db{ 60.0f };
+		real_t regularisation{ 1e-4f };					// |S|^2 + regularisation * max|S|^2
+	};
+
+	// Impulse response at the simulation rate (1 / config.dt).
+	static std::vector<float> Extract(const std::vector<real_t>& response, const std::vector<real_t>& source, const SimulationConfig& config, const Settings& settings);
+	// fir1(order, wc) equivalent: Hamming-windowed sinc low-pass, wc relative to Nyquist, unit gain at DC.
+	static std::vector<float> Fir1Lowpass(int order, float wc);
+	// Band-limited (windowed sinc) resampling to an arbitrary rate.
+	static std::vector<float> Resample(const std::vector<float>& x, double in_rate, double out_rate);
+	// Blackman-windowed sinc tap at distance d (input samples), cutoff relative to the input Nyquist,
+	// zero beyond support; includes the cutoff's gain, so the taps sum to about 1.
+	static double SincKernel(double d, double cutoff, double support);
+
+	// Writes <dir>/ir_<recorder id>.wav for every recorder, recorders are processed in parallel.
+	static void ExportRecorders(const std::vector<std::shared_ptr<Recorder>>& recorders, std::shared_ptr<SoundSource> source,
+		const std::string& dir, const Settings& settings);
+};
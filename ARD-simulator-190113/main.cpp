@@ -8,6 +8,8 @@
 #include <SDL.h>
 #include <SDL_ttf.h>
 #include <omp.h>
+#include <atomic>
+#include <thread>
 #include <Windows.h>
 #undef main		// https://stackoverflow.com/questions/6847360
 
@@ -17,41 +19,95 @@
 #include "sound_source.h"
 #include "gaussian_source.h"
 #include "recorder.h"
+#include "record_writer.h"
+#include "receiver_array.h"
+#include "dct_partition.h"
+#include "impulse_response.h"
+#include "auralizer.h"
+#include "room_metrics.h"
+#include "termination.h"
+#include "tracer.h"
+#include "perf_counters.h"
+#include "field_view.h"
+#include "snapshot.h"
+#include "frame_exporter.h"
+#include "scene_package.h"
+#include "partition_index.h"
 
 #include "utils_VkFFT.h"
 
 using namespace std;
 
 bool is_record = true;
+bool is_binary_record = true;	// Recorders write <output>/record.bin from a background thread instead of out_N.txt / response_N.txt.
+FieldEncoder::Encoding record_encoding = FieldEncoder::AMBISONICS;	// Per-step field at each recorder: RAW_CUBE (10x10x10 pressures), PRESSURE_VELOCITY (4) or AMBISONICS.
+int ambisonic_order = 1;		// 1..3, (order + 1)^2 channels.
+std::string receiver_path = "";	// Dense receivers (metres, one per line) gathered per partition into <output>/receivers.bin, "" to skip.
+real_t receiver_grid_spacing = 0.0f;	// > 0: also a receiver every spacing metres over all air partitions.
+bool is_batched_sources = false;	// Every source drives its own field (SimulationConfig::fields): one run gives each source's response at the receivers.
+bool is_reciprocal = false;		// Swap roles: listeners become sources, source positions recorders. One run per scene instead of one per source.
+bool is_lazy_idct = false;		// DCT partitions transform back only when something reads the pressure; receivers use the modes. Boundaries read it every step, so this saves nothing yet.
+bool is_source_export = true;	// Source waveforms to <output>/sources.bin, written in the background while the run starts.
+bool is_ir_export = true;		// After the run, write <output>/ir_N.wav per recorder (see ImpulseResponse::Settings).
+std::string auralize_input = "";	// Dry WAV convolved with every exported impulse response (<output>/<name>-ir_N.wav), "" to skip.
+bool is_metrics = true;			// Recorders compute EDT/T20/T30/C50/C80/D50 per octave band while running, <output>/metrics.csv.
+bool is_metrics_only = false;	// Only the metrics: no record.bin / text files, no stored responses (so no impulse responses).
+bool is_early_stop = false;		// End the run once the room has decayed (see TerminationController::Settings) instead of after the full duration.
+bool is_perf = false;		// Sample hardware counters per kernel (Linux perf_event_open), summary every perf_window steps.
+int perf_window = 1000;
+real_t preview_fps = 30.0f;	// Window refresh rate; the solver copies a slice at most this often and never waits for drawing.
+int snapshot_every = 0;		// > 0: the whole field every that many steps, quantised into <output>/snapshots.bin (see SnapshotWriter).
+int snapshot_bits = 8;			// 8 or 16 bits per cell.
+int video_every = 0;			// > 0: a headless video frame every that many steps, <output>/field.y4m (see FrameExporter).
+bool is_video_png = false;		// <output>/frame_NNNNNN.png instead of the Y4M stream.
+bool is_video_projection = false;	// Max-intensity projection along the view direction instead of the preview slice.
+std::string package_path = "";	// Compiled scene package (see ScenePackage), built from the scene on first use; "" to lay the scene out every launch.
+bool is_trace = false;		// Export per-phase spans to <output>/trace.json (chrome://tracing, ui.perfetto.dev).
 
 /* Set constant parameters. */
 
-real_t Partition::m_absorption = 1.0f;	// Absorption coefficients of the boundaries.
-real_t Simulation::m_duration = 2.0f;	// Duration of the whole simulation (seconds).
+static SimulationConfig Config()
+{
+	SimulationConfig config;
+	config.absorption = 1.0f;		// Absorption coefficients of the boundaries.
+	config.fields = 1;				// Independent fields per partition, one per source with is_batched_sources.
+	config.duration = 2.0f;			// Duration of the whole simulation (seconds).
 
-//real_t Simulation::m_dh = 0.05f;		// Space sampling rate (cell size 5cm)
-//real_t Simulation::m_dt = 0.625e-4f;	// Time sampling rate (16KHz)
+	//config.dh = 0.05f;			// Space sampling rate (cell size 5cm)
+	//config.dt = 0.625e-4f;		// Time sampling rate (16KHz)
 
-//real_t Simulation::m_dh = 0.1f;			// 10cm
-//real_t Simulation::m_dt = 1.25e-4f;		// 8kHz
+	//config.dh = 0.1f;				// 10cm
+	//config.dt = 1.25e-4f;			// 8kHz
 
-real_t Simulation::m_dh = 10 / 100.0f;		// 10 cm
-real_t Simulation::m_dt = 1.0f / 8000.0f;	// 8 kHz
+	config.dh = 10 / 100.0f;		// 10 cm
+	config.dt = 1.0f / 8000.0f;		// 8 kHz
 
-//real_t Simulation::m_dh = 0.2f;		// 20cm
-//real_t Simulation::m_dt = 2e-4f;		// 5kHz
+	//config.dh = 0.2f;				// 20cm
+	//config.dt = 2e-4f;			// 5kHz
 
-real_t Simulation::m_c0 = 3.435e2f;		// Speed of sound
-int Simulation::m_pml_layers = 5;		// Number of pml layers.
+	config.c0 = 3.435e2f;			// Speed of sound
+	config.pml_layers = 5;			// Number of pml layers.
+	return config;
+}
 
 int main()
 {
 	real_t time1 = (real_t)omp_get_wtime();		// Record the beginning time. Used for showing the consuming time.
 
-	std::string dir_name = "./output/" + std::to_string(Simulation::m_dh) + "_" + std::to_string(Partition::m_absorption);
+	SimulationConfig config = Config();
+	std::string dir_name = "./output/" + std::to_string(config.dh) + "_" + std::to_string(config.absorption);
 	CreateDirectory(dir_name.c_str(), NULL);	// Prepare for the output folder.
 												// ! Without this and the corresponding folder does not exist, the program will not write the output data.
 
+	if (is_trace)
+	{
+		Tracer::Enable();
+	}
+	if (is_perf)
+	{
+		is_perf = PerfCounters::Enable();
+	}
+
 	VkGPU vkGPU = {};
 	initVkGPU(&vkGPU);
 
@@ -60,26 +116,119 @@ int main()
 	std::vector<std::shared_ptr<Recorder>> recorders;
 
 #if 0
-	partitions = Partition::ImportPartitions("./assets/hall.txt");			// Read partition properties from file.
-	sources = SoundSource::ImportSources("./assets/hall-sources.txt");		// Read source properties from file.
-	recorders = Recorder::ImportRecorders("./assets/hall-recorders.txt");	// Read recorder properties from file. Recorder is not mandatory. 
+	std::string scene_path = "./assets/hall.txt";					// Partition properties.
+	std::string source_path = "./assets/hall-sources.txt";			// Source properties.
+	std::string recorder_path = "./assets/hall-recorders.txt";		// Recorder properties. Recorder is not mandatory.
 #else
-	partitions = Partition::ImportPartitions("./assets/scene-1.txt", &vkGPU);
-	sources = SoundSource::ImportSources("./assets/sources.txt");
+	std::string scene_path = "./assets/scene-1.txt";
+	std::string source_path = "./assets/sources.txt";
+	std::string recorder_path = "";
 #endif
 
-	//partitions = Partition::ImportPartitions("./assets/classroom.txt");
-	//sources = SoundSource::ImportSources("./assets/classroom-sources.txt");
-	//recorders = Recorder::ImportRecorders("./assets/classroom-recorders.txt");
+	if (is_reciprocal && !recorder_path.empty())
+	{
+		/* Reciprocity: the response at a listener to a source equals the response at the source's
+		 * position to the same source placed at the listener. Listener j becomes a source in field j,
+		 * source position i a recorder per listener: recorder i * listeners + j holds what a forward
+		 * run of source i records at listener j.
+		 */
+		sources = SoundSource::ImportSources(config, recorder_path);
+		SoundSource::BatchSources(sources, true, config);
+		recorders = Recorder::ImportRecorders(config, source_path, dir_name, config.fields);
+		std::cout << "Reciprocal run: " << sources.size() << " listeners as sources, "
+			<< recorders.size() / config.fields << " source positions as recorders" << std::endl;
+	}
+	else
+	{
+		sources = SoundSource::ImportSources(config, source_path);
+		SoundSource::BatchSources(sources, is_batched_sources, config);	// The window shows field 0.
+		if (!recorder_path.empty())
+		{
+			recorders = Recorder::ImportRecorders(config, recorder_path, dir_name);
+		}
+	}
+	// After SoundSource::BatchSources, the partitions size their fields by it.
+	ScenePackage package;
+	if (!package_path.empty() && package.Load(package_path, config, scene_path))
+	{
+		partitions = package.Partitions(config, &vkGPU);
+	}
+	else
+	{
+		partitions = Partition::ImportPartitions(config, scene_path, &vkGPU);
+	}
+
+	//partitions = Partition::ImportPartitions(config, "./assets/classroom.txt", &vkGPU);
+	//sources = SoundSource::ImportSources(config, "./assets/classroom-sources.txt");
+	//recorders = Recorder::ImportRecorders(config, "./assets/classroom-recorders.txt", dir_name);
 
+	PartitionIndex partition_index(partitions);
 	for (auto record : recorders)
 	{
-		record->FindPartition(partitions);		// Assign recorders to the corresponding partition.
+		record->FindPartition(partition_index);		// Assign recorders to the corresponding partition.
+		if (is_metrics)
+		{
+			record->EnableMetrics(is_metrics_only);
+		}
+		record->SetEncoding(record_encoding, ambisonic_order);
 	}
 
-	auto simulation = std::make_shared<Simulation>(partitions, sources);	// Initialize the simulation.
+	int samples_per_step = 1000;
+	if (record_encoding != FieldEncoder::RAW_CUBE)
+	{
+		samples_per_step = FieldEncoder(config, record_encoding, ambisonic_order).channels();
+	}
+	RecordWriter record_writer(dir_name + "/record.bin", config, samples_per_step, record_encoding);
+	if (is_record && is_binary_record && !(is_metrics && is_metrics_only) && !recorders.empty())
+	{
+		for (auto record : recorders)
+		{
+			record->Attach(&record_writer);
+		}
+		record_writer.Start();
+	}
+
+	auto simulation = std::make_shared<Simulation>(config, partitions, sources, package.is_open() ? &package : nullptr);	// Initialize the simulation.
 	simulation->Info();														// Show basic info of the simulation
-	//simulation->look_from_ = 1;											// FOR DEBUG: show field from another view direction.
+
+	std::future<bool> source_export;
+	if (is_source_export)
+	{
+		source_export = SoundSource::ExportSources(sources, dir_name + "/sources.bin", config);
+	}
+
+	if (is_lazy_idct)
+	{
+		for (auto& partition : partitions)
+		{
+			if (auto dct = std::dynamic_pointer_cast<DctPartition>(partition))
+			{
+				dct->set_lazy_idct(true);
+			}
+		}
+	}
+
+	auto receivers = std::make_shared<ReceiverArray>(config);
+	if (!receiver_path.empty() || receiver_grid_spacing > 0.0f)
+	{
+		if (!receiver_path.empty())
+		{
+			receivers->ImportReceivers(receiver_path);
+		}
+		if (receiver_grid_spacing > 0.0f)
+		{
+			receivers->AddGrid(partitions, receiver_grid_spacing);
+		}
+		receivers->Build(partitions);
+		receivers->Open(dir_name + "/receivers.bin");
+		receivers->Info();
+		simulation->SetReceivers(receivers);
+	}
+	FieldView::Settings view_settings;
+	//view_settings.look_from = 1;											// FOR DEBUG: show field from another view direction (1: yz, 2: xz).
+	view_settings.frames_per_second = preview_fps;
+	auto view = std::make_shared<FieldView>(*simulation, view_settings);
+	simulation->AddView(view);
 
 	/* Initialize SDL window
 	 * simulation_rect: show field.
@@ -87,14 +236,14 @@ int main()
 	 */
 	SDL_Event event;
 	SDL_Init(SDL_INIT_VIDEO);
-	SDL_PixelFormat* fmt = SDL_AllocFormat(SDL_PIXELFORMAT_RGBA8888);
 	int resolution_x = 800;
-	int resolution_y = resolution_x / simulation->size_x()*simulation->size_y();
+	int resolution_y = resolution_x * view->height() / view->width();
 	SDL_Window* window = SDL_CreateWindow("ARD Simulator",
 		SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, resolution_x, resolution_y + 20, 0);
 	SDL_Renderer* renderer = SDL_CreateRenderer(window, -1, 0);
 	SDL_Texture* texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGB888, SDL_TEXTUREACCESS_STREAMING,
-		simulation->size_x(), simulation->size_y());
+		view->width(), view->height());
+	std::vector<uint32_t> pixels;
 
 	SDL_Rect simulation_rect;
 	simulation_rect.x = 0;
@@ -116,78 +265,169 @@ int main()
 	Message_rect2.w = 100;
 	Message_rect2.h = 20;
 
-	bool quit = false;
-	int time_step = 0;
-	int total_time_steps = (int)( Simulation::m_duration / Simulation::m_dt );
-	std::string message;
+	SnapshotWriter::Settings snapshot_settings;
+	snapshot_settings.every = snapshot_every;
+	snapshot_settings.bits = snapshot_bits;
+	SnapshotWriter snapshots(dir_name + "/snapshots.bin", snapshot_settings);
+	if (snapshot_every > 0)
+	{
+		snapshots.Start(partitions);
+	}
+
+	FrameExporter::Settings video_settings;
+	video_settings.format = is_video_png ? FrameExporter::PNG : FrameExporter::Y4M;
+	video_settings.look_from = view_settings.look_from;
+	video_settings.projection = is_video_projection;
+	video_settings.every = video_every;
+	FrameExporter video(*simulation, dir_name + (is_video_png ? "/frame_" : "/field.y4m"), video_settings);
+	if (video_every > 0)
+	{
+		video.Start();
+	}
+
+	TerminationController termination(simulation, recorders, TerminationController::Settings());
+
+	std::atomic<bool> quit{ false };
+	std::atomic<bool> finished{ false };
+	std::atomic<int> progress{ 0 };
+	int total_time_steps = config.total_steps();
 
 	real_t time2 = (real_t)omp_get_wtime();
 	std::cout << "Initialization finished. (" << time2 - time1 << " s)" << std::endl;
 	std::cout << "############################################################" << std::endl;
 
-	while (!quit && time_step < total_time_steps)
+	// The solver runs on its own thread; this one only handles the window, at the preview rate.
+	std::thread solver([&]()
 	{
+		int time_step = 0;
+		while (!quit && time_step < total_time_steps)
+		{
+			time_step = simulation->Update();		// ! Updating sound field.
+			snapshots.Capture(partitions, time_step);
+			video.Capture(partitions, time_step);
 
-#if 1
-		while (SDL_PollEvent(&event)) {
-			switch (event.type)
+			if (is_perf && (time_step + 1) % perf_window == 0)
+			{
+				simulation->CounterInfo();
+			}
+
+			if (is_record)
+			{
+				for (auto record : recorders)
+				{
+					record->RecordField(time_step);	// Record sound field.
+				}
+			}
+
+			if (is_early_stop && termination.Update(time_step))
 			{
-			case SDL_QUIT:
 				quit = true;
-				break;
 			}
+			progress.store(time_step, std::memory_order_relaxed);
 		}
-#endif
-
-		time_step = simulation->Update();		// ! Updating sound field.
+		finished = true;
+	});
 
-		if (is_record)
+	// Text textures are rebuilt only when their text changes.
+	auto text = [&](SDL_Texture*& target, std::string& shown, const std::string& message)
+	{
+		if (target && message == shown)
 		{
-			for (auto record : recorders)
+			return;
+		}
+		SDL_DestroyTexture(target);
+		SDL_Surface* surface = TTF_RenderText_Solid(Sans, message.c_str(), White);
+		target = SDL_CreateTextureFromSurface(renderer, surface);
+		SDL_FreeSurface(surface);
+		shown = message;
+	};
+	SDL_Texture* step_message = nullptr;
+	SDL_Texture* time_message = nullptr;
+	std::string step_text, time_text;
+	Uint32 frame_ms = (Uint32)(1000.0f / std::max(1.0f, preview_fps));
+
+	while (!finished)
+	{
+		Uint32 frame_start = SDL_GetTicks();
+		while (SDL_PollEvent(&event)) {
+			switch (event.type)
 			{
-				record->RecordField(time_step);	// Record sound field.
+			case SDL_QUIT:
+				quit = true;
+				break;
 			}
 		}
 
-		message = std::to_string(time_step) + '/' + std::to_string(total_time_steps);
-
-#if 0
-		std::cout << message << std::endl;
-#else
-		SDL_Surface* surfaceMessage = TTF_RenderText_Solid(Sans, message.c_str(), White);
-		SDL_Texture* Message = SDL_CreateTextureFromSurface(renderer, surfaceMessage);
-
-		if (simulation->ready())
+		if (view->Render(pixels))
 		{
-			SDL_UpdateTexture(texture, nullptr,
-				simulation->pixels().data(), simulation->size_x() * sizeof(Uint32));
+			SDL_UpdateTexture(texture, nullptr, pixels.data(), view->width() * sizeof(Uint32));
 		}
+		text(step_message, step_text, std::to_string(progress.load(std::memory_order_relaxed)) + '/' + std::to_string(total_time_steps));
+		text(time_message, time_text, std::to_string((omp_get_wtime() - time1) / 60) + " min");
+
 		SDL_RenderClear(renderer);
 		SDL_RenderCopy(renderer, texture, nullptr, &simulation_rect);
-		SDL_RenderCopy(renderer, Message, NULL, &Message_rect);
-
-		message = std::to_string((omp_get_wtime() - time1) / 60) + " min";
-		surfaceMessage = TTF_RenderText_Solid(Sans, message.c_str(), White);
-		Message = SDL_CreateTextureFromSurface(renderer, surfaceMessage);
-		SDL_RenderCopy(renderer, Message, NULL, &Message_rect2);
-
-		SDL_FreeSurface(surfaceMessage);
-		SDL_DestroyTexture(Message);
+		SDL_RenderCopy(renderer, step_message, NULL, &Message_rect);
+		SDL_RenderCopy(renderer, time_message, NULL, &Message_rect2);
 		SDL_RenderPresent(renderer);
-#endif
+
+		Uint32 elapsed = SDL_GetTicks() - frame_start;
+		if (elapsed < frame_ms)
+		{
+			SDL_Delay(frame_ms - elapsed);
+		}
 	}
+	solver.join();
 
+	SDL_DestroyTexture(step_message);
+	SDL_DestroyTexture(time_message);
 	SDL_DestroyTexture(texture);
+	TTF_CloseFont(Sans);
+	TTF_Quit();
 	SDL_DestroyRenderer(renderer);
 	SDL_DestroyWindow(window);
 	SDL_Quit();
 
+	record_writer.Close();		// flush the last partial blocks
+	snapshots.Close();
+	video.Close();
+	receivers->Close();
+	if (source_export.valid() && !source_export.get())
+	{
+		std::cout << "Cannot write " << dir_name << "/sources.bin" << std::endl;
+	}
+
+	if (is_record && is_metrics)
+	{
+		RoomMetrics::ExportRecorders(recorders, dir_name);
+	}
+
+	if (is_record && is_ir_export && !(is_metrics && is_metrics_only) && !sources.empty())
+	{
+		ImpulseResponse::ExportRecorders(recorders, sources[0], dir_name, ImpulseResponse::Settings());
+
+		if (!auralize_input.empty())
+		{
+			std::vector<std::string> ir_paths;
+			for (auto record : recorders)
+			{
+				ir_paths.push_back(dir_name + "/ir_" + std::to_string(record->id()) + ".wav");
+			}
+			Auralizer::Run(auralize_input, ir_paths, dir_name, config, Auralizer::Settings());
+		}
+	}
+
 	for (auto& partition : partitions)
 		partition.reset();
 	simulation.reset();
 
 	destroyVkGPU(&vkGPU);
 
+	if (is_trace)
+	{
+		Tracer::Export(dir_name + "/trace.json");
+	}
+
 	real_t time3 = (real_t)omp_get_wtime();
 	std::cout << std::endl << "Simulation finished. (" << time3 - time1 << " s)" << std::endl;
 	std::cout << "############################################################" << std::endl;
@@ -0,0 +1,65 @@
+#define _USE_MATH_DEFINES
+#include <cmath>
+#include "mode_evaluator.h"
+#include <algorithm>
+
+
+static real_t Basis(int k, int x, int n)
+{
+	return k == 0 ? 1.0f : (real_t)(2.0 * cos(M_PI * k * (x + 0.5) / n));
+}
+
+ModeEvaluator::ModeEvaluator(int width, int height, int depth, const std::vector<int>& points)
+	: width_(width), height_(height), depth_(depth), count_((int)points.size() / 3)
+{
+	real_t scale = 1.0f / sqrtf(2.0f * width_ * height_ * depth_);
+	cx_.resize((size_t)count_ * width_);
+	cy_.resize((size_t)height_ * count_);
+	cz_.resize((size_t)depth_ * count_);
+	for (int r = 0; r < count_; r++)
+	{
+		int x = points[3 * r], y = points[3 * r + 1], z = points[3 * r + 2];
+		for (int k = 0; k < width_; k++)
+			cx_[(size_t)r * width_ + k] = scale * Basis(k, x, width_);
+		for (int j = 0; j < height_; j++)
+			cy_[(size_t)j * count_ + r] = Basis(j, y, height_);
+		for (int i = 0; i < depth_; i++)
+			cz_[(size_t)i * count_ + r] = Basis(i, z, depth_);
+	}
+	partial_.resize((size_t)depth_ * height_ * count_);
+	acc_.resize(count_);
+}
+
+void ModeEvaluator::Evaluate(const real_t* modes, real_t* out)
+{
+	// x: every row of modes against every receiver's cosine vector.
+	int rows = depth_ * height_;
+	for (int row = 0; row < rows; row++)
+	{
+		const real_t* m = modes + (size_t)row * width_;
+		real_t* p = &partial_[(size_t)row * count_];
+		for (int r = 0; r < count_; r++)
+		{
+			const real_t* c = &cx_[(size_t)r * width_];
+			real_t sum = 0.0f;
+			for (int k = 0; k < width_; k++)
+				sum += m[k] * c[k];
+			p[r] = sum;
+		}
+	}
+
+	// y and z, receivers innermost.
+	std::fill(acc_.begin(), acc_.end(), 0.0f);
+	for (int i = 0; i < depth_; i++)
+	{
+		const real_t* cz = &cz_[(size_t)i * count_];
+		for (int j = 0; j < height_; j++)
+		{
+			const real_t* cy = &cy_[(size_t)j * count_];
+			const real_t* p = &partial_[((size_t)i * height_ + j) * count_];
+			for (int r = 0; r < count_; r++)
+				acc_[r] += cz[r] * cy[r] * p[r];
+		}
+	}
+	std::copy(acc_.begin(), acc_.end(), out);
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include <vector>
+#include "types.h"
+
+/* Pressure at a few points of a DCT partition straight from its modes, without the IDCT.
+ *
+ * The normalised DCT-III (REDFT01) is separable, so the value at (x, y, z) is
+ *   p = s * sum_i sum_j sum_k cz(i, z) cy(j, y) cx(k, x) M[i][j][k],
+ *   c(0, x) = 1, c(k, x) = 2 cos(pi k (x + 1/2) / n), s = 1 / sqrt(2 w h d).
+ * The per-axis vectors are precomputed per receiver. Per step the x contraction of all receivers is
+ * one (d h x w) by (w x R) matrix product, then y and z are contracted per receiver (R d h).
+ * That is R N multiply-adds against N log N for the full IDCT, so it pays off for up to a few
+ * dozen receivers in a partition nobody else needs the field of (see DctPartition::set_lazy_idct;
+ * the boundaries read every partition of current scenes, so none qualifies yet).
+ */
+class ModeEvaluator
+{
+public:
+	// points: local x, y, z triples inside a width x height x depth partition.
+	ModeEvaluator(int width, int height, int depth, const std::vector<int>& points);
+
+	// modes: the partition's DCT modes (z, y, x order); out: one value per point.
+	void Evaluate(const real_t* modes, real_t* out);
+
+	int size() const
+	{
+		return count_;
+	}
+
+private:
+	int width_, height_, depth_;
+	int count_;
+	std::vector<real_t> cx_;		// [point][k], scale folded in
+	std::vector<real_t> cy_;		// [j][point]
+	std::vector<real_t> cz_;		// [i][point]
+	std::vector<real_t> partial_;	// [i * height + j][point]
+	std::vector<real_t> acc_;
+};
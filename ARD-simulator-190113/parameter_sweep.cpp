@@ -0,0 +1,244 @@
+#include "parameter_sweep.h"
+#include "simulation_context.h"
+#include "simulation.h"
+#include "sound_source.h"
+#include "room_metrics.h"
+#include "impulse_response.h"
+#include "wav_file.h"
+#include "dct_partition.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <thread>
+#include <tuple>
+#include <omp.h>
+
+
+static std::vector<real_t> ReadPoints(const std::string& path)
+{
+	std::vector<real_t> points;
+	std::ifstream file(path);
+	while (file.good())
+	{
+		real_t x, y, z;
+		file >> x >> y >> z;
+		if (file.eof()) break;
+		points.insert(points.end(), { x, y, z });
+	}
+	return points;
+}
+
+static bool ParsePoint(const std::string& value, std::vector<real_t>& points)
+{
+	real_t x, y, z;
+	char c1, c2;
+	std::istringstream in(value);
+	if (!(in >> x >> c1 >> y >> c2 >> z) || c1 != ',' || c2 != ',')
+	{
+		return false;
+	}
+	points.insert(points.end(), { x, y, z });
+	return true;
+}
+
+ParameterSweep::ParameterSweep(const SimulationConfig& config, const std::string& scene_path,
+	const std::string& sources_path, const std::string& recorders_path)
+	: config_(config)
+	, boxes_(SceneGenerator::Read(scene_path))
+	, sources_path_(sources_path)
+	, recorders_path_(recorders_path)
+{
+	// The variants' partitions come and go (one at a time with jobs = 1); the tables stay.
+	std::set<std::tuple<int, int, int>> sizes;
+	for (auto& b : boxes_)
+	{
+		// Cells as SimulationContext::AddPartition computes them.
+		sizes.insert(std::make_tuple((int)((real_t)b.w / config_.dh), (int)((real_t)b.h / config_.dh), (int)((real_t)b.d / config_.dh)));
+	}
+	for (auto& size : sizes)
+	{
+		if (std::get<0>(size) > 0 && std::get<1>(size) > 0 && std::get<2>(size) > 0)
+		{
+			tables_.push_back(DctPartition::HoldCoefficients(std::get<0>(size), std::get<1>(size), std::get<2>(size), config_));
+		}
+	}
+}
+
+bool ParameterSweep::ReadVariants(const std::string& path, std::vector<Variant>& variants)
+{
+	std::ifstream file(path);
+	if (!file)
+	{
+		std::cout << "Cannot read variants " << path << std::endl;
+		return false;
+	}
+	std::string line;
+	int number = 0;
+	while (std::getline(file, line))
+	{
+		number++;
+		std::istringstream in(line.substr(0, line.find('#')));
+		Variant variant;
+		if (!(in >> variant.name))
+		{
+			continue;
+		}
+		std::string item;
+		while (in >> item)
+		{
+			size_t equals = item.find('=');
+			std::string key = item.substr(0, equals);
+			std::string value = equals == std::string::npos ? "" : item.substr(equals + 1);
+			bool ok = !value.empty();
+			if (key == "absorption") variant.absorption = strtof(value.c_str(), nullptr);
+			else if (key == "duration")
+			{
+				variant.duration = strtof(value.c_str(), nullptr);
+				ok = ok && variant.duration > 0.0f;
+			}
+			else if (key == "source") ok = ok && ParsePoint(value, variant.sources);
+			else if (key == "recorder") ok = ok && ParsePoint(value, variant.recorders);
+			else if (key == "sources") variant.sources_path = value;
+			else if (key == "recorders") variant.recorders_path = value;
+			else ok = false;
+			if (!ok)
+			{
+				std::cout << path << ":" << number << ": bad item \"" << item << "\"" << std::endl;
+				return false;
+			}
+		}
+		variants.push_back(variant);
+	}
+	return true;
+}
+
+std::vector<ParameterSweep::Result> ParameterSweep::Run(const std::vector<Variant>& variants, const Settings& settings)
+{
+	std::vector<Result> results(variants.size());
+	std::vector<std::vector<Row>> rows(variants.size());
+	int budget = settings.threads > 0 ? settings.threads : omp_get_max_threads();
+	int jobs = std::max(1, std::min({ settings.jobs, budget, (int)variants.size() }));
+	int threads_per_job = std::max(1, budget / jobs);
+
+	std::cout << "# Parameter sweep. #########################################" << std::endl;
+	std::cout << variants.size() << " variants of " << boxes_.size() << " partitions, " << jobs << " at a time on "
+		<< threads_per_job << " threads each" << std::endl;
+	std::cout << "############################################################" << std::endl;
+
+	std::atomic<int> next{ 0 };
+	std::mutex print_mutex;
+	auto work = [&]()
+	{
+		omp_set_num_threads(threads_per_job);	// this thread's parallel regions only
+		for (int i = next++; i < (int)variants.size(); i = next++)
+		{
+			results[i] = RunVariant(variants[i], settings, rows[i]);
+			std::lock_guard<std::mutex> lock(print_mutex);
+			std::cout << variants[i].name << ": " << (results[i].ok ? "" : "failed, ") << results[i].steps << " steps in "
+				<< results[i].seconds << " s" << std::endl;
+		}
+	};
+	std::vector<std::thread> workers;
+	for (int j = 1; j < jobs; j++)
+	{
+		workers.emplace_back(work);
+	}
+	work();
+	for (auto& worker : workers)
+		worker.join();
+
+	std::string csv_path = settings.output + "/sweep.csv";
+	std::ofstream csv(csv_path);
+	if (!csv.is_open())
+	{
+		std::cout << "Cannot write " << csv_path << std::endl;
+		return results;
+	}
+	csv << "variant,recorder,x,y,z,edt,t30,c50,c80,d50" << std::endl;
+	for (size_t i = 0; i < variants.size(); i++)
+	{
+		for (auto& r : rows[i])
+		{
+			csv << variants[i].name << "," << r.recorder << "," << r.x << "," << r.y << "," << r.z << ","
+				<< r.edt << "," << r.t30 << "," << r.c50 << "," << r.c80 << "," << r.d50 << std::endl;
+		}
+	}
+	return results;
+}
+
+ParameterSweep::Result ParameterSweep::RunVariant(const Variant& variant, const Settings& settings, std::vector<Row>& rows)
+{
+	Result result;
+	SimulationConfig config = config_;
+	if (variant.absorption >= 0.0f) config.absorption = variant.absorption;
+	if (variant.duration > 0.0f) config.duration = variant.duration;
+
+	SimulationContext context(config);
+	for (auto& b : boxes_)
+	{
+		context.AddPartition((real_t)b.x, (real_t)b.y, (real_t)b.z, (real_t)b.w, (real_t)b.h, (real_t)b.d);
+	}
+	if (!variant.sources.empty())
+	{
+		for (size_t s = 0; s < variant.sources.size(); s += 3)
+			context.AddSource(variant.sources[s], variant.sources[s + 1], variant.sources[s + 2]);
+	}
+	else
+	{
+		context.LoadSources(variant.sources_path.empty() ? sources_path_ : variant.sources_path);
+	}
+	std::vector<real_t> points = variant.recorders;
+	if (points.empty())
+	{
+		points = ReadPoints(variant.recorders_path.empty() ? recorders_path_ : variant.recorders_path);
+	}
+	for (size_t p = 0; p < points.size(); p += 3)
+	{
+		context.AddRecorder(points[p], points[p + 1], points[p + 2]);
+	}
+
+	std::vector<RoomMetrics> metrics(context.num_recorders(), RoomMetrics(1.0f / config.dt, config.c0 / (2.3f * config.dh)));
+	SimulationContext::Callbacks callbacks;
+	callbacks.sample = [&metrics](int recorder, int, real_t pressure) { metrics[recorder].Push(pressure); };
+
+	double start = omp_get_wtime();
+	result.steps = context.Run(callbacks);
+	result.seconds = omp_get_wtime() - start;
+	if (result.steps < 0)
+	{
+		result.steps = 0;
+		return result;		// no partitions or no sources
+	}
+
+	result.ok = true;
+	std::string prefix = settings.output + "/" + variant.name + "_";
+	std::vector<real_t> source_signal;
+	if (settings.ir)
+	{
+		source_signal.resize(result.steps);
+		context.sources()[0]->Fill(0, result.steps, source_signal.data());
+	}
+	ImpulseResponse::Settings ir_settings;
+	for (int r = 0; r < (int)context.num_recorders(); r++)
+	{
+		const std::vector<real_t>& response = context.response(r);
+		result.ok = WavFile::Write(prefix + "response_" + std::to_string(r) + ".wav", response, 1,
+			(int)std::lround(1.0f / config.dt), WavFile::FLOAT_32) && result.ok;
+		if (settings.ir)
+		{
+			auto ir = ImpulseResponse::Extract(response, source_signal, config, ir_settings);
+			ir = ImpulseResponse::Resample(ir, 1.0 / config.dt, ir_settings.sample_rate);
+			result.ok = !ir.empty() && WavFile::Write(prefix + "ir_" + std::to_string(r) + ".wav", ir, 1,
+				ir_settings.sample_rate, ir_settings.format) && result.ok;
+		}
+		RoomMetrics::Band band = metrics[r].Analyse()[0];
+		rows.push_back({ r, points[3 * r], points[3 * r + 1], points[3 * r + 2], band.edt, band.t30, band.c50, band.c80, band.d50 });
+	}
+	return result;
+}
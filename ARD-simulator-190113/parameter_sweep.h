@@ -0,0 +1,83 @@
+#pragma once
+#include <memory>
+#include <string>
+#include <vector>
+#include "types.h"
+#include "simulation_config.h"
+#include "scene_generator.h"
+
+/* Many runs of one room: absorption, duration, source and receiver positions varied per variant.
+ *
+ * The scene file is parsed once; every variant builds its own SimulationContext from the parsed
+ * boxes. What does not depend on the variant is shared instead of rebuilt: DctPartition's mode
+ * coefficient tables (one per partition size, computed once and held by the sweep) and FFTW's
+ * plans, which are re-created from the process's accumulated wisdom after the first variant of a
+ * size, so only the first one pays for FFTW_MEASURE. Variants are taken from a work queue by `jobs`
+ * worker threads, each running its simulation with threads / jobs OpenMP threads.
+ *
+ * Variant file, one per line ('#' starts a comment):
+ *   name [absorption=A] [duration=S] [source=x,y,z]... [recorder=x,y,z]... [sources=FILE] [recorders=FILE]
+ * Positions in metres. Variants without sources or recorders use the sweep's defaults.
+ *
+ * Output, into the existing directory Settings::output: <name>_response_<r>.wav (pressure at 1 / dt,
+ * 32-bit float), <name>_ir_<r>.wav with Settings::ir (see ImpulseResponse), and sweep.csv with the
+ * broadband room metrics of every recorder of every variant.
+ */
+class ParameterSweep
+{
+public:
+	struct Variant
+	{
+		std::string name;
+		real_t absorption{ -1.0f };		// < 0: the base config's
+		real_t duration{ -1.0f };
+		std::vector<real_t> sources;	// x, y, z triples
+		std::vector<real_t> recorders;
+		std::string sources_path;
+		std::string recorders_path;
+	};
+
+	struct Settings
+	{
+		int jobs{ 1 };					// variants run at once
+		int threads{ 0 };				// total OpenMP threads over all jobs, 0: omp_get_max_threads()
+		bool ir{ false };
+		std::string output{ "./output" };
+	};
+
+	struct Result
+	{
+		bool ok{ false };
+		int steps{ 0 };
+		double seconds{ 0.0 };
+	};
+
+	ParameterSweep(const SimulationConfig& config, const std::string& scene_path,
+		const std::string& sources_path, const std::string& recorders_path);
+
+	static bool ReadVariants(const std::string& path, std::vector<Variant>& variants);
+
+	// Runs every variant; one Result per variant, in order.
+	std::vector<Result> Run(const std::vector<Variant>& variants, const Settings& settings);
+
+	size_t num_partitions() const
+	{
+		return boxes_.size();
+	}
+
+private:
+	struct Row
+	{
+		int recorder;
+		real_t x, y, z;
+		real_t edt, t30, c50, c80, d50;
+	};
+
+	Result RunVariant(const Variant& variant, const Settings& settings, std::vector<Row>& rows);
+
+	SimulationConfig config_;
+	std::vector<SceneGenerator::Box> boxes_;
+	std::string sources_path_;
+	std::string recorders_path_;
+	std::vector<std::shared_ptr<const void>> tables_;	// one per partition size, held for the sweep's lifetime
+};
@@ -4,17 +4,17 @@
 #include "dct_partition.h"
 #include "simulation.h"
 #include "tools.h"
+#include <algorithm>
 #include <fstream>
 #include <iostream>
 
-Partition::Partition(int xs, int ys, int zs, int w, int h, int d)
-	: x_start_(xs), y_start_(ys), z_start_(zs), width_(w), height_(h), depth_(d)
+Partition::Partition(const SimulationConfig& config, int xs, int ys, int zs, int w, int h, int d)
+	: config_(config), x_start_(xs), y_start_(ys), z_start_(zs), width_(w), height_(h), depth_(d)
 {
-	static int id_generator = 0;
-	info_.id = id_generator++;
-	dh_ = Simulation::m_dh;
-	dt_ = Simulation::m_dt;
-	c0_ = Simulation::m_c0;
+	info_.id = 0;	// numbered by ImportPartitions and Simulation, per simulation
+	dh_ = config.dh;
+	dt_ = config.dt;
+	c0_ = config.c0;
 	x_end_ = x_start_ + width_;
 	y_end_ = y_start_ + height_;
 	z_end_ = z_start_ + depth_;
@@ -55,37 +55,71 @@ Partition::~Partition()
 {
 }
 
-std::vector<real_t> Partition::get_xy_plane(int z)
+void PlaneView::CopyTo(real_t* out, ptrdiff_t out_stride) const
 {
-	std::vector<real_t> xy_plane;
-	for (int i = 0; i < height_; i++) {
-		for (int j = 0; j < width_; j++) {
-			xy_plane.push_back(get_pressure(j, i, z));
+	for (int v = 0; v < height; v++)
+	{
+		const real_t* row = data + v * row_stride;
+		real_t* target = out + v * out_stride;
+		if (column_stride == 1)
+		{
+			std::copy(row, row + width, target);
+			continue;
 		}
+		for (int u = 0; u < width; u++)
+			target[u] = row[u * column_stride];
 	}
-	return xy_plane;
 }
 
-std::vector<real_t> Partition::get_yz_plane(int x)
+PlaneView Partition::plane(int axis, int offset, int field)
 {
-	std::vector<real_t> yz_plane;
-	for (int i = 0; i < depth_; i++) {
-		for (int j = 0; j < height_; j++) {
-			yz_plane.push_back(get_pressure(x, j, i));
-		}
+	PlaneView view;
+	int extent = axis == 0 ? depth_ : (axis == 1 ? width_ : height_);
+	if (offset < 0 || offset >= extent)
+	{
+		return view;
+	}
+	// Pressure arrays are z, y, x (PML ghost cell past the end), field f field_stride_ further.
+	ptrdiff_t x_stride = 1, y_stride = width_, z_stride = (ptrdiff_t)width_ * height_;
+	const real_t* field_data = get_pressure_field() + (size_t)field * field_stride_;
+	switch (axis)
+	{
+	case 0:
+		view = { field_data + offset * z_stride, width_, height_, x_stride, y_stride };
+		break;
+	case 1:
+		view = { field_data + offset * x_stride, height_, depth_, y_stride, z_stride };
+		break;
+	default:
+		view = { field_data + offset * y_stride, width_, depth_, x_stride, z_stride };
+		break;
 	}
-	return yz_plane;
+	return view;
 }
 
-std::vector<real_t> Partition::get_xz_plane(int y)
+static std::vector<real_t> CopyPlane(const PlaneView& view)
 {
-	std::vector<real_t> xz_plane;
-	for (int i = 0; i < depth_; i++) {
-		for (int j = 0; j < width_; j++) {
-			xz_plane.push_back(get_pressure(j, y, i));
-		}
+	std::vector<real_t> plane((size_t)view.width * view.height);
+	if (!view.empty())
+	{
+		view.CopyTo(plane.data(), view.width);
 	}
-	return xz_plane;
+	return plane;
+}
+
+std::vector<real_t> Partition::get_xy_plane(int z)
+{
+	return CopyPlane(plane(0, z));
+}
+
+std::vector<real_t> Partition::get_yz_plane(int x)
+{
+	return CopyPlane(plane(1, x));
+}
+
+std::vector<real_t> Partition::get_xz_plane(int y)
+{
+	return CopyPlane(plane(2, y));
 }
 
 std::vector<real_t> Partition::get_xy_forcing_plane(int z)
@@ -93,6 +127,11 @@ std::vector<real_t> Partition::get_xy_forcing_plane(int z)
 	return std::vector<real_t>();
 }
 
+double Partition::ModeEnergy()
+{
+	return -1.0;
+}
+
 void Partition::AddBoundary(std::shared_ptr<Boundary> boundary)
 {
 	info_.num_boundaries++;
@@ -146,9 +185,15 @@ void Partition::AddSource(std::shared_ptr<SoundSource> source)
 {
 	info_.num_sources++;
 	sources_.push_back(source);
+	int x = source->x_ - x_start_, y = source->y_ - y_start_, z = source->z_ - z_start_;
+	if (x >= 0 && x < width_ && y >= 0 && y < height_ && z >= 0 && z < depth_)
+	{
+		size_t offset = (size_t)source->field_ * field_stride_ + ((size_t)z * height_ + y) * width_ + x;
+		source_cells_.push_back({ offset, source.get() });
+	}
 }
 
-std::vector<std::shared_ptr<Partition>> Partition::ImportPartitions(std::string path, VkGPU* vkGPU)
+std::vector<std::shared_ptr<Partition>> Partition::ImportPartitions(const SimulationConfig& config, std::string path, VkGPU* vkGPU)
 {
 	std::vector<std::shared_ptr<Partition>> partitions;
 
@@ -162,14 +207,15 @@ std::vector<std::shared_ptr<Partition>> Partition::ImportPartitions(std::string
 		file >> width >> height >> depth;
 		if (file.eof()) break;
 
-		real_t const x = x_start / Simulation::m_dh;
-		real_t const y = y_start / Simulation::m_dh;
-		real_t const z = z_start / Simulation::m_dh;
-		real_t const w = width / Simulation::m_dh;
-		real_t const h = height / Simulation::m_dh;
-		real_t const d = depth / Simulation::m_dh;
+		real_t const x = x_start / config.dh;
+		real_t const y = y_start / config.dh;
+		real_t const z = z_start / config.dh;
+		real_t const w = width / config.dh;
+		real_t const h = height / config.dh;
+		real_t const d = depth / config.dh;
 
-		partitions.push_back(std::make_shared<DctPartition>((int)x, (int)y, (int)z, (int)w, (int)h, (int)d, vkGPU));
+		partitions.push_back(std::make_shared<DctPartition>(config, (int)x, (int)y, (int)z, (int)w, (int)h, (int)d, vkGPU));
+		partitions.back()->info_.id = (int)partitions.size() - 1;
 	}
 	file.close();
 	return partitions;
@@ -184,14 +230,15 @@ void Partition::Info()
 		<< std::to_string(info_.num_boundaries) << " boundaries; " << std::endl;
 }
 
-void Partition::ComputeSourceForcingTerms(real_t t)
+void Partition::ComputeSourceForcingTerms(int time_step)
 {
-	for (auto source : sources_)
+	if (source_cells_.empty())
+	{
+		return;
+	}
+	real_t* force = get_force_field();
+	for (auto& cell : source_cells_)
 	{
-		set_force(
-			source->x_ - x_start_,
-			source->y_ - y_start_,
-			source->z_ - z_start_,
-			source->SampleValue(t));
+		force[cell.offset] = cell.source->Sample(time_step);
 	}
 }
@@ -1,16 +1,41 @@
 #pragma once
+#include <cstddef>
 #include <string>
 #include <vector>
 #include <memory>
 //#include "sound_source.h"
 #include "types.h"
+#include "simulation_config.h"
 
 class Boundary;
 class SoundSource;
 
+/* One plane of a partition's pressure array, in place: value (u, v) is data[u * column_stride + v * row_stride].
+ * Axis 0 is the xy plane (u = x, v = y), 1 the yz plane (u = y, v = z), 2 the xz plane (u = x, v = z),
+ * the same numbering as FieldView::Settings::look_from. Valid until the partition's next update.
+ */
+struct PlaneView
+{
+	const real_t* data{ nullptr };
+	int width{ 0 }, height{ 0 };
+	ptrdiff_t column_stride{ 0 }, row_stride{ 0 };
+
+	bool empty() const
+	{
+		return data == nullptr;
+	}
+	real_t operator()(int u, int v) const
+	{
+		return data[u * column_stride + v * row_stride];
+	}
+	// Row by row into out (out_stride between rows); rows with unit column stride are plain copies.
+	void CopyTo(real_t* out, ptrdiff_t out_stride) const;
+};
+
 class Partition
 {
 protected:
+	SimulationConfig config_;	// the simulation's parameters, shared by value with everything built from this partition
 	real_t dh_;
 	real_t dt_;
 	real_t c0_;
@@ -18,6 +43,7 @@ protected:
 	int y_start_, y_end_;
 	int z_start_, z_end_;
 	int width_, height_, depth_;
+	int field_stride_{ 0 };	// distance between two fields' pressure (and force) arrays
 	struct Info
 	{
 		int id;
@@ -27,6 +53,12 @@ protected:
 	} info_;
 
 	std::vector<std::shared_ptr<SoundSource>> sources_;
+	struct SourceCell
+	{
+		size_t offset;			// into get_force_field(), field included
+		SoundSource* source;
+	};
+	std::vector<SourceCell> source_cells_;
 	std::vector<std::vector<int>> right_free_borders_;
 	std::vector<std::vector<int>> left_free_borders_;
 	std::vector<std::vector<int>> top_free_borders_;
@@ -41,27 +73,33 @@ protected:
 	bool is_z_pml_{ false };
 	
 public:
-	static real_t m_absorption;
-
-	Partition(int xs, int ys, int zs, int w, int h, int d);
+	Partition(const SimulationConfig& config, int xs, int ys, int zs, int w, int h, int d);
 	~Partition();
 
 	virtual void Update() = 0;
 
-	virtual real_t* get_pressure_field() = 0;
-	std::vector<real_t> get_xy_plane(int z);
+	virtual real_t* get_pressure_field() = 0;	// field 0; field f starts field_stride_ further
+	virtual real_t* get_force_field() = 0;
+	PlaneView plane(int axis, int offset, int field = 0);	// offset: local cell along the normal; empty outside
+	std::vector<real_t> get_xy_plane(int z);	// copies of plane(0, z) etc.
 	std::vector<real_t> get_yz_plane(int x);
 	std::vector<real_t> get_xz_plane(int y);
-	virtual real_t get_pressure(int x, int y, int z) = 0;
-	virtual void set_force(int x, int y, int z, real_t f) = 0;
+	virtual real_t get_pressure(int x, int y, int z, int field = 0) = 0;
+	virtual void set_force(int x, int y, int z, real_t f, int field = 0) = 0;
 	virtual std::vector<real_t> get_xy_forcing_plane(int z);
 	virtual void Info();
+	virtual double ModeEnergy();	// acoustic energy (arbitrary but common units), < 0 if not tracked
 
 	void AddBoundary(std::shared_ptr<Boundary> boundary);
 	void AddSource(std::shared_ptr<SoundSource> source);
-	static std::vector<std::shared_ptr<Partition>> ImportPartitions(std::string path, struct VkGPU* vkGPU);
+	static std::vector<std::shared_ptr<Partition>> ImportPartitions(const SimulationConfig& config, std::string path, struct VkGPU* vkGPU);
+
+	const SimulationConfig& config() const
+	{
+		return config_;
+	}
 
-	void ComputeSourceForcingTerms(real_t t);
+	void ComputeSourceForcingTerms(int time_step);	// all sources of the partition, from their waveform tables
 
 	friend class Boundary;
 	//friend class SoundSource;
@@ -69,5 +107,11 @@ public:
 	friend class Tools;
 	friend class PmlPartition;
 	friend class Recorder;
+	friend class ReceiverArray;
+	friend class FieldView;
+	friend class SnapshotWriter;
+	friend class SimulationContext;
+	friend class ScenePackage;
+	friend class PartitionIndex;
 };
 
@@ -0,0 +1,145 @@
+#include "partition_index.h"
+#include "partition.h"
+#include <algorithm>
+#include <climits>
+
+
+PartitionIndex::PartitionIndex(const std::vector<std::shared_ptr<Partition>>& partitions)
+	: partitions_(partitions)
+{
+	for (int i = 0; i < (int)partitions_.size(); i++)
+	{
+		auto& p = partitions_[i];
+		if (p->info_.type == "PML")
+		{
+			continue;
+		}
+		boxes_.push_back({ { p->x_start_, p->y_start_, p->z_start_ }, { p->x_end_, p->y_end_, p->z_end_ }, i });
+	}
+	if (!boxes_.empty())
+	{
+		nodes_.reserve(2 * boxes_.size());
+		Build(0, (int)boxes_.size());
+	}
+}
+
+int PartitionIndex::Build(int first, int count)
+{
+	const int leaf_size = 4;
+	int index = (int)nodes_.size();
+	nodes_.push_back(Node());
+	Node node = { { INT_MAX, INT_MAX, INT_MAX }, { INT_MIN, INT_MIN, INT_MIN }, first, count, -1, -1 };
+	for (int i = first; i < first + count; i++)
+	{
+		for (int a = 0; a < 3; a++)
+		{
+			node.lo[a] = std::min(node.lo[a], boxes_[i].lo[a]);
+			node.hi[a] = std::max(node.hi[a], boxes_[i].hi[a]);
+		}
+	}
+	if (count > leaf_size)
+	{
+		int axis = 0;
+		for (int a = 1; a < 3; a++)
+		{
+			if (node.hi[a] - node.lo[a] > node.hi[axis] - node.lo[axis]) axis = a;
+		}
+		int half = count / 2;
+		std::nth_element(boxes_.begin() + first, boxes_.begin() + first + half, boxes_.begin() + first + count,
+			[axis](const Box& a, const Box& b) { return a.lo[axis] + a.hi[axis] < b.lo[axis] + b.hi[axis]; });
+		node.count = 0;
+		node.left = Build(first, half);
+		node.right = Build(first + half, count - half);
+	}
+	nodes_[index] = node;
+	return index;
+}
+
+int PartitionIndex::Locate(int x, int y, int z) const
+{
+	int best = INT_MAX;
+	int stack[64];
+	int depth = 0;
+	if (!nodes_.empty())
+	{
+		stack[depth++] = 0;
+	}
+	while (depth > 0)
+	{
+		const Node& node = nodes_[stack[--depth]];
+		if (x < node.lo[0] || x >= node.hi[0] || y < node.lo[1] || y >= node.hi[1] || z < node.lo[2] || z >= node.hi[2])
+		{
+			continue;
+		}
+		if (node.count > 0)
+		{
+			for (int i = node.first; i < node.first + node.count; i++)
+			{
+				const Box& b = boxes_[i];
+				if (x >= b.lo[0] && x < b.hi[0] && y >= b.lo[1] && y < b.hi[1] && z >= b.lo[2] && z < b.hi[2])
+				{
+					best = std::min(best, b.partition);
+				}
+			}
+			continue;
+		}
+		stack[depth++] = node.left;
+		stack[depth++] = node.right;
+	}
+	return best == INT_MAX ? -1 : best;
+}
+
+/* Faces perpendicular to axis: the boxes ending at a plane against those starting there. Within a
+ * plane both kinds are swept in order of their start along the other axis; each new interval pairs
+ * with the still open ones of the other kind, which all overlap it.
+ */
+void PartitionIndex::SweepFaces(int axis, std::vector<std::pair<int, int>>& pairs) const
+{
+	int other = 1 - axis;
+	struct Face
+	{
+		int plane;
+		int lo, hi;
+		int side;	// 0: box ends at the plane, 1: starts there
+		int partition;
+	};
+	std::vector<Face> faces;
+	faces.reserve(2 * boxes_.size());
+	for (auto& b : boxes_)
+	{
+		faces.push_back({ b.hi[axis], b.lo[other], b.hi[other], 0, b.partition });
+		faces.push_back({ b.lo[axis], b.lo[other], b.hi[other], 1, b.partition });
+	}
+	std::sort(faces.begin(), faces.end(), [](const Face& a, const Face& b)
+	{
+		return a.plane != b.plane ? a.plane < b.plane : a.lo < b.lo;
+	});
+
+	std::vector<const Face*> open[2];
+	for (size_t i = 0; i < faces.size(); i++)
+	{
+		if (i == 0 || faces[i].plane != faces[i - 1].plane)
+		{
+			open[0].clear();
+			open[1].clear();
+		}
+		const Face& face = faces[i];
+		auto& others = open[1 - face.side];
+		others.erase(std::remove_if(others.begin(), others.end(), [&face](const Face* f) { return f->hi <= face.lo; }), others.end());
+		for (const Face* f : others)
+		{
+			pairs.push_back(std::minmax(face.partition, f->partition));
+		}
+		open[face.side].push_back(&face);
+	}
+}
+
+std::vector<std::pair<int, int>> PartitionIndex::Touching() const
+{
+	std::vector<std::pair<int, int>> pairs;
+	SweepFaces(0, pairs);
+	SweepFaces(1, pairs);
+	std::sort(pairs.begin(), pairs.end());
+	pairs.erase(std::unique(pairs.begin(), pairs.end()), pairs.end());
+	return pairs;
+}
@@ -0,0 +1,56 @@
+#pragma once
+#include <memory>
+#include <utility>
+#include <vector>
+
+class Partition;
+
+/* Spatial index over the partitions' boxes (cells), for scenes of thousands of partitions.
+ *
+ * Point location walks a bounding volume hierarchy (median splits along the longest axis, a few
+ * boxes per leaf): O(log n) per source, recorder or receiver instead of a scan over all partitions.
+ * Adjacency groups the faces perpendicular to x and to y by their plane and sweeps each plane's
+ * intervals, so only boxes that actually meet there are paired: O(n log n + pairs) instead of
+ * testing every pair. As in Boundary::FindBoundary the scenes are 2.5D, so z is not compared.
+ *
+ * Indices are those of the vector the index was built from. PML partitions are not indexed;
+ * partitions are assumed disjoint, otherwise the lowest index containing a cell wins, as the
+ * scans it replaces did.
+ */
+class PartitionIndex
+{
+public:
+	explicit PartitionIndex(const std::vector<std::shared_ptr<Partition>>& partitions);
+
+	int Locate(int x, int y, int z) const;	// partition containing the cell, -1 outside all
+	std::vector<std::pair<int, int>> Touching() const;	// i < j sharing part of an x or y face, sorted
+
+	const std::shared_ptr<Partition>& partition(int i) const
+	{
+		return partitions_[i];
+	}
+	size_t size() const
+	{
+		return partitions_.size();
+	}
+
+private:
+	struct Box
+	{
+		int lo[3], hi[3];
+		int partition;
+	};
+	struct Node
+	{
+		int lo[3], hi[3];
+		int first, count;	// leaf: boxes_[first, first + count)
+		int left, right;	// inner node: children
+	};
+
+	int Build(int first, int count);
+	void SweepFaces(int axis, std::vector<std::pair<int, int>>& pairs) const;
+
+	std::vector<std::shared_ptr<Partition>> partitions_;
+	std::vector<Box> boxes_;
+	std::vector<Node> nodes_;
+};
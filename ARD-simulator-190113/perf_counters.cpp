@@ -0,0 +1,265 @@
+#include "perf_counters.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+bool PerfCounters::m_enabled = false;
+std::mutex PerfCounters::m_register_mutex;
+std::vector<std::unique_ptr<PerfCounters::ThreadState>> PerfCounters::m_threads;
+
+void PerfCounters::Totals::Add(const Totals& t)
+{
+	calls += t.calls;
+	cells += t.cells;
+	ns += t.ns;
+	cycles += t.cycles;
+	instructions += t.instructions;
+	llc_misses += t.llc_misses;
+	stall_cycles += t.stall_cycles;
+}
+
+#if defined(__linux__)
+static int OpenCounter(uint32_t type, uint64_t config, int group_fd)
+{
+	struct perf_event_attr attr;
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = type;
+	attr.config = config;
+	attr.disabled = (group_fd == -1) ? 1 : 0;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	attr.read_format = PERF_FORMAT_GROUP;
+	// pid = 0, cpu = -1: the calling thread on any cpu
+	return (int)syscall(__NR_perf_event_open, &attr, 0, -1, group_fd, 0);
+}
+#endif
+
+bool PerfCounters::Enable()
+{
+#if defined(__linux__)
+	// Probe once on the calling thread, perf_event_paranoid may forbid user space counting.
+	int fd = OpenCounter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, -1);
+	if (fd < 0)
+	{
+		std::cout << "perf_event_open not available, hardware counters disabled." << std::endl;
+		return false;
+	}
+	close(fd);
+	m_enabled = true;
+	return true;
+#else
+	return false;
+#endif
+}
+
+PerfCounters::ThreadState* PerfCounters::Local()
+{
+	thread_local ThreadState* state = nullptr;
+	if (!state)
+	{
+		std::lock_guard<std::mutex> lock(m_register_mutex);
+		m_threads.push_back(std::make_unique<ThreadState>());
+		state = m_threads.back().get();
+#if defined(__linux__)
+		// Not every PMU exposes LLC misses or backend stalls; missing counters read as 0.
+		const uint64_t configs[4][2] = {
+			{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+			{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+			{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+			{ PERF_TYPE_HARDWARE, PERF_COUNT_HW_STALLED_CYCLES_BACKEND } };
+		for (int i = 0; i < 4; i++)
+		{
+			state->fds[i] = OpenCounter((uint32_t)configs[i][0], configs[i][1], state->group_fd);
+			if (i == 0)
+			{
+				state->group_fd = state->fds[0];
+				if (state->group_fd < 0) break;
+			}
+		}
+		if (state->group_fd >= 0)
+		{
+			for (int i = 0; i < 4; i++)
+			{
+				if (state->fds[i] >= 0) state->num_counters++;
+			}
+			ioctl(state->group_fd, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+			ioctl(state->group_fd, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+		}
+#endif
+	}
+	return state;
+}
+
+bool PerfCounters::Read(Sample& sample)
+{
+	sample.ns = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+#if defined(__linux__)
+	ThreadState* state = Local();
+	if (state->group_fd < 0) return false;
+	uint64_t buffer[1 + 4] = { 0 };	// nr, values in open order
+	if (read(state->group_fd, buffer, sizeof(buffer)) <= 0) return false;
+	int n = 0;
+	for (int i = 0; i < 4; i++)
+	{
+		sample.values[i] = (state->fds[i] >= 0 && n < (int)buffer[0]) ? buffer[1 + n++] : 0;
+	}
+	return true;
+#else
+	return false;
+#endif
+}
+
+void PerfCounters::Accumulate(Kernel kernel, int id, uint64_t cells, const Sample& begin, const Sample& end)
+{
+	Totals& t = Local()->totals[std::make_pair((int)kernel, id)];
+	t.calls++;
+	t.cells += cells;
+	t.ns += end.ns - begin.ns;
+	t.cycles += end.values[0] - begin.values[0];
+	t.instructions += end.values[1] - begin.values[1];
+	t.llc_misses += end.values[2] - begin.values[2];
+	t.stall_cycles += end.values[3] - begin.values[3];
+}
+
+const char* PerfCounters::KernelName(Kernel kernel)
+{
+	switch (kernel)
+	{
+	case K_DCT: return "DCT";
+	case K_PML: return "PML";
+	case K_INTERFACE: return "Interface";
+	default: return "?";
+	}
+}
+
+double PerfCounters::ModelBytesPerCell(Kernel kernel)
+{
+	switch (kernel)
+	{
+	case K_DCT:
+		// update: force/pressure modes, prev, cwt, w2 in, next out; two memcpy; two normalisation passes;
+		// each transform streams its input and output once.
+		return 4.0 * (6 + 4 + 4 + 4);
+	case K_PML:
+		// p, p_old, phi_xyz, zeta_xyz, force in; p_new, phi_xyz_new out; force cleared.
+		return 4.0 * (9 + 4 + 1);
+	case K_INTERFACE:
+		// per interface cell: 6 pressures read, 6 forces written.
+		return 4.0 * (6 + 6);
+	default:
+		return 0.0;
+	}
+}
+
+double PerfCounters::ModelFlopsPerCell(Kernel kernel, uint64_t cells_per_call)
+{
+	switch (kernel)
+	{
+	case K_DCT:
+	{
+		// ~2.5 N log2(N) per real-to-real transform, two transforms, plus the update and normalisation.
+		double n = (double)std::max<uint64_t>(cells_per_call, 2);
+		return 2.0 * 2.5 * std::log2(n) + 9.0 + 2.0;
+	}
+	case K_PML:
+		// 7-point second derivatives and two sets of 5-point first derivatives in x, y, z, plus the update.
+		return 3 * 14 + 2 * 3 * 10 + 40;
+	case K_INTERFACE:
+		// 6 outputs, 6-tap stencil each, plus scaling.
+		return 6 * (6 * 2 + 4);
+	default:
+		return 0.0;
+	}
+}
+
+void PerfCounters::Report(int first_step, int last_step, bool per_id)
+{
+	if (!m_enabled) return;
+
+	std::map<std::pair<int, int>, Totals> merged;
+	{
+		std::lock_guard<std::mutex> lock(m_register_mutex);
+		for (auto& state : m_threads)
+		{
+			for (auto& entry : state->totals)
+			{
+				merged[entry.first].Add(entry.second);
+			}
+			state->totals.clear();	// safe between steps, no PerfScope is live
+		}
+	}
+
+	Totals per_kernel[K_COUNT];
+	for (auto& entry : merged)
+	{
+		per_kernel[entry.first.first].Add(entry.second);
+	}
+
+	std::ios::fmtflags flags = std::cout.flags();
+	std::streamsize precision = std::cout.precision();
+	std::cout << "# Hardware counters, steps " << first_step << "-" << last_step << " ######################" << std::endl;
+	std::cout << std::left << std::setw(10) << "kernel" << std::right
+		<< std::setw(12) << "Mcells"
+		<< std::setw(10) << "ns/cell"
+		<< std::setw(8) << "IPC"
+		<< std::setw(12) << "LLCmiss/c"
+		<< std::setw(9) << "stall%"
+		<< std::setw(9) << "B/cell"
+		<< std::setw(9) << "F/cell"
+		<< std::setw(8) << "F/B"
+		<< std::setw(9) << "GB/s"
+		<< std::setw(9) << "GF/s" << std::endl;
+
+	auto print = [](const char* name, Kernel kernel, const Totals& t)
+	{
+		if (t.cells == 0 || t.calls == 0) return;
+		double cells = (double)t.cells;
+		double cells_per_call = cells / t.calls;
+		double bytes = ModelBytesPerCell(kernel);
+		double flops = ModelFlopsPerCell(kernel, (uint64_t)cells_per_call);
+		// ns is summed over threads, so rates are per thread-second (cycles of all threads).
+		double seconds = t.ns * 1e-9;
+		std::cout << std::left << std::setw(10) << name << std::right << std::fixed
+			<< std::setw(12) << std::setprecision(2) << cells * 1e-6
+			<< std::setw(10) << std::setprecision(2) << t.ns / cells
+			<< std::setw(8) << std::setprecision(2) << (t.cycles ? (double)t.instructions / t.cycles : 0.0)
+			<< std::setw(12) << std::setprecision(4) << t.llc_misses / cells
+			<< std::setw(9) << std::setprecision(1) << (t.cycles ? 100.0 * t.stall_cycles / t.cycles : 0.0)
+			<< std::setw(9) << std::setprecision(1) << bytes
+			<< std::setw(9) << std::setprecision(1) << flops
+			<< std::setw(8) << std::setprecision(2) << flops / bytes
+			<< std::setw(9) << std::setprecision(2) << (seconds > 0 ? bytes * cells / seconds * 1e-9 : 0.0)
+			<< std::setw(9) << std::setprecision(2) << (seconds > 0 ? flops * cells / seconds * 1e-9 : 0.0)
+			<< std::endl;
+	};
+
+	for (int k = 0; k < K_COUNT; k++)
+	{
+		print(KernelName((Kernel)k), (Kernel)k, per_kernel[k]);
+	}
+	if (per_id)
+	{
+		std::cout << "------------------------------------------------------------" << std::endl;
+		for (auto& entry : merged)
+		{
+			std::string name = std::string(KernelName((Kernel)entry.first.first)) + " " + std::to_string(entry.first.second);
+			print(name.c_str(), (Kernel)entry.first.first, entry.second);
+		}
+	}
+	std::cout << "############################################################" << std::endl;
+	std::cout.flags(flags);
+	std::cout.precision(precision);
+}
@@ -0,0 +1,105 @@
+#pragma once
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+/* Hardware counter sampling per kernel (Linux perf_event_open).
+ *
+ * Each thread opens one counter group the first time it enters a PerfScope and accumulates
+ * cycles, instructions, LLC misses and backend stall cycles per (kernel, partition/boundary id)
+ * into its own table, so nothing is shared on the hot path. Report() merges the tables, prints a
+ * roofline-style summary for the current step window and resets it.
+ * On other platforms, or when perf events are not permitted, everything is a no-op.
+ */
+class PerfCounters
+{
+public:
+	enum Kernel {
+		K_DCT,			// DctPartition::Update: DCT, mode update, IDCT
+		K_PML,			// PmlPartition::Update
+		K_INTERFACE,	// Boundary::ComputeForcingTerms
+		K_COUNT
+	};
+
+	struct Totals
+	{
+		uint64_t calls{ 0 };
+		uint64_t cells{ 0 };
+		uint64_t ns{ 0 };
+		uint64_t cycles{ 0 };
+		uint64_t instructions{ 0 };
+		uint64_t llc_misses{ 0 };
+		uint64_t stall_cycles{ 0 };
+
+		void Add(const Totals& t);
+	};
+
+	struct Sample
+	{
+		uint64_t ns{ 0 };
+		uint64_t values[4]{ 0, 0, 0, 0 };	// cycles, instructions, llc misses, backend stalls
+	};
+
+	static bool Enable();
+	static bool enabled()
+	{
+		return m_enabled;
+	}
+
+	static bool Read(Sample& sample);
+	static void Accumulate(Kernel kernel, int id, uint64_t cells, const Sample& begin, const Sample& end);
+
+	static void Report(int first_step, int last_step, bool per_id = false);
+
+	static const char* KernelName(Kernel kernel);
+	// Analytic model of compulsory memory traffic and arithmetic per cell, see perf_counters.cpp.
+	static double ModelBytesPerCell(Kernel kernel);
+	static double ModelFlopsPerCell(Kernel kernel, uint64_t cells_per_call);
+
+private:
+	struct ThreadState
+	{
+		int group_fd{ -1 };
+		int fds[4]{ -1, -1, -1, -1 };
+		int num_counters{ 0 };
+		std::map<std::pair<int, int>, Totals> totals;	// (kernel, id) -> totals
+	};
+
+	static ThreadState* Local();
+
+	static bool m_enabled;
+	static std::mutex m_register_mutex;
+	static std::vector<std::unique_ptr<ThreadState>> m_threads;
+};
+
+/* RAII scope: PerfScope scope(PerfCounters::K_PML, info_.id, cells); */
+class PerfScope
+{
+	PerfCounters::Kernel kernel_;
+	int id_;
+	uint64_t cells_;
+	bool active_;
+	PerfCounters::Sample begin_;
+
+public:
+	PerfScope(PerfCounters::Kernel kernel, int id, uint64_t cells)
+		: kernel_(kernel), id_(id), cells_(cells), active_(PerfCounters::enabled())
+	{
+		if (active_)
+		{
+			active_ = PerfCounters::Read(begin_);
+		}
+	}
+	~PerfScope()
+	{
+		PerfCounters::Sample end;
+		if (active_ && PerfCounters::Read(end))
+		{
+			PerfCounters::Accumulate(kernel_, id_, cells_, begin_, end);
+		}
+	}
+	PerfScope(const PerfScope&) = delete;
+	PerfScope& operator=(const PerfScope&) = delete;
+};
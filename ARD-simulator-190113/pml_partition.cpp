@@ -1,5 +1,10 @@
+#define _USE_MATH_DEFINES
+#include <cmath>
+#include <cstring>
 #include "pml_partition.h"
 #include "simulation.h"
+#include "tracer.h"
+#include "perf_counters.h"
 #include <omp.h>
 
 
@@ -15,7 +20,7 @@ int PmlPartition::GetIndex(int x, int y, int z)
 }
 
 PmlPartition::PmlPartition(std::shared_ptr<Partition> neighbor_part, PmlType type, int xs, int ys, int zs, int w, int h, int d)
-	: Partition(xs, ys, zs, w, h, d), type_(type), neighbor_part_(neighbor_part)
+	: Partition(neighbor_part->config_, xs, ys, zs, w, h, d), type_(type), neighbor_part_(neighbor_part)
 {
 	include_self_terms_ = false;
 	should_render_ = true;
@@ -25,32 +30,35 @@ PmlPartition::PmlPartition(std::shared_ptr<Partition> neighbor_part, PmlType typ
 	if (type_ == P_TOP || type_ == P_BOTTOM) is_y_pml_ = true;
 	if (type_ == P_FRONT || type_ == P_BACK) is_z_pml_ = true;
 
-	thickness_ = Simulation::m_pml_layers * dh_;
-	zeta_ = Simulation::m_c0 / thickness_ * log10f(1.0f / R_);
+	thickness_ = config_.pml_layers * dh_;
+	zeta_ = c0_ / thickness_ * log10f(1.0f / R_);
 
+	// config_.fields independent fields, each with its own out-of-range cell; the zeta profiles are shared.
 	int size = width_ * height_*depth_ + 1;
-	p_old_ = (real_t *)malloc(size * sizeof(real_t));
-	p_ = (real_t *)malloc(size * sizeof(real_t));
-	p_new_ = (real_t *)malloc(size * sizeof(real_t));
-
-	phi_x_ = (real_t *)malloc(size * sizeof(real_t));
-	phi_x_new_ = (real_t *)malloc(size * sizeof(real_t));
-	phi_y_ = (real_t *)malloc(size * sizeof(real_t));
-	phi_y_new_ = (real_t *)malloc(size * sizeof(real_t));
-	phi_z_ = (real_t *)malloc(size * sizeof(real_t));
-	phi_z_new_ = (real_t *)malloc(size * sizeof(real_t));
-
-	force_ = (real_t *)malloc(size * sizeof(real_t));
-	memset((void *)p_old_, 0, size * sizeof(real_t));
-	memset((void *)p_, 0, size * sizeof(real_t));
-	memset((void *)p_new_, 0, size * sizeof(real_t));
-	memset((void *)phi_x_, 0, size * sizeof(real_t));
-	memset((void *)phi_x_new_, 0, size * sizeof(real_t));
-	memset((void *)phi_y_, 0, size * sizeof(real_t));
-	memset((void *)phi_y_new_, 0, size * sizeof(real_t));
-	memset((void *)phi_z_, 0, size * sizeof(real_t));
-	memset((void *)phi_z_new_, 0, size * sizeof(real_t));
-	memset((void *)force_, 0, size * sizeof(real_t));
+	field_stride_ = size;
+	size_t fields_size = (size_t)size * config_.fields;
+	p_old_ = (real_t *)malloc(fields_size * sizeof(real_t));
+	p_ = (real_t *)malloc(fields_size * sizeof(real_t));
+	p_new_ = (real_t *)malloc(fields_size * sizeof(real_t));
+
+	phi_x_ = (real_t *)malloc(fields_size * sizeof(real_t));
+	phi_x_new_ = (real_t *)malloc(fields_size * sizeof(real_t));
+	phi_y_ = (real_t *)malloc(fields_size * sizeof(real_t));
+	phi_y_new_ = (real_t *)malloc(fields_size * sizeof(real_t));
+	phi_z_ = (real_t *)malloc(fields_size * sizeof(real_t));
+	phi_z_new_ = (real_t *)malloc(fields_size * sizeof(real_t));
+
+	force_ = (real_t *)malloc(fields_size * sizeof(real_t));
+	memset((void *)p_old_, 0, fields_size * sizeof(real_t));
+	memset((void *)p_, 0, fields_size * sizeof(real_t));
+	memset((void *)p_new_, 0, fields_size * sizeof(real_t));
+	memset((void *)phi_x_, 0, fields_size * sizeof(real_t));
+	memset((void *)phi_x_new_, 0, fields_size * sizeof(real_t));
+	memset((void *)phi_y_, 0, fields_size * sizeof(real_t));
+	memset((void *)phi_y_new_, 0, fields_size * sizeof(real_t));
+	memset((void *)phi_z_, 0, fields_size * sizeof(real_t));
+	memset((void *)phi_z_new_, 0, fields_size * sizeof(real_t));
+	memset((void *)force_, 0, fields_size * sizeof(real_t));
 
 	zetax_ = (real_t*)calloc(size, sizeof(real_t));
 	zetay_ = (real_t*)calloc(size, sizeof(real_t));
@@ -112,78 +120,94 @@ PmlPartition::~PmlPartition()
 
 void PmlPartition::Update()
 {
+	TraceSpan span("pml update", info_.id);
+	PerfScope perf(PerfCounters::K_PML, info_.id, (uint64_t)width_ * height_ * depth_ * config_.fields);
 	int width = width_;
 	int height = height_;
 	int depth = depth_;
 	auto type = type_;
 	auto thickness = thickness_;
-	auto dh = Simulation::m_dh;
-	auto dt = Simulation::m_dt;
-	auto c0 = Simulation::m_c0;
+	auto dh = dh_;
+	auto dt = dt_;
+	auto c0 = c0_;
 	auto zeta = zeta_;
 
-#pragma omp parallel for
-	for (int k = 0; k < depth; k++)
+	for (int f = 0; f < config_.fields; f++)
 	{
-//#pragma omp parallel for
-		for (int j = 0; j < height; j++)
+		real_t* p_old = p_old_ + (size_t)f * field_stride_;
+		real_t* p = p_ + (size_t)f * field_stride_;
+		real_t* p_new = p_new_ + (size_t)f * field_stride_;
+		real_t* phi_x = phi_x_ + (size_t)f * field_stride_;
+		real_t* phi_x_new = phi_x_new_ + (size_t)f * field_stride_;
+		real_t* phi_y = phi_y_ + (size_t)f * field_stride_;
+		real_t* phi_y_new = phi_y_new_ + (size_t)f * field_stride_;
+		real_t* phi_z = phi_z_ + (size_t)f * field_stride_;
+		real_t* phi_z_new = phi_z_new_ + (size_t)f * field_stride_;
+		real_t* force = force_ + (size_t)f * field_stride_;
+
+#pragma omp parallel for
+		for (int k = 0; k < depth; k++)
 		{
 //#pragma omp parallel for
-			for (int i = 0; i < width; i++)
+			for (int j = 0; j < height; j++)
 			{
-				real_t coefs[] = { 2.0, -27.0, 270.0, -490.0, 270.0, -27.0, 2.0 };
-				real_t d2udx2 = 0.0;
-				real_t d2udy2 = 0.0;
-				real_t d2udz2 = 0.0;
-				for (int m = 0; m < 7; m++)
-				{
-					d2udx2 += coefs[m] * p_[GetIndex(i + m - 3, j, k)];
-					d2udy2 += coefs[m] * p_[GetIndex(i, j + m - 3, k)];
-					d2udz2 += coefs[m] * p_[GetIndex(i, j, k + m - 3)];
-				}
-				d2udx2 /= (180.0f * dh * dh);
-				d2udy2 /= (180.0f * dh * dh);
-				d2udz2 /= (180.0f * dh * dh);
-
-				real_t term1 = 2 * p_[GetIndex(i, j, k)];
-				real_t term2 = -p_old_[GetIndex(i, j, k)];
-				real_t term3 = c0 * c0 * (d2udx2 + d2udy2 + d2udz2);	// c^2*(d2udx2+d2udy2+d2udz2)
-				real_t term4 = -(zetax_[GetIndex(i, j, k)] + zetay_[GetIndex(i, j, k)] + zetaz_[GetIndex(i, j, k)]) * (p_[GetIndex(i, j, k)] - p_old_[GetIndex(i, j, k)]) / dt;
-				real_t term5 = -(zetax_[GetIndex(i, j, k)] * zetay_[GetIndex(i, j, k)] + zetay_[GetIndex(i, j, k)] * zetaz_[GetIndex(i, j, k)] + zetax_[GetIndex(i, j, k)] * zetaz_[GetIndex(i, j, k)]) * p_[GetIndex(i, j, k)];
-
-				real_t fourthCoefs[] = { 1.0, -8.0, 0.0, 8.0, -1.0 };
-				real_t dphidx = 0.0;
-				real_t dphidy = 0.0;
-				real_t dphidz = 0.0;
-				for (int m = 0; m < 5; m++)
-				{
-					dphidx += fourthCoefs[m] * phi_x_[GetIndex(i + m - 2, j, k)];
-					dphidy += fourthCoefs[m] * phi_y_[GetIndex(i, j + m - 2, k)];
-					dphidz += fourthCoefs[m] * phi_z_[GetIndex(i, j, k + m - 2)];
-				}
-				dphidx /= (12.0f * dh);
-				dphidy /= (12.0f * dh);
-				dphidz /= (12.0f * dh);
-				real_t term6 = dphidx + dphidy + dphidz;
-
-				p_new_[GetIndex(i, j, k)] = term1 + term2 + dt * dt * (term3 + term4 + term5 + term6 + force_[GetIndex(i, j, k)]);
-
-				real_t dudx = 0.0f;
-				real_t dudy = 0.0f;
-				real_t dudz = 0.0f;
-
-				for (int m = 0; m < 5; m++)
+//#pragma omp parallel for
+				for (int i = 0; i < width; i++)
 				{
-					dudx += fourthCoefs[m] * p_[GetIndex(i + m - 2, j, k)];
-					dudy += fourthCoefs[m] * p_[GetIndex(i, j + m - 2, k)];
-					dudz += fourthCoefs[m] * p_[GetIndex(i, j, k + m - 2)];
+					real_t coefs[] = { 2.0, -27.0, 270.0, -490.0, 270.0, -27.0, 2.0 };
+					real_t d2udx2 = 0.0;
+					real_t d2udy2 = 0.0;
+					real_t d2udz2 = 0.0;
+					for (int m = 0; m < 7; m++)
+					{
+						d2udx2 += coefs[m] * p[GetIndex(i + m - 3, j, k)];
+						d2udy2 += coefs[m] * p[GetIndex(i, j + m - 3, k)];
+						d2udz2 += coefs[m] * p[GetIndex(i, j, k + m - 3)];
+					}
+					d2udx2 /= (180.0f * dh * dh);
+					d2udy2 /= (180.0f * dh * dh);
+					d2udz2 /= (180.0f * dh * dh);
+
+					real_t term1 = 2 * p[GetIndex(i, j, k)];
+					real_t term2 = -p_old[GetIndex(i, j, k)];
+					real_t term3 = c0 * c0 * (d2udx2 + d2udy2 + d2udz2);	// c^2*(d2udx2+d2udy2+d2udz2)
+					real_t term4 = -(zetax_[GetIndex(i, j, k)] + zetay_[GetIndex(i, j, k)] + zetaz_[GetIndex(i, j, k)]) * (p[GetIndex(i, j, k)] - p_old[GetIndex(i, j, k)]) / dt;
+					real_t term5 = -(zetax_[GetIndex(i, j, k)] * zetay_[GetIndex(i, j, k)] + zetay_[GetIndex(i, j, k)] * zetaz_[GetIndex(i, j, k)] + zetax_[GetIndex(i, j, k)] * zetaz_[GetIndex(i, j, k)]) * p[GetIndex(i, j, k)];
+
+					real_t fourthCoefs[] = { 1.0, -8.0, 0.0, 8.0, -1.0 };
+					real_t dphidx = 0.0;
+					real_t dphidy = 0.0;
+					real_t dphidz = 0.0;
+					for (int m = 0; m < 5; m++)
+					{
+						dphidx += fourthCoefs[m] * phi_x[GetIndex(i + m - 2, j, k)];
+						dphidy += fourthCoefs[m] * phi_y[GetIndex(i, j + m - 2, k)];
+						dphidz += fourthCoefs[m] * phi_z[GetIndex(i, j, k + m - 2)];
+					}
+					dphidx /= (12.0f * dh);
+					dphidy /= (12.0f * dh);
+					dphidz /= (12.0f * dh);
+					real_t term6 = dphidx + dphidy + dphidz;
+
+					p_new[GetIndex(i, j, k)] = term1 + term2 + dt * dt * (term3 + term4 + term5 + term6 + force[GetIndex(i, j, k)]);
+
+					real_t dudx = 0.0f;
+					real_t dudy = 0.0f;
+					real_t dudz = 0.0f;
+
+					for (int m = 0; m < 5; m++)
+					{
+						dudx += fourthCoefs[m] * p[GetIndex(i + m - 2, j, k)];
+						dudy += fourthCoefs[m] * p[GetIndex(i, j + m - 2, k)];
+						dudz += fourthCoefs[m] * p[GetIndex(i, j, k + m - 2)];
+					}
+					dudx /= (12.0f * dh);
+					dudy /= (12.0f * dh);
+					dudz /= (12.0f * dh);
+					phi_x_new[GetIndex(i, j, k)] = phi_x[GetIndex(i, j, k)] - dt * zetax_[GetIndex(i, j, k)] * phi_x[GetIndex(i, j, k)] + dt * (zetay_[GetIndex(i, j, k)] + zetaz_[GetIndex(i, j, k)] - zetax_[GetIndex(i, j, k)]) * dudx;
+					phi_y_new[GetIndex(i, j, k)] = phi_y[GetIndex(i, j, k)] - dt * zetay_[GetIndex(i, j, k)] * phi_y[GetIndex(i, j, k)] + dt * (zetax_[GetIndex(i, j, k)] + zetaz_[GetIndex(i, j, k)] - zetay_[GetIndex(i, j, k)]) * dudy;
+					phi_z_new[GetIndex(i, j, k)] = phi_z[GetIndex(i, j, k)] - dt * zetaz_[GetIndex(i, j, k)] * phi_z[GetIndex(i, j, k)] + dt * (zetax_[GetIndex(i, j, k)] + zetay_[GetIndex(i, j, k)] - zetaz_[GetIndex(i, j, k)]) * dudz;
 				}
-				dudx /= (12.0f * dh);
-				dudy /= (12.0f * dh);
-				dudz /= (12.0f * dh);
-				phi_x_new_[GetIndex(i, j, k)] = phi_x_[GetIndex(i, j, k)] - dt * zetax_[GetIndex(i, j, k)] * phi_x_[GetIndex(i, j, k)] + dt * (zetay_[GetIndex(i, j, k)] + zetaz_[GetIndex(i, j, k)] - zetax_[GetIndex(i, j, k)]) * dudx;
-				phi_y_new_[GetIndex(i, j, k)] = phi_y_[GetIndex(i, j, k)] - dt * zetay_[GetIndex(i, j, k)] * phi_y_[GetIndex(i, j, k)] + dt * (zetax_[GetIndex(i, j, k)] + zetaz_[GetIndex(i, j, k)] - zetay_[GetIndex(i, j, k)]) * dudy;
-				phi_z_new_[GetIndex(i, j, k)] = phi_z_[GetIndex(i, j, k)] - dt * zetaz_[GetIndex(i, j, k)] * phi_z_[GetIndex(i, j, k)] + dt * (zetax_[GetIndex(i, j, k)] + zetay_[GetIndex(i, j, k)] - zetaz_[GetIndex(i, j, k)]) * dudz;
 			}
 		}
 	}
@@ -196,7 +220,7 @@ void PmlPartition::Update()
 	p_ = p_new_;
 	p_new_ = temp;
 
-	memset((void *)force_, 0, width * height * depth * sizeof(real_t));
+	memset((void *)force_, 0, (size_t)field_stride_ * config_.fields * sizeof(real_t));
 }
 
 real_t* PmlPartition::get_pressure_field()
@@ -204,12 +228,17 @@ real_t* PmlPartition::get_pressure_field()
 	return p_;
 }
 
-real_t PmlPartition::get_pressure(int x, int y, int z)
+real_t* PmlPartition::get_force_field()
+{
+	return force_;
+}
+
+real_t PmlPartition::get_pressure(int x, int y, int z, int field)
 {
-	return p_[GetIndex(x, y, z)];
+	return p_[(size_t)field * field_stride_ + GetIndex(x, y, z)];
 }
 
-void PmlPartition::set_force(int x, int y, int z, real_t f)
+void PmlPartition::set_force(int x, int y, int z, real_t f, int field)
 {
-	force_[GetIndex(x, y, z)] = f;
+	force_[(size_t)field * field_stride_ + GetIndex(x, y, z)] = f;
 }
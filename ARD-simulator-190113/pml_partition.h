@@ -51,7 +51,10 @@ public:
 	virtual void Update();
 
 	virtual real_t* get_pressure_field();
-	virtual real_t get_pressure(int x, int y, int z);
-	virtual void set_force(int x, int y, int z, real_t f);
+	virtual real_t* get_force_field();
+	virtual real_t get_pressure(int x, int y, int z, int field = 0);
+	virtual void set_force(int x, int y, int z, real_t f, int field = 0);
+
+	friend class ScenePackage;
 };
 
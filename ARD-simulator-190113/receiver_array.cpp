@@ -0,0 +1,285 @@
+#include "receiver_array.h"
+#include "partition.h"
+#include "dct_partition.h"
+#include "mode_evaluator.h"
+#include "partition_index.h"
+#include "tracer.h"
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <numeric>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+
+ReceiverArray::ReceiverArray(const SimulationConfig& config, int chunk_steps, bool keep)
+	: config_(config), chunk_steps_(std::max(1, chunk_steps)), keep_(keep)
+{
+}
+
+ReceiverArray::~ReceiverArray()
+{
+	Close();
+}
+
+void ReceiverArray::Add(int x, int y, int z)
+{
+	points_.insert(points_.end(), { x, y, z });
+}
+
+void ReceiverArray::ImportReceivers(std::string path)
+{
+	std::ifstream file;
+	file.open(path, std::ifstream::in);
+	while (file.good())
+	{
+		real_t x, y, z;
+		file >> x >> y >> z;
+		if (file.eof()) break;
+		Add((int)(x / config_.dh), (int)(y / config_.dh), (int)(z / config_.dh));
+	}
+	file.close();
+}
+
+void ReceiverArray::AddGrid(const std::vector<std::shared_ptr<Partition>>& partitions, real_t spacing)
+{
+	int step = std::max(1, (int)std::lround(spacing / config_.dh));
+	auto first = [step](int start)
+	{
+		return (int)std::ceil((double)start / step) * step;	// aligned to the global grid, so neighbours agree
+	};
+	for (auto& partition : partitions)
+	{
+		if (partition->info_.type != "DCT")
+		{
+			continue;
+		}
+		for (int z = first(partition->z_start_); z < partition->z_end_; z += step)
+			for (int y = first(partition->y_start_); y < partition->y_end_; y += step)
+				for (int x = first(partition->x_start_); x < partition->x_end_; x += step)
+					Add(x, y, z);
+	}
+}
+
+void ReceiverArray::Build(const std::vector<std::shared_ptr<Partition>>& partitions)
+{
+	TraceSpan span("receiver index");
+
+	PartitionIndex index(partitions);	// the DCT partitions, PML layers are not indexed
+
+	// Point -> (partition, offset).
+	struct Entry
+	{
+		int partition;
+		int32_t offset;
+		int point;
+	};
+	std::vector<Entry> entries;
+	dropped_ = 0;
+	for (int n = 0; n < (int)points_.size() / 3; n++)
+	{
+		int x = points_[3 * n], y = points_[3 * n + 1], z = points_[3 * n + 2];
+		int found = index.Locate(x, y, z);
+		if (found < 0)
+		{
+			dropped_++;
+			continue;
+		}
+		auto& p = partitions[found];
+		int32_t offset = ((z - p->z_start_) * p->height_ + (y - p->y_start_)) * p->width_ + (x - p->x_start_);
+		entries.push_back({ found, offset, n });
+	}
+
+	// Receivers of one partition are adjacent columns, in memory order of the pressure field.
+	std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b)
+	{
+		return a.partition != b.partition ? a.partition < b.partition : a.offset < b.offset;
+	});
+	groups_.clear();
+	groups_.resize(partitions.size());
+	ids_.clear();
+	coordinates_.clear();
+	for (int c = 0; c < (int)entries.size(); c++)
+	{
+		const Entry& e = entries[c];
+		Group& group = groups_[e.partition];
+		if (group.offsets.empty())
+		{
+			group.partition = partitions[e.partition];
+			group.first = c;
+		}
+		group.offsets.push_back(e.offset);
+		ids_.push_back(e.point);
+		coordinates_.insert(coordinates_.end(), points_.begin() + 3 * e.point, points_.begin() + 3 * e.point + 3);
+	}
+	points_.clear();
+	points_.shrink_to_fit();
+
+	for (auto& group : groups_)
+	{
+		auto dct = std::dynamic_pointer_cast<DctPartition>(group.partition);
+		if (!dct || !dct->lazy_idct())
+		{
+			continue;
+		}
+		std::vector<int> local;
+		int w = dct->width_, h = dct->height_;
+		for (int32_t offset : group.offsets)
+			local.insert(local.end(), { offset % w, (offset / w) % h, offset / (w * h) });
+		group.evaluator = std::make_unique<ModeEvaluator>(w, h, dct->depth_, local);
+	}
+
+	fields_ = config_.fields;
+	chunk_.assign((size_t)chunk_steps_ * columns(), 0.0f);
+	transposed_.assign(chunk_.size(), 0.0f);
+	if (keep_)
+	{
+		int total_steps = config_.total_steps();
+		columns_.assign(columns(), std::vector<float>());
+		for (auto& column : columns_)
+			column.reserve(total_steps);
+	}
+	rows_ = 0;
+}
+
+bool ReceiverArray::Open(const std::string& path)
+{
+	file_ = fopen(path.c_str(), "wb");
+	if (!file_)
+	{
+		std::cout << "Cannot open " << path << " for the receivers." << std::endl;
+		return false;
+	}
+	file_buffer_.resize(8 << 20);
+	setvbuf(file_, file_buffer_.data(), _IOFBF, file_buffer_.size());
+
+	const char magic[8] = { 'A', 'R', 'D', 'R', 'C', 'V', 0, 1 };
+	int32_t header[5] = { 2, (int32_t)ids_.size(), chunk_steps_, (int32_t)config_.total_steps(), fields_ };
+	float constants[3] = { config_.dh, config_.dt, config_.c0 };
+	fwrite(magic, 1, sizeof(magic), file_);
+	fwrite(header, sizeof(int32_t), 5, file_);
+	fwrite(constants, sizeof(float), 3, file_);
+	for (size_t i = 0; i < ids_.size(); i++)
+	{
+		int32_t info[4] = { ids_[i], coordinates_[3 * i], coordinates_[3 * i + 1], coordinates_[3 * i + 2] };
+		fwrite(info, sizeof(int32_t), 4, file_);
+	}
+	return true;
+}
+
+void ReceiverArray::Gather(int partition)
+{
+	if (partition >= (int)groups_.size() || groups_[partition].offsets.empty())
+	{
+		return;
+	}
+	const Group& group = groups_[partition];
+	// Field f of every receiver is the column block f * size() .. (f + 1) * size() - 1.
+	for (int f = 0; f < fields_; f++)
+	{
+		float* row = &chunk_[(size_t)rows_ * columns() + (size_t)f * ids_.size() + group.first];
+		if (group.evaluator)
+		{
+			group.evaluator->Evaluate(static_cast<DctPartition*>(group.partition.get())->modes(f), row);
+			continue;
+		}
+		const real_t* field = group.partition->get_pressure_field() + (size_t)f * group.partition->field_stride_;
+		const int32_t* offsets = group.offsets.data();
+		int count = (int)group.offsets.size();
+		int i = 0;
+#if defined(__AVX2__)
+		for (; i + 8 <= count; i += 8)
+		{
+			__m256i index = _mm256_loadu_si256((const __m256i*)(offsets + i));
+			_mm256_storeu_ps(row + i, _mm256_i32gather_ps(field, index, 4));
+		}
+#endif
+		for (; i < count; i++)
+			row[i] = field[offsets[i]];
+	}
+}
+
+void ReceiverArray::EndStep(int time_step)
+{
+	if (ids_.empty())
+	{
+		return;
+	}
+	if (rows_ == 0)
+	{
+		first_step_ = time_step;
+	}
+	if (++rows_ == chunk_steps_)
+	{
+		Flush();
+	}
+}
+
+void ReceiverArray::Flush()
+{
+	if (rows_ == 0)
+	{
+		return;
+	}
+	TraceSpan span("receiver flush");
+	size_t n = columns();
+	// Step-major rows -> one column per receiver, in tiles to keep both sides in cache.
+	const size_t tile = 64;
+	for (size_t r0 = 0; r0 < (size_t)rows_; r0 += tile)
+		for (size_t c0 = 0; c0 < n; c0 += tile)
+			for (size_t r = r0; r < std::min(r0 + tile, (size_t)rows_); r++)
+				for (size_t c = c0; c < std::min(c0 + tile, n); c++)
+					transposed_[c * rows_ + r] = chunk_[r * n + c];
+
+	if (file_)
+	{
+		int32_t header[2] = { first_step_, rows_ };
+		fwrite(header, sizeof(int32_t), 2, file_);
+		fwrite(transposed_.data(), sizeof(float), n * rows_, file_);
+	}
+	if (keep_)
+	{
+		for (size_t c = 0; c < n; c++)
+			columns_[c].insert(columns_[c].end(), transposed_.begin() + c * rows_, transposed_.begin() + (c + 1) * rows_);
+	}
+	rows_ = 0;
+}
+
+void ReceiverArray::Close()
+{
+	Flush();
+	if (file_)
+	{
+		fclose(file_);
+		file_ = nullptr;
+	}
+}
+
+void ReceiverArray::Info()
+{
+	int partitions = 0, mode_space = 0;
+	for (auto& group : groups_)
+	{
+		partitions += !group.offsets.empty();
+		mode_space += group.evaluator ? group.evaluator->size() : 0;
+	}
+	std::cout << "# Receiver array. ##########################################" << std::endl;
+	std::cout << ids_.size() << " receivers in " << partitions << " partitions";
+	if (fields_ > 1)
+	{
+		std::cout << ", " << fields_ << " fields each";
+	}
+	if (dropped_)
+	{
+		std::cout << ", " << dropped_ << " outside the air partitions dropped";
+	}
+	std::cout << std::endl;
+	if (mode_space)
+	{
+		std::cout << mode_space << " evaluated from the modes (lazy IDCT)" << std::endl;
+	}
+	std::cout << "Chunks of " << chunk_steps_ << " steps (" << (double)chunk_.size() * sizeof(float) / (1 << 20) << " MB)" << std::endl;
+	std::cout << "############################################################" << std::endl;
+}
@@ -0,0 +1,97 @@
+#pragma once
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+#include "types.h"
+#include "simulation_config.h"
+
+class Partition;
+class ModeEvaluator;
+
+/* Dense receiver grids (parameter maps, acoustic probes): thousands of points, pressure only.
+ *
+ * Receivers are assigned to DCT partitions through a PartitionIndex (no scan over all partitions
+ * per point, no margin: any cell inside the partition works) and grouped by partition with their
+ * linear offsets into the pressure array. Simulation calls Gather() for each
+ * partition right after its update, while the field is still in cache: one indexed load per
+ * receiver (AVX2 gathers when available), no virtual call. Samples are stored step-major into a
+ * chunk of chunk_steps rows and transposed into per-receiver columns when the chunk is full,
+ * so the file gets one large contiguous write per chunk.
+ * Receivers in a DCT partition with a lazy IDCT are evaluated from its modes (ModeEvaluator) instead,
+ * so recording them does not force the pressure volume to be transformed (the boundaries still do).
+ *
+ * With batched sources (config.fields > 1) every receiver records every field.
+ *
+ * receivers.bin (native little-endian, 4-byte fields):
+ *   header:   "ARDRCV\0\1", version (2), num_receivers, chunk_steps, total_steps, num_fields, dh, dt, c0
+ *   receiver: id, x, y, z (cells)                      (num_receivers times)
+ *   chunks:   first_step, count, pressure[num_fields][num_receivers][count]
+ * matlab/read_receivers.m reads it back.
+ */
+class ReceiverArray
+{
+public:
+	ReceiverArray(const SimulationConfig& config, int chunk_steps = 1024, bool keep = false);
+	ReceiverArray(const ReceiverArray&) = delete;
+	ReceiverArray& operator=(const ReceiverArray&) = delete;
+	~ReceiverArray();
+
+	void Add(int x, int y, int z);		// cells
+	void ImportReceivers(std::string path);	// one point per line in metres, like the recorder files
+	void AddGrid(const std::vector<std::shared_ptr<Partition>>& partitions, real_t spacing);	// every spacing metres in air
+
+	// Assigns receivers to partitions (same vector, same order as given to the Simulation); drops points outside.
+	void Build(const std::vector<std::shared_ptr<Partition>>& partitions);
+	bool Open(const std::string& path);	// optional file output, after Build
+
+	void Gather(int partition);	// thread safe across partitions
+	void EndStep(int time_step);				// once per step, after every Gather
+	void Close();	// flushes the last partial chunk
+
+	size_t size() const
+	{
+		return ids_.size();
+	}
+	// Per-receiver pressure, only when constructed with keep = true.
+	const std::vector<float>& response(size_t i, int field = 0) const
+	{
+		return columns_[(size_t)field * ids_.size() + i];
+	}
+	void Info();
+
+private:
+	struct Group
+	{
+		std::shared_ptr<Partition> partition;
+		std::vector<int32_t> offsets;	// linear index into the partition's pressure array, ascending
+		int first{ 0 };					// the group's receivers are columns first .. first + offsets.size() - 1
+		std::unique_ptr<ModeEvaluator> evaluator;	// lazy IDCT partitions only
+	};
+
+	std::vector<int> points_;			// x, y, z triples before Build
+	std::vector<int> ids_;
+	std::vector<int> coordinates_;		// x, y, z per kept receiver
+	std::vector<Group> groups_;			// indexed by partition
+	int dropped_{ 0 };
+
+	SimulationConfig config_;
+	int chunk_steps_;
+	bool keep_;
+	int fields_{ 1 };
+	size_t columns() const
+	{
+		return ids_.size() * fields_;
+	}
+	int rows_{ 0 };
+	int first_step_{ 0 };
+	std::vector<float> chunk_;			// [row][receiver]
+	std::vector<float> transposed_;		// [receiver][row]
+	std::vector<std::vector<float>> columns_;
+
+	FILE* file_{ nullptr };
+	std::vector<char> file_buffer_;
+
+	void Flush();
+};
@@ -0,0 +1,178 @@
+#include "record_writer.h"
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+
+
+RecordWriter::RecordWriter(const std::string& path, const SimulationConfig& config, int samples_per_step, int encoding, int block_steps, int blocks_per_channel)
+	: path_(path)
+	, config_(config)
+	, samples_per_step_(samples_per_step)
+	, encoding_(encoding)
+	, block_steps_(block_steps)
+	, blocks_per_channel_(blocks_per_channel)
+{
+}
+
+RecordWriter::~RecordWriter()
+{
+	Close();
+}
+
+int RecordWriter::AddChannel(const ChannelInfo& info)
+{
+	auto channel = std::make_unique<Channel>(blocks_per_channel_);
+	channel->info = info;
+	for (int i = 0; i < blocks_per_channel_; i++)
+	{
+		auto block = std::make_unique<Block>();
+		block->response.resize(block_steps_);
+		block->field.resize((size_t)samples_per_step_ * block_steps_);
+		channel->empty.Push(block.get());
+		channel->storage.push_back(std::move(block));
+	}
+	channels_.push_back(std::move(channel));
+	return (int)channels_.size() - 1;
+}
+
+bool RecordWriter::Start()
+{
+	file_ = fopen(path_.c_str(), "wb");
+	if (!file_)
+	{
+		std::cout << "Cannot open " << path_ << " for recording." << std::endl;
+		return false;
+	}
+	// One large stdio buffer: the writer issues few, big write calls instead of one per sample.
+	file_buffer_.resize(8 << 20);
+	setvbuf(file_, file_buffer_.data(), _IOFBF, file_buffer_.size());
+
+	const char magic[8] = { 'A', 'R', 'D', 'R', 'E', 'C', 0, 1 };
+	int32_t header[5] = { 2, (int32_t)channels_.size(), block_steps_, samples_per_step_, encoding_ };
+	float constants[3] = { config_.dh, config_.dt, config_.c0 };
+	fwrite(magic, 1, sizeof(magic), file_);
+	fwrite(header, sizeof(int32_t), 5, file_);
+	fwrite(constants, sizeof(float), 3, file_);
+	for (auto& channel : channels_)
+	{
+		const ChannelInfo& c = channel->info;
+		int32_t info[11] = { c.id, c.total_steps, c.x, c.y, c.z, c.x_start, c.y_start, c.z_start, c.x_end, c.y_end, c.z_end };
+		fwrite(info, sizeof(int32_t), 11, file_);
+	}
+
+	running_ = true;
+	thread_ = std::thread(&RecordWriter::Run, this);
+	return true;
+}
+
+void RecordWriter::Push(int channel, int step, const real_t* field, real_t response)
+{
+	if (!running_)
+	{
+		return;		// never started (file could not be opened) or already closed
+	}
+	Channel& ch = *channels_[channel];
+	if (!ch.current)
+	{
+		while (!ch.empty.Pop(ch.current))
+		{
+			std::this_thread::yield();	// writer is behind, wait for a block to come back
+		}
+		ch.current->first_step = step;
+		ch.current->count = 0;
+	}
+	Block& block = *ch.current;
+	int s = block.count++;
+	block.response[s] = response;
+	for (int i = 0; i < samples_per_step_; i++)
+	{
+		block.field[(size_t)i * block_steps_ + s] = field[i];
+	}
+	if (block.count == block_steps_)
+	{
+		while (!ch.full.Push(ch.current))
+		{
+			std::this_thread::yield();
+		}
+		ch.current = nullptr;
+	}
+}
+
+void RecordWriter::Close()
+{
+	if (!running_)
+	{
+		return;
+	}
+	for (auto& channel : channels_)
+	{
+		if (channel->current && channel->current->count > 0)
+		{
+			while (!channel->full.Push(channel->current))
+			{
+				std::this_thread::yield();
+			}
+		}
+		channel->current = nullptr;
+	}
+	running_ = false;
+	thread_.join();
+	fclose(file_);
+	file_ = nullptr;
+	if (failed_)
+	{
+		std::cout << "Writing " << path_ << " failed, the recording is incomplete." << std::endl;
+	}
+}
+
+void RecordWriter::Run()
+{
+	for (;;)
+	{
+		// Read the flag before draining, so blocks pushed before Close() are always written.
+		bool stop = !running_;
+		bool idle = true;
+		for (int i = 0; i < (int)channels_.size(); i++)
+		{
+			Block* block;
+			while (channels_[i]->full.Pop(block))
+			{
+				if (!failed_ && !WriteBlock(i, *block))
+				{
+					failed_ = true;
+				}
+				channels_[i]->empty.Push(block);
+				idle = false;
+			}
+		}
+		if (stop)
+		{
+			break;
+		}
+		if (idle)
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+	}
+}
+
+bool RecordWriter::WriteBlock(int channel, const Block& block)
+{
+	int32_t header[3] = { channel, block.first_step, block.count };
+	bool ok = fwrite(header, sizeof(int32_t), 3, file_) == 3;
+	ok = ok && fwrite(block.response.data(), sizeof(float), block.count, file_) == (size_t)block.count;
+	if (block.count == block_steps_)
+	{
+		size_t n = block.field.size();
+		ok = ok && fwrite(block.field.data(), sizeof(float), n, file_) == n;
+	}
+	else
+	{
+		for (int i = 0; i < samples_per_step_ && ok; i++)
+		{
+			ok = fwrite(&block.field[(size_t)i * block_steps_], sizeof(float), block.count, file_) == (size_t)block.count;
+		}
+	}
+	return ok;
+}
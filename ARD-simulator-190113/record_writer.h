@@ -0,0 +1,86 @@
+#pragma once
+#include <atomic>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "types.h"
+#include "simulation_config.h"
+#include "spsc_queue.h"
+
+/* Binary recorder output, written by a background thread.
+ *
+ * Layout (native little-endian, all fields 4 bytes):
+ *   header:  "ARDREC\0\1", version (2), num_channels, block_steps, samples_per_step, encoding,
+ *            dh, dt, c0
+ *            encoding is a FieldEncoder::Encoding: 0 the raw pressure cube (edge cbrt(samples_per_step)),
+ *            1 pressure and velocity, 2 ambisonics (order sqrt(samples_per_step) - 1, ACN / SN3D)
+ *   channel: id, total_steps, x, y, z (cells), partition x_start, y_start, z_start, x_end, y_end, z_end
+ *            (repeated num_channels times)
+ *   blocks:  channel, first_step, count, response[count],
+ *            then field[samples_per_step][count] (one column per neighbourhood cell or channel)
+ * Blocks of different channels are interleaved in the order the writer drains them.
+ * matlab/read_record.m reads the file back.
+ *
+ * Each channel has its own SPSC queue pair (full blocks to the writer, empty ones back), so
+ * channels may be pushed from different threads, but one channel only from one thread.
+ */
+class RecordWriter
+{
+public:
+	struct ChannelInfo
+	{
+		int id;
+		int total_steps;
+		int x, y, z;
+		int x_start, y_start, z_start;
+		int x_end, y_end, z_end;
+	};
+
+	RecordWriter(const std::string& path, const SimulationConfig& config, int samples_per_step = 1000, int encoding = 0, int block_steps = 256, int blocks_per_channel = 4);
+	~RecordWriter();
+
+	int AddChannel(const ChannelInfo& info);	// before Start()
+	bool Start();
+	// field: samples_per_step values (cube ordered z, y, x, or the encoded channels).
+	void Push(int channel, int step, const real_t* field, real_t response);
+	void Close();	// flushes partial blocks, joins the writer and closes the file
+
+private:
+	struct Block
+	{
+		int first_step{ 0 };
+		int count{ 0 };
+		std::vector<float> response;
+		std::vector<float> field;	// field[cell * block_steps + step]
+	};
+
+	struct Channel
+	{
+		ChannelInfo info;
+		std::vector<std::unique_ptr<Block>> storage;
+		Block* current{ nullptr };
+		SpscQueue<Block*> full;
+		SpscQueue<Block*> empty;
+
+		explicit Channel(size_t blocks) : full(blocks), empty(blocks) {}
+	};
+
+	void Run();
+	bool WriteBlock(int channel, const Block& block);
+
+	std::string path_;
+	SimulationConfig config_;	// dh, dt and c0 for the header
+	int samples_per_step_;
+	int encoding_;
+	int block_steps_;
+	int blocks_per_channel_;
+
+	std::vector<std::unique_ptr<Channel>> channels_;
+	FILE* file_{ nullptr };
+	std::vector<char> file_buffer_;
+	std::thread thread_;
+	std::atomic<bool> running_{ false };
+	bool failed_{ false };
+};
@@ -1,19 +1,21 @@
 #include "recorder.h"
-#include "simulation.h"
+#include "tracer.h"
+#include "record_writer.h"
+#include "partition_index.h"
 #include <iostream>
 
 
-Recorder::Recorder(int x, int y, int z, int total_steps)
-	: x_(x), y_(y), z_(z), total_steps_(total_steps)
+Recorder::Recorder(const SimulationConfig& config, int x, int y, int z, int id, const std::string& output_dir)
+	: id_(id), x_(x), y_(y), z_(z), total_steps_(config.total_steps()), config_(config), output_dir_(output_dir)
 {
-	static int id_generator = 0;
-	id_ = id_generator++;
-	std::string filename;
-	std::string dir_name = std::to_string(Simulation::m_dh) + "_" + std::to_string(Partition::m_absorption);
-	filename = "./output/" + dir_name + "/out_" + std::to_string(id_) + ".txt";
-	output_.open(filename, std::ios::out);
-	filename = "./output/" + dir_name + "/response_" + std::to_string(id_) + ".txt";
-	response_.open(filename, std::ios::out);
+	response_samples_.reserve(total_steps_);
+}
+
+void Recorder::OpenText()
+{
+	text_opened_ = true;
+	output_.open(output_dir_ + "/out_" + std::to_string(id_) + ".txt", std::ios::out);
+	response_.open(output_dir_ + "/response_" + std::to_string(id_) + ".txt", std::ios::out);
 }
 
 
@@ -23,36 +25,96 @@ Recorder::~Recorder()
 	response_.close();
 }
 
-void Recorder::FindPartition(std::vector<std::shared_ptr<Partition>> partitions)
+void Recorder::FindPartition(const PartitionIndex& index)
 {
-	for (auto partition : partitions)
+	int i = index.Locate(x_, y_, z_);
+	if (i < 0)
 	{
-		if (partition->x_start_<x_ - 5 && partition->x_end_>x_ + 4 &&
-			partition->y_start_<y_ - 5 && partition->y_end_>y_ + 4 &&
-			partition->z_start_<z_ - 5 && partition->z_end_>z_ + 4)
-		{
-			part_ = partition;
-			break;
-		}
+		return;
+	}
+	auto partition = index.partition(i);
+	if (partition->x_start_<x_ - 5 && partition->x_end_>x_ + 4 &&
+		partition->y_start_<y_ - 5 && partition->y_end_>y_ + 4 &&
+		partition->z_start_<z_ - 5 && partition->z_end_>z_ + 4)
+	{
+		part_ = partition;
+		lx_ = x_ - partition->x_start_;
+		ly_ = y_ - partition->y_start_;
+		lz_ = z_ - partition->z_start_;
 	}
 }
 
 void Recorder::RecordField(int time_step)
 {
-	if (time_step < total_steps_)
+	if (time_step < total_steps_ && part_)	// nothing is recorded outside the partitions
 	{
+		TraceSpan span("record", id_);
+		if (metrics_)
+		{
+			metrics_->Push(part_->get_pressure(lx_, ly_, lz_, field_));
+			if (metrics_only_)
+			{
+				return;
+			}
+		}
+		if (encoder_)
+		{
+			encoder_->Encode(part_.get(), lx_, ly_, lz_, neighbourhood_.data(), field_);
+			real_t response = part_->get_pressure(lx_, ly_, lz_, field_);
+			response_samples_.push_back(response);
+			if (writer_)
+			{
+				writer_->Push(channel_, time_step, neighbourhood_.data(), response);
+				return;
+			}
+			if (!text_opened_)
+			{
+				OpenText();
+			}
+			for (real_t value : neighbourhood_)
+			{
+				output_ << value << " ";
+			}
+			output_ << std::endl;
+			response_ << response << std::endl;
+			return;
+		}
+		if (writer_)
+		{
+			int n = 0;
+			for (int i = -5; i < 5; i++)
+			{
+				for (int j = -5; j < 5; j++)
+				{
+					for (int k = -5; k < 5; k++)
+					{
+						neighbourhood_[n++] = part_->get_pressure(lx_ + k, ly_ + j, lz_ + i, field_);
+					}
+				}
+			}
+			real_t response = part_->get_pressure(lx_, ly_, lz_, field_);
+			response_samples_.push_back(response);
+			writer_->Push(channel_, time_step, neighbourhood_.data(), response);
+			return;
+		}
+		if (!text_opened_)
+		{
+			OpenText();
+		}
 		for (int i = -5; i < 5; i++)
 		{
 			for (int j = -5; j < 5; j++)
 			{
 				for (int k = -5; k < 5; k++)
 				{
-					output_ << part_->get_pressure(x_ + k, y_ + j, z_ + i) << " ";
+					output_ << part_->get_pressure(lx_ + k, ly_ + j, lz_ + i, field_) << " ";
 				}
 			}
 		}
 		output_ << std::endl;
-		response_ << part_->get_pressure(x_, y_, z_) << std::endl;
+		real_t response = part_->get_pressure(lx_, ly_, lz_, field_);
+		response_samples_.push_back(response);
+		response_ << response << std::endl;
 	}
 }
 
@@ -60,11 +122,50 @@ void Recorder::RecordResponse(int time_step)
 {
 	if (time_step <= total_steps_)
 	{
-		response_ << part_->get_pressure(x_, y_, z_) << std::endl;
+		if (!text_opened_)
+		{
+			OpenText();
+		}
+		response_ << part_->get_pressure(lx_, ly_, lz_, field_) << std::endl;
+	}
+}
+
+void Recorder::Attach(RecordWriter* writer)
+{
+	if (!part_)
+	{
+		return;		// not inside any partition, nothing will be recorded
 	}
+	RecordWriter::ChannelInfo info = { id_, total_steps_, x_, y_, z_,
+		part_->x_start_, part_->y_start_, part_->z_start_, part_->x_end_, part_->y_end_, part_->z_end_ };
+	writer_ = writer;
+	channel_ = writer->AddChannel(info);
+	neighbourhood_.resize(encoder_ ? encoder_->channels() : 10 * 10 * 10);
 }
 
-std::vector<std::shared_ptr<Recorder>> Recorder::ImportRecorders(std::string path)
+void Recorder::SetEncoding(FieldEncoder::Encoding encoding, int order)
+{
+	if (encoding == FieldEncoder::RAW_CUBE)
+	{
+		encoder_.reset();
+		return;
+	}
+	encoder_ = std::make_unique<FieldEncoder>(config_, encoding, order);
+	neighbourhood_.resize(encoder_->channels());
+}
+
+void Recorder::EnableMetrics(bool metrics_only)
+{
+	metrics_ = std::make_unique<RoomMetrics>(1.0f / config_.dt, config_.c0 / (2.3f * config_.dh));
+	metrics_only_ = metrics_only;
+	if (metrics_only_)
+	{
+		response_samples_.clear();
+		response_samples_.shrink_to_fit();
+	}
+}
+
+std::vector<std::shared_ptr<Recorder>> Recorder::ImportRecorders(const SimulationConfig& config, std::string path, const std::string& output_dir, int fields)
 {
 	std::vector<std::shared_ptr<Recorder>> recorders;
 
@@ -76,12 +177,15 @@ std::vector<std::shared_ptr<Recorder>> Recorder::ImportRecorders(std::string pat
 		file >> x >> y >> z;
 		if (file.eof()) break;
 
-		float const xh = x / Simulation::m_dh;
-		float const yh = y / Simulation::m_dh;
-		float const zh = z / Simulation::m_dh;
-		float const duration = Simulation::m_duration / Simulation::m_dt;
+		float const xh = x / config.dh;
+		float const yh = y / config.dh;
+		float const zh = z / config.dh;
 
-		recorders.push_back(std::make_shared<Recorder>((int)xh, (int)yh, (int)zh, (int)duration));
+		for (int field = 0; field < fields; field++)
+		{
+			recorders.push_back(std::make_shared<Recorder>(config, (int)xh, (int)yh, (int)zh, (int)recorders.size(), output_dir));
+			recorders.back()->field_ = field;
+		}
 	}
 	file.close();
 
@@ -4,27 +4,82 @@
 #include <memory>
 #include <fstream>
 #include "partition.h"
+#include "room_metrics.h"
+#include "field_encoder.h"
+
+class PartitionIndex;
+
+class RecordWriter;
 
 class Recorder
 {
 	int id_;
 	int x_, y_, z_;
+	int lx_{ 0 }, ly_{ 0 }, lz_{ 0 };	// inside part_, which get_pressure() indexes by
+	int field_{ 0 };					// which of the partition's fields it listens to (batched sources)
 	int total_steps_;
+	SimulationConfig config_;
+	std::string output_dir_;		// out_<id>.txt and response_<id>.txt, when no writer is attached
 
 	std::shared_ptr<Partition> part_;
 	
 	std::fstream output_;
 	std::fstream response_;
+	bool text_opened_{ false };		// opened on first use, so binary-only runs leave no empty files
+
+	RecordWriter* writer_{ nullptr };	// binary output instead of the text files when attached
+	int channel_{ -1 };
+	std::vector<real_t> neighbourhood_;
+	std::unique_ptr<FieldEncoder> encoder_;	// null: the raw 10x10x10 neighbourhood
+	std::vector<real_t> response_samples_;	// pressure at the recorder, one per recorded step
+
+	std::unique_ptr<RoomMetrics> metrics_;
+	bool metrics_only_{ false };		// feed the metrics, skip field and response storage
+
+	void OpenText();
 
 public:
-	Recorder(int x, int y, int z, int total_steps = 1000);
+	Recorder(const SimulationConfig& config, int x, int y, int z, int id, const std::string& output_dir);	// records config.total_steps() steps
 	~Recorder();
 
-	void FindPartition(std::vector<std::shared_ptr<Partition>> partitions);
+	void FindPartition(const PartitionIndex& index);	// at least 5 cells inside a partition
 	void RecordField(int time_step = 0);
 	void RecordResponse(int time_step = 0);
+	void Attach(RecordWriter* writer);	// after FindPartition, before the writer is started
+	void SetEncoding(FieldEncoder::Encoding encoding, int order = 1);	// before Attach
+	void EnableMetrics(bool metrics_only = false);
+
+	int id() const
+	{
+		return id_;
+	}
+	const SimulationConfig& config() const
+	{
+		return config_;
+	}
+	const std::vector<real_t>& response() const
+	{
+		return response_samples_;
+	}
+	const RoomMetrics* metrics() const
+	{
+		return metrics_.get();
+	}
+	real_t pressure()	// current pressure at the recorder, 0 outside the partitions
+	{
+		return part_ ? part_->get_pressure(lx_, ly_, lz_, field_) : 0.0f;
+	}
+	int field() const
+	{
+		return field_;
+	}
+	bool found() const	// inside a partition, after FindPartition
+	{
+		return part_ != nullptr;
+	}
 
-	static std::vector<std::shared_ptr<Recorder>> ImportRecorders(std::string path);
+	// Positions in metres. fields > 1: one recorder per field at every point, point-major (ids point * fields + field).
+	static std::vector<std::shared_ptr<Recorder>> ImportRecorders(const SimulationConfig& config, std::string path, const std::string& output_dir, int fields = 1);
 
 };
 
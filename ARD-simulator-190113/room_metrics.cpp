@@ -0,0 +1,228 @@
+#define _USE_MATH_DEFINES
+#include <cmath>
+#include "room_metrics.h"
+#include "recorder.h"
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <limits>
+
+
+RoomMetrics::RoomMetrics(real_t sample_rate, real_t band_limit, real_t block_seconds)
+	: sample_rate_(sample_rate)
+	, band_limit_(band_limit)
+{
+	block_ = std::max(1, (int)std::lround(block_seconds * sample_rate));
+
+	// Octave bands whose upper edge stays clear of Nyquist: 63 Hz .. 2 kHz at 8 kHz.
+	const real_t octaves[] = { 63.0f, 125.0f, 250.0f, 500.0f, 1000.0f, 2000.0f, 4000.0f, 8000.0f };
+	for (real_t centre : octaves)
+	{
+		if (centre * (real_t)M_SQRT2 > 0.45f * sample_rate_)
+		{
+			break;
+		}
+		centres_.push_back(centre);
+		Biquad hp = Design(centre / (real_t)M_SQRT2, sample_rate_, true);
+		Biquad lp = Design(centre * (real_t)M_SQRT2, sample_rate_, false);
+		filters_.insert(filters_.end(), { hp, hp, lp, lp });
+	}
+	energy_.assign(centres_.size() + 1, 0.0);
+	cumulative_.resize(centres_.size() + 1);
+}
+
+// Butterworth (Q = 1/sqrt 2) section from the RBJ cookbook; two in a row give 24 dB/octave skirts.
+RoomMetrics::Biquad RoomMetrics::Design(real_t frequency, real_t sample_rate, bool highpass)
+{
+	double w0 = 2.0 * M_PI * frequency / sample_rate;
+	double c = cos(w0);
+	double alpha = sin(w0) / (2.0 * M_SQRT1_2);
+	double a0 = 1.0 + alpha;
+	Biquad q;
+	q.b0 = (highpass ? (1.0 + c) : (1.0 - c)) / 2.0 / a0;
+	q.b1 = (highpass ? -(1.0 + c) : (1.0 - c)) / a0;
+	q.b2 = q.b0;
+	q.a1 = -2.0 * c / a0;
+	q.a2 = (1.0 - alpha) / a0;
+	return q;
+}
+
+void RoomMetrics::Push(real_t pressure)
+{
+	double x = pressure;
+	energy_[0] += x * x;
+	if (block_peak_.size() == cumulative_[0].size())
+	{
+		block_peak_.push_back(0.0);
+	}
+	block_peak_.back() = std::max(block_peak_.back(), x * x);
+
+	for (size_t b = 0; b < centres_.size(); b++)
+	{
+		double y = x;
+		for (int s = 0; s < 4; s++)
+			y = filters_[b * 4 + s].Process(y);
+		energy_[b + 1] += y * y;
+	}
+
+	if (++in_block_ == block_)
+	{
+		EndBlock();
+	}
+}
+
+void RoomMetrics::EndBlock()
+{
+	for (size_t b = 0; b < energy_.size(); b++)
+	{
+		double previous = cumulative_[b].empty() ? 0.0 : cumulative_[b].back();
+		cumulative_[b].push_back(previous + energy_[b]);
+	}
+	last_block_energy_ = energy_[0];
+	peak_block_energy_ = std::max(peak_block_energy_, energy_[0]);
+	std::fill(energy_.begin(), energy_.end(), 0.0);
+	in_block_ = 0;
+}
+
+real_t RoomMetrics::level_db() const
+{
+	if (peak_block_energy_ <= 0.0)
+	{
+		return 0.0f;
+	}
+	return (real_t)(10.0 * log10(std::max(last_block_energy_, 1e-300) / peak_block_energy_));
+}
+
+// Least-squares slope of the Schroeder curve between two levels (dB below the onset), as a -60 dB time.
+static real_t DecayTime(const std::vector<double>& curve, real_t block_seconds, real_t upper, real_t lower)
+{
+	double sx = 0, sy = 0, sxx = 0, sxy = 0;
+	int n = 0;
+	bool reached = false;
+	for (size_t i = 0; i < curve.size(); i++)
+	{
+		if (curve[i] > upper)
+		{
+			continue;
+		}
+		if (curve[i] < lower)
+		{
+			reached = true;
+			break;
+		}
+		double x = i * block_seconds;
+		sx += x;
+		sy += curve[i];
+		sxx += x * x;
+		sxy += x * curve[i];
+		n++;
+	}
+	double denominator = n * sxx - sx * sx;
+	if (!reached || n < 2 || denominator <= 0.0)
+	{
+		return std::numeric_limits<real_t>::quiet_NaN();
+	}
+	double slope = (n * sxy - sx * sy) / denominator;
+	return slope < 0.0 ? (real_t)(-60.0 / slope) : std::numeric_limits<real_t>::quiet_NaN();
+}
+
+RoomMetrics::Band RoomMetrics::Fit(int band, int onset) const
+{
+	const real_t nan = std::numeric_limits<real_t>::quiet_NaN();
+	const std::vector<double>& cumulative = cumulative_[band];
+	real_t block_seconds = block_ / sample_rate_;
+	real_t fmax = band_limit_;
+
+	Band result = { band ? centres_[band - 1] : 0.0f, band ? centres_[band - 1] * (real_t)M_SQRT2 <= fmax : true,
+		nan, nan, nan, nan, nan, nan, nan };
+	int blocks = (int)cumulative.size();
+	if (onset < 0 || onset >= blocks)
+	{
+		return result;
+	}
+	double before = onset ? cumulative[onset - 1] : 0.0;
+	double total = cumulative.back() - before;
+	double broadband = cumulative_[0].back() - (onset ? cumulative_[0][onset - 1] : 0.0);
+	if (total <= 0.0)
+	{
+		return result;
+	}
+	result.level = (real_t)(10.0 * log10(total / broadband));
+
+	// Schroeder backward integral from the onset, in dB: 10 log10((total - energy before block i) / total).
+	std::vector<double> curve(blocks - onset);
+	for (int i = onset; i < blocks; i++)
+	{
+		double remaining = cumulative.back() - (i ? cumulative[i - 1] : 0.0);
+		curve[i - onset] = 10.0 * log10(std::max(remaining / total, 1e-30));
+	}
+	result.edt = DecayTime(curve, block_seconds, 0.0f, -10.0f);
+	result.t20 = DecayTime(curve, block_seconds, -5.0f, -25.0f);
+	result.t30 = DecayTime(curve, block_seconds, -5.0f, -35.0f);
+
+	auto early = [&](real_t seconds)
+	{
+		int end = std::min(blocks, onset + (int)std::lround(seconds / block_seconds));
+		return cumulative[end - 1] - before;
+	};
+	double e50 = early(0.05f);
+	double e80 = early(0.08f);
+	result.d50 = (real_t)(e50 / total);
+	result.c50 = total > e50 ? (real_t)(10.0 * log10(e50 / (total - e50))) : nan;
+	result.c80 = total > e80 ? (real_t)(10.0 * log10(e80 / (total - e80))) : nan;
+	return result;
+}
+
+std::vector<RoomMetrics::Band> RoomMetrics::Analyse() const
+{
+	// Onset: the first block whose peak is within 20 dB of the overall peak (ISO 3382-1, A.3.4).
+	int onset = -1;
+	double peak = block_peak_.empty() ? 0.0 : *std::max_element(block_peak_.begin(), block_peak_.end());
+	int complete = (int)cumulative_[0].size();	// a trailing partial block is ignored
+	for (int i = 0; i < complete && peak > 0.0; i++)
+	{
+		if (block_peak_[i] >= 0.01 * peak)
+		{
+			onset = i;
+			break;
+		}
+	}
+
+	std::vector<Band> bands;
+	for (int b = 0; b < (int)energy_.size(); b++)
+		bands.push_back(Fit(b, onset));
+	return bands;
+}
+
+void RoomMetrics::ExportRecorders(const std::vector<std::shared_ptr<Recorder>>& recorders, const std::string& dir)
+{
+	std::ofstream file(dir + "/metrics.csv");
+	file << "recorder,band,valid,level_db,edt,t20,t30,c50,c80,d50" << std::endl;
+
+	std::cout << "# Room acoustics (broadband). ##############################" << std::endl;
+	std::cout << std::setw(9) << "recorder" << std::setw(9) << "EDT" << std::setw(9) << "T20" << std::setw(9) << "T30"
+		<< std::setw(9) << "C50" << std::setw(9) << "C80" << std::setw(9) << "D50" << std::endl;
+	std::cout << std::fixed << std::setprecision(2);
+	for (auto& recorder : recorders)
+	{
+		const RoomMetrics* metrics = recorder->metrics();
+		if (!metrics)
+		{
+			continue;
+		}
+		auto bands = metrics->Analyse();
+		for (auto& band : bands)
+		{
+			file << recorder->id() << "," << band.centre << "," << band.valid << "," << band.level << "," << band.edt << ","
+				<< band.t20 << "," << band.t30 << "," << band.c50 << "," << band.c80 << "," << band.d50 << std::endl;
+		}
+		const Band& b = bands[0];
+		std::cout << std::setw(9) << recorder->id() << std::setw(9) << b.edt << std::setw(9) << b.t20 << std::setw(9) << b.t30
+			<< std::setw(9) << b.c50 << std::setw(9) << b.c80 << std::setw(9) << b.d50 << std::endl;
+	}
+	std::cout.unsetf(std::ios::fixed);
+	std::cout << std::setprecision(6);
+	std::cout << "Per octave band: " << dir << "/metrics.csv" << std::endl;
+	std::cout << "############################################################" << std::endl;
+}
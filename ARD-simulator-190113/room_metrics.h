@@ -0,0 +1,76 @@
+#pragma once
+#include <memory>
+#include <string>
+#include <vector>
+#include "types.h"
+
+class Recorder;
+
+/* Room-acoustic parameters (ISO 3382) computed while the simulation runs, the streaming version of matlab/t60.m.
+ *
+ * Every pushed sample goes through an octave filter bank (cascaded RBJ biquads, 4th-order high-pass
+ * and low-pass per band) and its energy is accumulated per block of about 1 ms, broadband and per band.
+ * Only these cumulative block energies are kept, so the Schroeder backward integral at any block is
+ * total - cumulative and no response has to be stored. Analyse() fits the decay curve for EDT
+ * (0..-10 dB), T20 (-5..-25 dB) and T30 (-5..-35 dB) and sums C50, C80 and D50 from the onset, the
+ * first block within 20 dB of the broadband peak. Values the decay does not reach are NaN.
+ */
+class RoomMetrics
+{
+public:
+	struct Band
+	{
+		real_t centre;		// Hz, 0 for broadband
+		bool valid;			// upper band edge below the grid's bandwidth c0 / (2.3 dh)
+		real_t level;		// dB relative to the broadband energy
+		real_t edt, t20, t30;	// s
+		real_t c50, c80;	// dB
+		real_t d50;			// 0..1
+	};
+
+	// band_limit: the grid's bandwidth c0 / (2.3 dh), bands above it are marked invalid.
+	RoomMetrics(real_t sample_rate, real_t band_limit, real_t block_seconds = 1e-3f);
+
+	void Push(real_t pressure);
+
+	// Latest block energy relative to the loudest block so far (dB, <= 0): cheap enough to poll every step.
+	real_t level_db() const;
+
+	// Broadband first, then the octave bands.
+	std::vector<Band> Analyse() const;
+
+	// Writes <dir>/metrics.csv (one row per recorder and band) and prints the broadband values.
+	static void ExportRecorders(const std::vector<std::shared_ptr<Recorder>>& recorders, const std::string& dir);
+
+private:
+	struct Biquad
+	{
+		double b0, b1, b2, a1, a2;
+		double z1{ 0.0 }, z2{ 0.0 };
+
+		double Process(double x)
+		{
+			double y = b0 * x + z1;
+			z1 = b1 * x - a1 * y + z2;
+			z2 = b2 * x - a2 * y;
+			return y;
+		}
+	};
+	static Biquad Design(real_t frequency, real_t sample_rate, bool highpass);
+
+	real_t sample_rate_;
+	real_t band_limit_;
+	int block_;						// samples per energy block
+	int in_block_{ 0 };
+
+	std::vector<real_t> centres_;
+	std::vector<Biquad> filters_;	// 4 per band
+	std::vector<double> energy_;	// per band (0: broadband), energy of the current block
+	std::vector<std::vector<double>> cumulative_;	// per band, cumulative energy at the end of every block
+	std::vector<double> block_peak_;	// broadband max squared sample per block, for the onset
+	double peak_block_energy_{ 0.0 };
+	double last_block_energy_{ 0.0 };
+
+	void EndBlock();
+	Band Fit(int band, int onset) const;
+};
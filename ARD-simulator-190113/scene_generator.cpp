@@ -0,0 +1,112 @@
+#include "scene_generator.h"
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+
+
+std::vector<SceneGenerator::Box> SceneGenerator::Corridor(int num_rooms, int room_w, int room_h, int corridor_w, int height, int door)
+{
+	std::vector<Box> boxes;
+	int pitch = room_w + 1;		// room plus wall
+	boxes.push_back({ 0, 0, 0, num_rooms * pitch - 1, corridor_w, height });
+	for (int i = 0; i < num_rooms; i++)
+	{
+		int x = i * pitch;
+		boxes.push_back({ x, corridor_w + 1, 0, room_w, room_h, height });
+		boxes.push_back({ x + (room_w - door) / 2, corridor_w, 0, door, 1, height });
+	}
+	return boxes;
+}
+
+std::vector<SceneGenerator::Box> SceneGenerator::RoomGrid(int n, int m, int room_w, int room_h, int height, int door)
+{
+	std::vector<Box> boxes;
+	int pitch_x = room_w + 1;
+	int pitch_y = room_h + 1;
+	for (int j = 0; j < m; j++)
+	{
+		for (int i = 0; i < n; i++)
+		{
+			int x = i * pitch_x;
+			int y = j * pitch_y;
+			boxes.push_back({ x, y, 0, room_w, room_h, height });
+			if (i + 1 < n)
+			{
+				boxes.push_back({ x + room_w, y + (room_h - door) / 2, 0, 1, door, height });
+			}
+			if (j + 1 < m)
+			{
+				boxes.push_back({ x + (room_w - door) / 2, y + room_h, 0, door, 1, height });
+			}
+		}
+	}
+	return boxes;
+}
+
+std::vector<SceneGenerator::Box> SceneGenerator::Hall(int area, float aspect, int height)
+{
+	int w = std::max(1, (int)std::lround(std::sqrt(area / aspect)));
+	int l = std::max(1, (int)std::lround((float)area / w));
+	return { { 0, 0, 0, l, w, height } };
+}
+
+std::vector<SceneGenerator::Box> SceneGenerator::Build(const std::string& kind, int scale)
+{
+	scale = std::max(1, scale);
+	if (kind == "corridor")
+		return Corridor(4 * scale, 4, 4, 2, 3);
+	if (kind == "grid")
+		return RoomGrid(2 * scale, 2, 4, 4, 3);
+	if (kind == "hall")
+		return Hall(80 * scale, 1.0f, 4);
+	if (kind == "long-hall")
+		return Hall(80 * scale, 4.0f, 4);
+	std::cout << "Unknown scene kind " << kind << std::endl;
+	return {};
+}
+
+bool SceneGenerator::Write(const std::string& path, const std::vector<Box>& boxes)
+{
+	std::ofstream file(path);
+	if (!file.is_open())
+	{
+		std::cout << "Cannot write " << path << std::endl;
+		return false;
+	}
+	for (auto& b : boxes)
+	{
+		file << b.x << " " << b.y << " " << b.z << " " << b.w << " " << b.h << " " << b.d << std::endl;
+	}
+	file << std::endl;		// the importers expect a trailing blank line
+	return true;
+}
+
+std::vector<SceneGenerator::Box> SceneGenerator::Read(const std::string& path)
+{
+	std::vector<Box> boxes;
+	std::ifstream file(path);
+	while (file.good())
+	{
+		Box b;
+		file >> b.x >> b.y >> b.z >> b.w >> b.h >> b.d;
+		if (file.eof()) break;
+		boxes.push_back(b);
+	}
+	return boxes;
+}
+
+bool SceneGenerator::WriteSource(const std::string& path, const std::vector<Box>& boxes)
+{
+	if (boxes.empty()) return false;
+	std::ofstream file(path);
+	if (!file.is_open())
+	{
+		std::cout << "Cannot write " << path << std::endl;
+		return false;
+	}
+	auto& b = boxes[0];
+	file << b.x + b.w / 2 << " " << b.y + b.h / 2 << " " << b.z + b.d / 2 << std::endl;
+	file << std::endl;
+	return true;
+}
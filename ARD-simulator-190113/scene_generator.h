@@ -0,0 +1,37 @@
+#pragma once
+#include <vector>
+#include <string>
+
+/* Procedural multi-room scenes in the Partition::ImportPartitions format.
+ *
+ * All values are in meters (integers, as the importer reads them), z is always 0 and every
+ * partition has the same depth (2.5D, see README). Rooms are separated by 1 m walls, which are
+ * simply left empty; doors are 1 m thick partitions touching the two rooms they connect, so
+ * Boundary::FindBoundary finds an interface on each side and the walls get PML.
+ */
+class SceneGenerator
+{
+public:
+	struct Box
+	{
+		int x, y, z;
+		int w, h, d;
+	};
+
+	// A corridor along x with num_rooms rooms on one side, each connected by a door.
+	static std::vector<Box> Corridor(int num_rooms, int room_w, int room_h, int corridor_w, int height, int door = 1);
+	// n x m rooms; neighbouring rooms are connected by a door in the middle of the shared wall.
+	static std::vector<Box> RoomGrid(int n, int m, int room_w, int room_h, int height, int door = 1);
+	// A single hall of roughly the given floor area, aspect = length / width.
+	static std::vector<Box> Hall(int area, float aspect, int height);
+
+	// Built-in scenes used by the scaling benchmark, the floor area grows linearly with scale.
+	// kind: "corridor", "grid", "hall", "long-hall".
+	static std::vector<Box> Build(const std::string& kind, int scale);
+
+	static bool Write(const std::string& path, const std::vector<Box>& boxes);
+	// Parses a partition file once, so several simulations can be built from it (ParameterSweep).
+	static std::vector<Box> Read(const std::string& path);
+	// One source in the middle of the first box (meters, rounded down).
+	static bool WriteSource(const std::string& path, const std::vector<Box>& boxes);
+};
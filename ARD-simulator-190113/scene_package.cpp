@@ -0,0 +1,377 @@
+#include "scene_package.h"
+#include "partition.h"
+#include "dct_partition.h"
+#include "pml_partition.h"
+#include "boundary.h"
+#include "simulation.h"
+#include "sound_source.h"
+#include "convolver.h"
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <tuple>
+#include <omp.h>
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static_assert(sizeof(ScenePackage::PartitionRecord) == 32, "package partition record");
+static_assert(sizeof(ScenePackage::PmlRecord) == 32, "package PML record");
+static_assert(sizeof(ScenePackage::BoundaryRecord) == 40, "package boundary record");
+
+static const char kMagic[8] = { 'A', 'R', 'D', 'P', 'K', 'G', 0, 1 };
+static const int kHeaderBytes = 96;
+
+struct TableRecord
+{
+	int32_t width, height, depth, reserved;
+	int64_t offset;
+};
+static_assert(sizeof(TableRecord) == 24, "package table record");
+
+struct ScenePackage::Mapping
+{
+#ifdef _WIN32
+	HANDLE file{ INVALID_HANDLE_VALUE };
+	HANDLE mapping{ NULL };
+#endif
+	const uint8_t* data{ nullptr };
+	size_t size{ 0 };
+
+	~Mapping()
+	{
+#ifdef _WIN32
+		if (data) UnmapViewOfFile(data);
+		if (mapping) CloseHandle(mapping);
+		if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+#else
+		if (data) munmap((void*)data, size);
+#endif
+	}
+};
+
+static int64_t Align(int64_t n, int64_t to)
+{
+	return (n + to - 1) / to * to;
+}
+
+// FNV-1a of the scene file, 0 if it cannot be read.
+static uint64_t HashFile(const std::string& path)
+{
+	std::ifstream file(path, std::ios::binary);
+	if (!file)
+	{
+		return 0;
+	}
+	uint64_t hash = 14695981039346656037ull;
+	for (std::istreambuf_iterator<char> it(file), end; it != end; ++it)
+	{
+		hash = (hash ^ (uint8_t)*it) * 1099511628211ull;
+	}
+	return hash;
+}
+
+ScenePackage::ScenePackage()
+{
+}
+
+ScenePackage::~ScenePackage()
+{
+	Close();
+}
+
+bool ScenePackage::Matches(const SimulationConfig& a, const SimulationConfig& b)
+{
+	return a.dh == b.dh && a.dt == b.dt && a.c0 == b.c0 && a.pml_layers == b.pml_layers;
+}
+
+bool ScenePackage::Compile(const SimulationConfig& config, const std::string& scene_path, const std::string& path)
+{
+	double start = omp_get_wtime();
+	uint64_t scene_hash = HashFile(scene_path);
+	auto partitions = Partition::ImportPartitions(config, scene_path, nullptr);	// plans (and so wisdom) as a CPU run makes them
+	if (partitions.empty() || scene_hash == 0)
+	{
+		std::cout << "No partitions in " << scene_path << std::endl;
+		return false;
+	}
+	std::vector<std::shared_ptr<SoundSource>> no_sources;
+	Simulation simulation(config, partitions, no_sources);
+
+	// One table per partition size.
+	std::map<std::tuple<int, int, int>, int> table_index;
+	std::vector<const DctPartition*> table_owners;
+	std::vector<PartitionRecord> records;
+	for (auto& p : partitions)
+	{
+		auto key = std::make_tuple(p->width_, p->height_, p->depth_);
+		if (!table_index.count(key))
+		{
+			table_index[key] = (int)table_owners.size();
+			table_owners.push_back(static_cast<const DctPartition*>(p.get()));
+		}
+		records.push_back({ p->x_start_, p->y_start_, p->z_start_, p->width_, p->height_, p->depth_, table_index[key], 0 });
+	}
+	std::vector<PmlRecord> pmls;
+	for (size_t i = partitions.size(); i < simulation.m_partitions.size(); i++)
+	{
+		auto pml = std::static_pointer_cast<PmlPartition>(simulation.m_partitions[i]);
+		pmls.push_back({ pml->neighbor_part_->info_.id, (int32_t)pml->type_,
+			pml->x_start_, pml->y_start_, pml->z_start_, pml->width_, pml->height_, pml->depth_ });
+	}
+	std::vector<BoundaryRecord> boundaries;
+	for (auto& b : simulation.m_boundaries)
+	{
+		boundaries.push_back({ (int32_t)b->type_, b->a_->info_.id, b->b_->info_.id,
+			b->x_start_, b->x_end_, b->y_start_, b->y_end_, b->z_start_, b->z_end_, 0 });
+	}
+
+	std::string wisdom;
+	{
+		std::lock_guard<std::mutex> lock(PartitionedConvolver::PlanMutex());
+		char* exported = fftwf_export_wisdom_to_string();
+		if (exported)
+		{
+			wisdom = exported;
+			fftwf_free(exported);
+		}
+	}
+
+	int64_t table_offset = kHeaderBytes + (int64_t)sizeof(PartitionRecord) * records.size()
+		+ (int64_t)sizeof(PmlRecord) * pmls.size() + (int64_t)sizeof(BoundaryRecord) * boundaries.size();
+	std::vector<TableRecord> tables;
+	int64_t offset = Align(table_offset + (int64_t)sizeof(TableRecord) * table_owners.size(), 64);
+	for (auto p : table_owners)
+	{
+		tables.push_back({ p->width_, p->height_, p->depth_, 0, offset });
+		offset = Align(offset + 2 * (int64_t)p->width_ * p->height_ * p->depth_ * sizeof(real_t), 64);
+	}
+	int64_t wisdom_offset = offset;
+	int64_t wisdom_bytes = (int64_t)wisdom.size() + 1;
+	int64_t file_bytes = wisdom_offset + wisdom_bytes;
+
+	// Written aside and renamed over the old package, so a concurrent Open() never maps half a file.
+	std::string temp_path = path + ".tmp";
+	FILE* file = fopen(temp_path.c_str(), "wb");
+	if (!file)
+	{
+		std::cout << "Cannot write " << temp_path << std::endl;
+		return false;
+	}
+	int32_t header[6] = { 1, (int32_t)records.size(), (int32_t)pmls.size(), (int32_t)boundaries.size(),
+		(int32_t)tables.size(), config.pml_layers };
+	float constants[4] = { config.dh, config.dt, config.c0, 0.0f };
+	int64_t sizes[5] = { table_offset, wisdom_offset, wisdom_bytes, file_bytes, 0 };
+	fwrite(kMagic, 1, sizeof(kMagic), file);
+	fwrite(header, sizeof(int32_t), 6, file);
+	fwrite(constants, sizeof(float), 4, file);
+	fwrite(&scene_hash, sizeof(uint64_t), 1, file);
+	fwrite(sizes, sizeof(int64_t), 5, file);
+	fwrite(records.data(), sizeof(PartitionRecord), records.size(), file);
+	fwrite(pmls.data(), sizeof(PmlRecord), pmls.size(), file);
+	fwrite(boundaries.data(), sizeof(BoundaryRecord), boundaries.size(), file);
+	fwrite(tables.data(), sizeof(TableRecord), tables.size(), file);
+	int64_t position = table_offset + (int64_t)sizeof(TableRecord) * tables.size();
+	std::vector<char> padding(64, 0);
+	for (size_t t = 0; t < tables.size(); t++)
+	{
+		fwrite(padding.data(), 1, (size_t)(tables[t].offset - position), file);
+		size_t cells = (size_t)tables[t].width * tables[t].height * tables[t].depth;
+		fwrite(table_owners[t]->cwt_, sizeof(real_t), cells, file);
+		fwrite(table_owners[t]->w2_, sizeof(real_t), cells, file);
+		position = tables[t].offset + 2 * (int64_t)cells * sizeof(real_t);
+	}
+	fwrite(padding.data(), 1, (size_t)(wisdom_offset - position), file);
+	fwrite(wisdom.c_str(), 1, (size_t)wisdom_bytes, file);
+	bool ok = !ferror(file);
+	ok = fclose(file) == 0 && ok;
+#ifdef _WIN32
+	ok = ok && MoveFileExA(temp_path.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING);
+#else
+	ok = ok && rename(temp_path.c_str(), path.c_str()) == 0;
+#endif
+	if (!ok)
+	{
+		std::cout << "Cannot write " << path << std::endl;
+		remove(temp_path.c_str());
+		return false;
+	}
+
+	std::cout << "# Scene package. ###########################################" << std::endl;
+	std::cout << path << ": " << records.size() << " partitions, " << pmls.size() << " PML partitions, "
+		<< boundaries.size() << " boundaries, " << tables.size() << " coefficient tables, " << file_bytes << " bytes" << std::endl;
+	std::cout << "Compiled in " << omp_get_wtime() - start << " s" << std::endl;
+	std::cout << "############################################################" << std::endl;
+	return true;
+}
+
+bool ScenePackage::Open(const std::string& path, const SimulationConfig& config, const std::string& scene_path)
+{
+	Close();
+	auto mapping = std::make_shared<Mapping>();
+#ifdef _WIN32
+	HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, 0, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		std::cout << "Cannot open " << path << std::endl;
+		return false;
+	}
+	LARGE_INTEGER size;
+	GetFileSizeEx(file, &size);
+	mapping->file = file;
+	mapping->mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	mapping->data = mapping->mapping ? (const uint8_t*)MapViewOfFile(mapping->mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+	mapping->size = (size_t)size.QuadPart;
+#else
+	int fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+	{
+		std::cout << "Cannot open " << path << std::endl;
+		return false;
+	}
+	struct stat st;
+	fstat(fd, &st);
+	void* view = st.st_size > 0 ? mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+	close(fd);	// the mapping keeps the file alive
+	if (view != MAP_FAILED)
+	{
+		mapping->data = (const uint8_t*)view;
+		mapping->size = (size_t)st.st_size;
+	}
+#endif
+	const uint8_t* map = mapping->data;
+	if (!map || mapping->size < kHeaderBytes || memcmp(map, kMagic, sizeof(kMagic)))
+	{
+		std::cout << path << " is not a scene package." << std::endl;
+		return false;
+	}
+
+	int32_t header[6];
+	float constants[4];
+	uint64_t scene_hash;
+	int64_t sizes[5];
+	memcpy(header, map + 8, sizeof(header));
+	memcpy(constants, map + 32, sizeof(constants));
+	memcpy(&scene_hash, map + 48, sizeof(scene_hash));
+	memcpy(sizes, map + 56, sizeof(sizes));
+	int64_t table_offset = sizes[0], wisdom_offset = sizes[1], wisdom_bytes = sizes[2];
+	int64_t records_end = kHeaderBytes + (int64_t)sizeof(PartitionRecord) * header[1]
+		+ (int64_t)sizeof(PmlRecord) * header[2] + (int64_t)sizeof(BoundaryRecord) * header[3];
+	if (header[0] != 1 || header[1] < 0 || header[2] < 0 || header[3] < 0 || header[4] < 0 || sizes[3] != (int64_t)mapping->size
+		|| table_offset != records_end || table_offset + (int64_t)sizeof(TableRecord) * header[4] > wisdom_offset
+		|| wisdom_bytes < 1 || wisdom_offset + wisdom_bytes != sizes[3] || map[sizes[3] - 1] != 0)
+	{
+		std::cout << path << ": unsupported or damaged scene package." << std::endl;
+		return false;
+	}
+	SimulationConfig built = config;
+	built.dh = constants[0];
+	built.dt = constants[1];
+	built.c0 = constants[2];
+	built.pml_layers = header[5];
+	if (!Matches(built, config) || (!scene_path.empty() && HashFile(scene_path) != scene_hash))
+	{
+		std::cout << path << " was compiled for another scene or grid." << std::endl;
+		return false;
+	}
+
+	const uint8_t* cursor = map + kHeaderBytes;
+	partitions_.resize(header[1]);
+	pmls_.resize(header[2]);
+	boundaries_.resize(header[3]);
+	memcpy(partitions_.data(), cursor, sizeof(PartitionRecord) * partitions_.size());
+	cursor += sizeof(PartitionRecord) * partitions_.size();
+	memcpy(pmls_.data(), cursor, sizeof(PmlRecord) * pmls_.size());
+	cursor += sizeof(PmlRecord) * pmls_.size();
+	memcpy(boundaries_.data(), cursor, sizeof(BoundaryRecord) * boundaries_.size());
+	cursor += sizeof(BoundaryRecord) * boundaries_.size();
+
+	mapping_ = mapping;
+	map_ = map;
+	map_size_ = mapping->size;
+	config_ = config;
+	bool valid = true;
+	for (int t = 0; t < header[4] && valid; t++)
+	{
+		TableRecord table;
+		memcpy(&table, cursor + sizeof(TableRecord) * t, sizeof(TableRecord));
+		int64_t cells = (int64_t)table.width * table.height * table.depth;
+		valid = table.width > 0 && table.height > 0 && table.depth > 0 && table.offset % 64 == 0
+			&& table.offset >= table_offset && table.offset + 2 * cells * (int64_t)sizeof(real_t) <= wisdom_offset;
+		if (valid)
+		{
+			const real_t* cwt = (const real_t*)(map + table.offset);
+			tables_.push_back(DctPartition::ShareCoefficients(table.width, table.height, table.depth, config,
+				cwt, cwt + cells, mapping_));
+		}
+	}
+	for (auto& p : partitions_)
+	{
+		valid = valid && p.table >= 0 && p.table < header[4] && p.width > 0 && p.height > 0 && p.depth > 0;
+	}
+	int32_t num_partitions = (int32_t)(partitions_.size() + pmls_.size());
+	for (auto& p : pmls_)
+	{
+		valid = valid && p.neighbour >= 0 && p.neighbour < header[1];
+	}
+	for (auto& b : boundaries_)
+	{
+		valid = valid && b.a >= 0 && b.a < num_partitions && b.b >= 0 && b.b < header[1];
+	}
+	if (!valid)
+	{
+		std::cout << path << ": unsupported or damaged scene package." << std::endl;
+		Close();
+		return false;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(PartitionedConvolver::PlanMutex());
+		fftwf_import_wisdom_from_string((const char*)(map + wisdom_offset));
+	}
+	return true;
+}
+
+bool ScenePackage::Load(const std::string& path, const SimulationConfig& config, const std::string& scene_path)
+{
+	if (Open(path, config, scene_path))
+	{
+		return true;
+	}
+	std::cout << "Compiling " << scene_path << " into " << path << std::endl;
+	return Compile(config, scene_path, path) && Open(path, config, scene_path);
+}
+
+void ScenePackage::Close()
+{
+	tables_.clear();
+	partitions_.clear();
+	pmls_.clear();
+	boundaries_.clear();
+	mapping_.reset();	// unmapped once no partition uses its tables
+	map_ = nullptr;
+	map_size_ = 0;
+}
+
+std::vector<std::shared_ptr<Partition>> ScenePackage::Partitions(const SimulationConfig& config, VkGPU* vkGPU) const
+{
+	std::vector<std::shared_ptr<Partition>> partitions;
+	if (!map_ || !Matches(config, config_))
+	{
+		return partitions;
+	}
+	for (auto& p : partitions_)
+	{
+		partitions.push_back(std::make_shared<DctPartition>(config, p.x, p.y, p.z, p.width, p.height, p.depth, vkGPU));
+		partitions.back()->info_.id = (int)partitions.size() - 1;
+	}
+	return partitions;
+}
@@ -0,0 +1,107 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "types.h"
+#include "simulation_config.h"
+
+class Partition;
+struct VkGPU;
+
+/* A scene compiled once for fast startup: what Simulation otherwise works out on every launch.
+ *
+ * Compile() imports the scene, lets Simulation find the boundaries and the PML layout (over
+ * every free border cell) and writes them with the DCT partitions' mode coefficient tables
+ * and the FFTW wisdom gathered while planning. Open() maps the file read-only: the tables are used
+ * in place (DctPartition::ShareCoefficients), so concurrent processes share one copy through the
+ * page cache, and the imported wisdom turns FFTW_MEASURE planning into a lookup. The records are
+ * a few bytes per partition and copied out.
+ *
+ *   ScenePackage package;
+ *   package.Load("output/hall.ardpkg", config, "assets/hall.txt");	// compiles it if missing or stale
+ *   auto partitions = package.Partitions(config, vkGPU);
+ *   Simulation simulation(config, partitions, sources, &package);
+ *
+ * A package is tied to the scene file's contents and to dh, dt, c0 and the PML layers; absorption,
+ * duration and the field count may differ between runs.
+ *
+ * <name>.ardpkg (native little-endian):
+ *   header:    "ARDPKG\0\1", int32 version (1), num_partitions, num_pmls, num_boundaries, num_tables,
+ *              pml_layers, float dh, dt, c0, 0, uint64 scene hash (FNV-1a of the file), int64 table_offset,
+ *              wisdom_offset, wisdom_bytes, file_bytes, 0 (96 bytes)
+ *   partition: int32 x, y, z, width, height, depth (cells), table, 0 (num_partitions times)
+ *   pml:       int32 neighbour (partition index), PmlPartition::PmlType, x, y, z, width, height, depth
+ *   boundary:  int32 Boundary::BoundaryType, a, b (indices into partitions then PMLs), x_start, x_end,
+ *              y_start, y_end, z_start, z_end, 0, in Simulation's order
+ *   table:     int32 width, height, depth, 0, int64 offset of float cos(w dt)[w * h * d] then w^2[w * h * d]
+ *              (64-byte aligned, from table_offset)
+ *   wisdom:    fftwf_export_wisdom_to_string() with its terminating 0
+ */
+class ScenePackage
+{
+public:
+	struct PartitionRecord
+	{
+		int32_t x, y, z, width, height, depth;
+		int32_t table, reserved;
+	};
+	struct PmlRecord
+	{
+		int32_t neighbour, type;
+		int32_t x, y, z, width, height, depth;
+	};
+	struct BoundaryRecord
+	{
+		int32_t type, a, b;
+		int32_t x_start, x_end, y_start, y_end, z_start, z_end;
+		int32_t reserved;
+	};
+
+	ScenePackage();
+	~ScenePackage();
+	ScenePackage(const ScenePackage&) = delete;
+	ScenePackage& operator=(const ScenePackage&) = delete;
+
+	static bool Compile(const SimulationConfig& config, const std::string& scene_path, const std::string& path);
+
+	// False if the file is missing or damaged, or was built for another grid or (scene_path not empty) scene.
+	bool Open(const std::string& path, const SimulationConfig& config, const std::string& scene_path = "");
+	// Open(), compiling the package first if it is missing or stale.
+	bool Load(const std::string& path, const SimulationConfig& config, const std::string& scene_path);
+	void Close();
+
+	// The DCT partitions, numbered as ImportPartitions does; config as opened (the field count may differ).
+	std::vector<std::shared_ptr<Partition>> Partitions(const SimulationConfig& config, VkGPU* vkGPU) const;
+
+	bool is_open() const
+	{
+		return map_ != nullptr;
+	}
+	size_t num_partitions() const
+	{
+		return partitions_.size();
+	}
+	const std::vector<PmlRecord>& pmls() const
+	{
+		return pmls_;
+	}
+	const std::vector<BoundaryRecord>& boundaries() const
+	{
+		return boundaries_;
+	}
+
+private:
+	struct Mapping;
+
+	static bool Matches(const SimulationConfig& a, const SimulationConfig& b);
+
+	std::shared_ptr<const Mapping> mapping_;	// also held by the shared coefficient tables
+	const uint8_t* map_{ nullptr };
+	size_t map_size_{ 0 };
+	SimulationConfig config_;
+	std::vector<PartitionRecord> partitions_;
+	std::vector<PmlRecord> pmls_;
+	std::vector<BoundaryRecord> boundaries_;
+	std::vector<std::shared_ptr<const void>> tables_;	// DctPartition::ShareCoefficients handles
+};
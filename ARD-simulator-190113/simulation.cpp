@@ -4,6 +4,13 @@
 #include "boundary.h"
 #include "tools.h"
 #include "sound_source.h"
+#include "tracer.h"
+#include "perf_counters.h"
+#include "receiver_array.h"
+#include "field_view.h"
+#include "scene_package.h"
+#include "partition_index.h"
+#include <cassert>
 #include <fstream>
 #include <iostream>
 #include <algorithm>
@@ -11,46 +18,101 @@
 #include <omp.h>
 
 
-Simulation::Simulation( std::vector<std::shared_ptr<Partition>>& partitions,
-						std::vector<std::shared_ptr<SoundSource>>& sources )
+Simulation::Simulation( const SimulationConfig& config,
+						std::vector<std::shared_ptr<Partition>>& partitions,
+						std::vector<std::shared_ptr<SoundSource>>& sources,
+						const ScenePackage* package )
 	: m_partitions(partitions)
 	, m_sources(sources)
+	, config_(config)
 {
-	// Find all shared boundaries of partitions
-	for (int i = 0; i < m_partitions.size(); i++)
+	for (int i = 0; i < (int)m_partitions.size(); i++)
 	{
-		auto part_a = m_partitions[i];
-		for (int j = i + 1; j < m_partitions.size(); j++)
-		{
-			auto part_b = m_partitions[j];
-			auto boundary = Boundary::FindBoundary(part_a, part_b);
-			if (boundary)
-			{
-				m_boundaries.push_back(boundary);
-				part_a->AddBoundary(boundary);
-				part_b->AddBoundary(boundary);
-			}
-		}
+		m_partitions[i]->info_.id = i;
+	}
+
+	info_.num_dct_partitions = m_partitions.size();
+	PartitionIndex index(m_partitions);
+
+	if (package)
+	{
+		Restore(*package);
+	}
+	else
+	{
+		FindBoundaries(index);
 	}
 
 	// Add sources to corresponding partition
-	for (auto partition : m_partitions)
+	for (auto source : m_sources)
 	{
-		for (auto source : m_sources)
+		int i = index.Locate(source->x_, source->y_, source->z_);
+		if (i >= 0)
 		{
-			if (source->x_ >= partition->x_start_ && source->x_ < partition->x_end_ &&
-				source->y_ >= partition->y_start_ && source->y_ < partition->y_end_ &&
-				source->z_ >= partition->z_start_ && source->z_ < partition->z_end_)
-			{
-				partition->AddSource(source);
-			}
+			m_partitions[i]->AddSource(source);
 		}
 	}
 
-	info_.num_dct_partitions = m_partitions.size();
-	info_.num_boundaries = m_boundaries.size();
+	// Waveform tables (or the first block of streamed ones) before the first step.
+	for (auto source : m_sources)
+	{
+		source->Prepare(config_.total_steps());
+	}
+
 	info_.num_sources = m_sources.size();
 
+	if (!package)
+	{
+		info_.num_boundaries = m_boundaries.size();
+		FindPmlPartitions();
+	}
+
+	for (int i = 0; i < (int)m_boundaries.size(); i++)
+	{
+		m_boundaries[i]->info_.id = i;
+	}
+
+	/*------------- partitions includes pml partition --------------------------*/
+
+	x_start_ = y_start_ = z_start_ = std::numeric_limits<int>::max();
+	x_end_ = y_end_ = z_end_ = std::numeric_limits<int>::min();
+
+	for (auto partition : m_partitions)
+	{
+		x_start_ = std::min(x_start_, partition->x_start_);
+		y_start_ = std::min(y_start_, partition->y_start_);
+		z_start_ = std::min(z_start_, partition->z_start_);
+
+		x_end_ = std::max(x_end_, partition->x_end_);
+		y_end_ = std::max(y_end_, partition->y_end_);
+		z_end_ = std::max(z_end_, partition->z_end_);
+	}
+
+	size_x_ = x_end_ - x_start_;
+	size_y_ = y_end_ - y_start_;
+	size_z_ = z_end_ - z_start_;
+
+}
+
+void Simulation::FindBoundaries(const PartitionIndex& index)
+{
+	// Find all shared boundaries of partitions: only pairs whose faces meet, in the order of a scan over all pairs.
+	for (auto& pair : index.Touching())
+	{
+		auto part_a = m_partitions[pair.first];
+		auto part_b = m_partitions[pair.second];
+		auto boundary = Boundary::FindBoundary(part_a, part_b);
+		if (boundary)
+		{
+			m_boundaries.push_back(boundary);
+			part_a->AddBoundary(boundary);
+			part_b->AddBoundary(boundary);
+		}
+	}
+}
+
+void Simulation::FindPmlPartitions()
+{
 	// Find and create PML partitions.
 	for (int cnt = 0; cnt < info_.num_dct_partitions; cnt++)
 	{
@@ -76,14 +138,15 @@ Simulation::Simulation( std::vector<std::shared_ptr<Partition>>& partitions,
 					auto pml = std::make_shared<PmlPartition>(
 						partition,
 						PmlPartition::P_LEFT,
-						partition->x_start_ - Simulation::m_pml_layers,
+						partition->x_start_ - config_.pml_layers,
 						partition->y_start_ + start,
 						partition->z_start_,
-						Simulation::m_pml_layers,
+						config_.pml_layers,
 						end - start + 1,
 						partition->depth_);
+					pml->info_.id = (int)m_partitions.size();
 					m_partitions.push_back(pml);
-					auto boundary = Boundary::FindBoundary(pml, partition, partition->m_absorption);
+					auto boundary = Boundary::FindBoundary(pml, partition, config_.absorption);
 					m_boundaries.push_back(boundary);
 					info_.num_pml_partitions++;
 					started = false;
@@ -117,11 +180,12 @@ Simulation::Simulation( std::vector<std::shared_ptr<Partition>>& partitions,
 						partition->x_end_,
 						partition->y_start_ + start,
 						partition->z_start_,
-						Simulation::m_pml_layers,
+						config_.pml_layers,
 						end - start + 1,
 						partition->depth_);
+					pml->info_.id = (int)m_partitions.size();
 					m_partitions.push_back(pml);
-					auto boundary = Boundary::FindBoundary(pml, partition, partition->m_absorption);
+					auto boundary = Boundary::FindBoundary(pml, partition, config_.absorption);
 					m_boundaries.push_back(boundary);
 					info_.num_pml_partitions++;
 					started = false;
@@ -153,13 +217,14 @@ Simulation::Simulation( std::vector<std::shared_ptr<Partition>>& partitions,
 						partition,
 						PmlPartition::P_TOP,
 						partition->x_start_ + start,
-						partition->y_start_ - Simulation::m_pml_layers,
+						partition->y_start_ - config_.pml_layers,
 						partition->z_start_,
 						end - start + 1,
-						Simulation::m_pml_layers,
+						config_.pml_layers,
 						partition->depth_);
+					pml->info_.id = (int)m_partitions.size();
 					m_partitions.push_back(pml);
-					auto boundary = Boundary::FindBoundary(pml, partition, partition->m_absorption);
+					auto boundary = Boundary::FindBoundary(pml, partition, config_.absorption);
 					m_boundaries.push_back(boundary);
 					info_.num_pml_partitions++;
 					started = false;
@@ -194,10 +259,11 @@ Simulation::Simulation( std::vector<std::shared_ptr<Partition>>& partitions,
 						partition->y_end_,
 						partition->z_start_,
 						end - start + 1,
-						Simulation::m_pml_layers,
+						config_.pml_layers,
 						partition->depth_);
+					pml->info_.id = (int)m_partitions.size();
 					m_partitions.push_back(pml);
-					auto boundary = Boundary::FindBoundary(pml, partition, partition->m_absorption);
+					auto boundary = Boundary::FindBoundary(pml, partition, config_.absorption);
 					m_boundaries.push_back(boundary);
 					info_.num_pml_partitions++;
 					started = false;
@@ -218,14 +284,15 @@ Simulation::Simulation( std::vector<std::shared_ptr<Partition>>& partitions,
 				PmlPartition::P_FRONT,
 				partition->x_start_,
 				partition->y_start_,
-				partition->z_start_ - Simulation::m_pml_layers,
+				partition->z_start_ - config_.pml_layers,
 				partition->width_,
 				partition->height_,
-				Simulation::m_pml_layers);
+				config_.pml_layers);
+			pml->info_.id = (int)m_partitions.size();
 			m_partitions.push_back(pml);
 			m_boundaries.push_back(std::make_shared<Boundary>(
 				Boundary::Z_BOUNDARY,
-				partition->m_absorption,
+				config_.absorption,
 				pml,
 				partition,
 				partition->x_start_,
@@ -248,11 +315,12 @@ Simulation::Simulation( std::vector<std::shared_ptr<Partition>>& partitions,
 				partition->z_end_,
 				partition->width_,
 				partition->height_,
-				Simulation::m_pml_layers);
+				config_.pml_layers);
+			pml->info_.id = (int)m_partitions.size();
 			m_partitions.push_back(pml);
 			m_boundaries.push_back(std::make_shared<Boundary>(
 				Boundary::Z_BOUNDARY,
-				partition->m_absorption,
+				config_.absorption,
 				pml,
 				partition,
 				partition->x_start_,
@@ -264,33 +332,35 @@ Simulation::Simulation( std::vector<std::shared_ptr<Partition>>& partitions,
 			info_.num_pml_partitions++;
 		}
 	}
+}
 
-
-
-	/*------------- partitions includes pml partition --------------------------*/
-
-	x_start_ = y_start_ = z_start_ = std::numeric_limits<int>::max();
-	x_end_ = y_end_ = z_end_ = std::numeric_limits<int>::min();
-
-	for (auto partition : m_partitions)
+void Simulation::Restore(const ScenePackage& package)
+{
+	// The PML partitions and boundaries FindBoundaries and FindPmlPartitions would build, in the same order.
+	assert(package.num_partitions() == info_.num_dct_partitions);
+	for (auto& r : package.pmls())
 	{
-		x_start_ = std::min(x_start_, partition->x_start_);
-		y_start_ = std::min(y_start_, partition->y_start_);
-		z_start_ = std::min(z_start_, partition->z_start_);
-
-		x_end_ = std::max(x_end_, partition->x_end_);
-		y_end_ = std::max(y_end_, partition->y_end_);
-		z_end_ = std::max(z_end_, partition->z_end_);
+		auto pml = std::make_shared<PmlPartition>(m_partitions[r.neighbour], (PmlPartition::PmlType)r.type,
+			r.x, r.y, r.z, r.width, r.height, r.depth);
+		pml->info_.id = (int)m_partitions.size();
+		m_partitions.push_back(pml);
+		info_.num_pml_partitions++;
+	}
+	for (auto& r : package.boundaries())
+	{
+		auto a = m_partitions[r.a];
+		auto b = m_partitions[r.b];
+		bool shared = r.a < (int)info_.num_dct_partitions;	// between two DCT partitions, else a is the PML
+		auto boundary = std::make_shared<Boundary>((Boundary::BoundaryType)r.type, shared ? 1.0f : config_.absorption,
+			a, b, r.x_start, r.x_end, r.y_start, r.y_end, r.z_start, r.z_end);
+		m_boundaries.push_back(boundary);
+		if (shared)
+		{
+			a->AddBoundary(boundary);
+			b->AddBoundary(boundary);
+			info_.num_boundaries++;
+		}
 	}
-
-	size_x_ = x_end_ - x_start_;
-	size_y_ = y_end_ - y_start_;
-	size_z_ = z_end_ - z_start_;
-
-
-
-	pixels_.assign(size_x_*size_y_, 0);
-	ready_ = true;
 }
 
 Simulation::~Simulation()
@@ -300,16 +370,29 @@ Simulation::~Simulation()
 int Simulation::Update()
 {
 	int time_step = time_step_++;
+	Tracer::SetStep(time_step);
+	TraceSpan step_span("step");
 	//std::cout << "#" << std::setw(5) << time_step << " : ";
 	//std::cout << std::to_string(sources_[0]->SampleValue(time_step)) << " ";
 
 #pragma omp parallel for
 	for (int i = 0; i < m_partitions.size(); i++)
 	{
-		m_partitions[i]->ComputeSourceForcingTerms((real_t)time_step);
+		{
+			TraceSpan span("source injection", m_partitions[i]->info_.id);
+			m_partitions[i]->ComputeSourceForcingTerms(time_step);
+		}
 		m_partitions[i]->Update();
+		if (m_receivers)
+		{
+			m_receivers->Gather(i);
+		}
 		//std::cout << "update partition " << partition->info_.id << " ";
 	}
+	if (m_receivers)
+	{
+		m_receivers->EndStep(time_step);
+	}
 #pragma omp parallel for
 	for (int i = 0; i < m_boundaries.size(); i++)
 	{
@@ -317,107 +400,14 @@ int Simulation::Update()
 	}
 	//std::cout << std::endl;
 
-#if 1
-	// Visualization
+	// Visualization: a copy of each view's plane when its frame is due, coloured on the render thread.
+	if (render_)
 	{
-		SDL_PixelFormat* fmt = SDL_AllocFormat(SDL_PIXELFORMAT_RGBA8888);
-		int v_coef = 10;
-		bool render_pml = false;
-		if (look_from_ == 0)	//xy
-		{
-			int pixels_z = m_sources[0]->z();
-			for (auto partition : m_partitions)
-			{
-				if (!render_pml)
-				{
-					if (!partition->should_render_) continue;
-				}
-				//if (partition->is_z_pml_) continue;
-				if (partition->z_start_ > pixels_z || partition->z_end_ < pixels_z)
-				{
-					continue;
-				}
-				int x_offset = partition->x_start_ - x_start_;
-				int y_offset = partition->y_start_ - y_start_;
-				std::vector<real_t> partition_xy;
-				partition_xy = partition->get_xy_plane(pixels_z);
-				for (int i = 0; i < partition->height_; i++) {
-					for (int j = 0; j < partition->width_; j++) {
-						real_t pressure = partition_xy[i*partition->width_ + j];
-						real_t norm = 0.5f*std::max(-1.0f, std::min(1.0f, pressure*v_coef)) + 0.5f;
-						int r, g, b;
-						if (norm >= 0.5f)
-						{
-							r = static_cast<int> (255 - round(255.0f*2.0f*(norm - 0.5f)));
-							g = static_cast<int> (255 - round(255.0f*2.0f*(norm - 0.5f)));
-							b = 255;
-						}
-						else {
-							r = 255;
-							g = static_cast<int> (255 - round(255.0f*(1.0f - 2.0f*norm)));
-							b = static_cast<int> (255 - round(255.0f*(1.0f - 2.0f*norm)));
-						}
-						if (partition->should_render_)
-						{
-							pixels_[(y_offset + i)*size_x_ + (x_offset + j)] = SDL_MapRGBA(fmt, 255, r, g, b);
-						}
-						else
-						{
-							pixels_[(y_offset + i)*size_x_ + (x_offset + j)] = SDL_MapRGBA(fmt, 255, Uint8(0.5f*r), Uint8(0.5f*g), Uint8(0.5f*b));
-						}
-					}
-				}
-			}
-		}
-		else if (look_from_ == 1)	//yz
+		for (auto& view : m_views)
 		{
-			int pixels_x = m_sources[0]->x();
-			for (auto partition : m_partitions)
-			{
-				if (!render_pml)
-				{
-					if (!partition->should_render_) continue;
-				}
-				//if (partition->is_x_pml_) continue;
-				if (partition->x_start_ > pixels_x || partition->x_end_ < pixels_x)
-				{
-					continue;
-				}
-				int y_offset = partition->y_start_ - y_start_;
-				int z_offset = partition->z_start_ - z_start_;
-				std::vector<real_t> partition_yz;
-				partition_yz = partition->get_yz_plane(pixels_x);
-
-				for (int i = 0; i < partition->depth_; i++) {
-					for (int j = 0; j < partition->height_; j++) {
-						real_t pressure = partition_yz[i*partition->height_ + j];
-						real_t norm = 0.5f*std::max(-1.0f, std::min(1.0f, pressure*v_coef)) + 0.5f;
-						int r, g, b;
-						if (norm >= 0.5)
-						{
-							r = static_cast<int> (255 - round(255.0f*2.0f*(norm - 0.5f)));
-							g = static_cast<int> (255 - round(255.0f*2.0f*(norm - 0.5f)));
-							b = 255;
-						}
-						else {
-							r = 255;
-							g = static_cast<int> (255 - round(255.0f*(1.0f - 2.0f*norm)));
-							b = static_cast<int> (255 - round(255.0f*(1.0f - 2.0f*norm)));
-						}
-						if (partition->should_render_)
-						{
-							pixels_[(z_offset + i)*size_y_ + (y_offset + j)] = SDL_MapRGBA(fmt, 255, r, g, b);
-						}
-						else
-						{
-							pixels_[(z_offset + i)*size_y_ + (y_offset + j)] = SDL_MapRGBA(fmt, 255, Uint8(0.5f*r), Uint8(0.5f*g), Uint8(0.5f*b));
-						}
-					}
-				}
-			}
+			view->Capture(m_partitions, time_step);
 		}
 	}
-#endif
 
 	return time_step;
 }
@@ -429,13 +419,17 @@ void Simulation::Info()
 		<< std::to_string(x_start_) << "," << std::to_string(y_start_) << "," << std::to_string(z_start_) << "->"
 		<< std::to_string(x_end_) << "," + std::to_string(y_end_) << "," + std::to_string(z_end_) << std::endl;
 	std::cout << "Size: " << "<" << size_x_ << "," << size_y_ << "," << size_z_ << ">" << std::endl;
-	std::cout << "dh = " << std::to_string(Simulation::m_dh)
-		<< "(m), dt = " << std::to_string(Simulation::m_dt)
-		<< "(s), c0 = " << std::to_string(Simulation::m_c0) << "(m/s)" << std::endl;
+	std::cout << "dh = " << std::to_string(config_.dh)
+		<< "(m), dt = " << std::to_string(config_.dt)
+		<< "(s), c0 = " << std::to_string(config_.c0) << "(m/s)" << std::endl;
 	std::cout << "Number of dct_partitions: " << info_.num_dct_partitions << std::endl;
 	std::cout << "Number of pml_partitions: " << info_.num_pml_partitions << std::endl;
 	std::cout << "Number of boundaries: " << info_.num_boundaries << std::endl;
 	std::cout << "Number of sources: " << info_.num_sources << std::endl;
+	if (config_.fields > 1)
+	{
+		std::cout << "Batched sources: " << config_.fields << " fields per partition" << std::endl;
+	}
 
 	std::cout << "############################################################" << std::endl;
 	for (auto p : m_partitions)
@@ -451,8 +445,56 @@ void Simulation::Info()
 	std::cout << "------------------------------------------------------------" << std::endl;
 	for (auto s : m_sources)
 	{
-		std::cout << "Source " << s->id_ << ": " << s->x() << "," << s->y() << "," << s->z() << std::endl;
+		std::cout << "Source " << s->id_ << ": " << s->x() << "," << s->y() << "," << s->z();
+		if (config_.fields > 1)
+		{
+			std::cout << " (field " << s->field() << ")";
+		}
+		std::cout << std::endl;
 	}
 	std::cout << "------------------------------------------------------------" << std::endl;
 }
 
+uint64_t Simulation::num_cells()
+{
+	uint64_t cells = 0;
+	for (auto partition : m_partitions)
+	{
+		cells += (uint64_t)partition->width_ * partition->height_ * partition->depth_;
+	}
+	return cells;
+}
+
+void Simulation::SetReceivers(std::shared_ptr<ReceiverArray> receivers)
+{
+	m_receivers = receivers;
+}
+
+void Simulation::AddView(std::shared_ptr<FieldView> view)
+{
+	m_views.push_back(view);
+}
+
+double Simulation::Energy()
+{
+	TraceSpan span("energy");
+	double energy = 0.0;
+	int tracked = 0;
+#pragma omp parallel for reduction(+:energy, tracked)
+	for (int i = 0; i < (int)m_partitions.size(); i++)
+	{
+		double e = m_partitions[i]->ModeEnergy();
+		if (e >= 0.0)
+		{
+			energy += e;
+			tracked++;
+		}
+	}
+	return tracked ? energy : -1.0;
+}
+
+void Simulation::CounterInfo(bool per_partition)
+{
+	PerfCounters::Report(counter_window_start_, time_step_ - 1, per_partition);
+	counter_window_start_ = time_step_;
+}
@@ -1,13 +1,18 @@
 #pragma once
+#include <cstdint>
 #include <vector>
 #include <memory>
 #include <string>
-#include <SDL.h>
 #include "types.h"
+#include "simulation_config.h"
 
 class Partition;
 class Boundary;
 class SoundSource;
+class ReceiverArray;
+class FieldView;
+class ScenePackage;
+class PartitionIndex;
 
 class Simulation
 {
@@ -24,6 +29,8 @@ class Simulation
 	std::vector<std::shared_ptr<Partition>>		m_partitions;
 	std::vector<std::shared_ptr<Boundary>>		m_boundaries;
 	std::vector<std::shared_ptr<SoundSource>>	m_sources;
+	std::shared_ptr<ReceiverArray>				m_receivers;	// gathered right after each partition's update
+	std::vector<std::shared_ptr<FieldView>>		m_views;		// preview slices, each captured at its frame rate
 
 	int x_start_, x_end_;
 	int y_start_, y_end_;
@@ -31,34 +38,46 @@ class Simulation
 
 	int size_x_, size_y_, size_z_;
 
-	bool ready_;
-	std::vector<Uint32> pixels_;
-	
+	SimulationConfig config_;
 	Info info_;
+	int counter_window_start_{ 0 };
 
-public:
-
-	static real_t m_duration;
+	void FindBoundaries(const PartitionIndex& index);	// between the DCT partitions
+	void FindPmlPartitions();							// along every free border
+	void Restore(const ScenePackage& package);
 
-	static real_t m_dh;
-	static real_t m_dt;
-	static real_t m_c0;
-	static int m_pml_layers;
+public:
 
 	int time_step_{ 0 };
 
-	int look_from_{ 0 };	// 0: visualize xy plane
-							// 1: visualize yz plane
-							// 2: 
+	bool render_{ true };	// false: no preview captures (headless runs, benchmarks)
 
-	Simulation(std::vector<std::shared_ptr<Partition>> &partitions, std::vector<std::shared_ptr<SoundSource>> &sources);
+	/* partitions: the DCT partitions, built with the same config; PML partitions and the boundaries are added here.
+	 * Partitions and boundaries are numbered per simulation, so several can coexist in one process.
+	 * package: the partitions came from ScenePackage::Partitions(), whose boundaries and PML layout are used
+	 * instead of searching for them.
+	 */
+	Simulation(const SimulationConfig& config, std::vector<std::shared_ptr<Partition>> &partitions, std::vector<std::shared_ptr<SoundSource>> &sources,
+		const ScenePackage* package = nullptr);
 	~Simulation();
 
 	int Update();
+	void SetReceivers(std::shared_ptr<ReceiverArray> receivers);
+	void AddView(std::shared_ptr<FieldView> view);
 
 	void Info();
-	//FindBoundaries();
+	void CounterInfo(bool per_partition = false);	// hardware counter summary since the last call
+	uint64_t num_cells();	// DCT and PML cells updated per step
+	double Energy();		// sum of the partitions' mode energies, < 0 if none is tracked (GPU)
 
+	const SimulationConfig& config() const
+	{
+		return config_;
+	}
+	int total_steps() const
+	{
+		return config_.total_steps();
+	}
 	int size_x()
 	{
 		return size_x_;
@@ -71,13 +90,7 @@ public:
 	{
 		return size_z_;
 	}
-	bool ready()
-	{
-		return ready_;
-	}
-	decltype(pixels_) pixels()
-	{
-		return pixels_;
-	}
+	friend class FieldView;
+	friend class ScenePackage;
 };
 
@@ -0,0 +1,24 @@
+#pragma once
+#include "types.h"
+
+/* Physical and run parameters of one simulation.
+ *
+ * There is no process-wide copy: partitions keep the one they were built with (Partition::config_),
+ * Simulation, sources and the outputs get it from them or as an argument. Two simulations with
+ * different settings can therefore run side by side in one process (see SimulationContext).
+ */
+struct SimulationConfig
+{
+	real_t dh{ 10 / 100.0f };		// Space sampling rate (cell size, m)
+	real_t dt{ 1.0f / 8000.0f };	// Time sampling rate (s)
+	real_t c0{ 3.435e2f };			// Speed of sound (m/s)
+	real_t duration{ 2.0f };		// Duration of the whole simulation (s)
+	int pml_layers{ 5 };			// Number of pml layers
+	real_t absorption{ 1.0f };		// Absorption coefficient of the boundaries
+	int fields{ 1 };				// Independent fields per partition (batched sources)
+
+	int total_steps() const
+	{
+		return (int)(duration / dt);
+	}
+};
@@ -0,0 +1,145 @@
+#include "simulation_context.h"
+#include "simulation.h"
+#include "partition.h"
+#include "dct_partition.h"
+#include "sound_source.h"
+#include "gaussian_source.h"
+#include "partition_index.h"
+#include <iostream>
+
+
+SimulationContext::SimulationContext(const SimulationConfig& config)
+	: config_(config)
+{
+}
+
+SimulationContext::~SimulationContext()
+{
+	// The Simulation holds the PML partitions and the boundaries, which point back at the DCT partitions.
+	simulation_.reset();
+	partitions_.clear();
+}
+
+bool SimulationContext::LoadScene(const std::string& path)
+{
+	if (simulation_)
+	{
+		return false;
+	}
+	auto partitions = Partition::ImportPartitions(config_, path, nullptr);
+	if (partitions.empty())
+	{
+		std::cout << "No partitions in " << path << std::endl;
+		return false;
+	}
+	partitions_.insert(partitions_.end(), partitions.begin(), partitions.end());
+	return true;
+}
+
+bool SimulationContext::AddPartition(real_t x, real_t y, real_t z, real_t width, real_t height, real_t depth)
+{
+	int w = (int)(width / config_.dh), h = (int)(height / config_.dh), d = (int)(depth / config_.dh);
+	if (simulation_ || w <= 0 || h <= 0 || d <= 0)
+	{
+		return false;
+	}
+	partitions_.push_back(std::make_shared<DctPartition>(config_,
+		(int)(x / config_.dh), (int)(y / config_.dh), (int)(z / config_.dh), w, h, d, nullptr));
+	return true;
+}
+
+bool SimulationContext::LoadSources(const std::string& path)
+{
+	if (simulation_)
+	{
+		return false;
+	}
+	auto sources = SoundSource::ImportSources(config_, path);
+	for (auto& source : sources)
+	{
+		source->set_id((int)sources_.size());
+		sources_.push_back(source);
+	}
+	return !sources.empty();
+}
+
+int SimulationContext::AddSource(real_t x, real_t y, real_t z)
+{
+	if (simulation_)
+	{
+		return -1;
+	}
+	auto source = std::make_shared<GaussianSource>((int)(x / config_.dh), (int)(y / config_.dh), (int)(z / config_.dh), config_);
+	source->set_id((int)sources_.size());
+	sources_.push_back(source);
+	return source->id();
+}
+
+int SimulationContext::AddRecorder(real_t x, real_t y, real_t z)
+{
+	if (simulation_)
+	{
+		return -1;
+	}
+	Probe probe;
+	probe.x = (int)(x / config_.dh);
+	probe.y = (int)(y / config_.dh);
+	probe.z = (int)(z / config_.dh);
+	recorders_.push_back(probe);
+	return (int)recorders_.size() - 1;
+}
+
+bool SimulationContext::Build()
+{
+	if (partitions_.empty() || sources_.empty())
+	{
+		return false;
+	}
+	PartitionIndex index(partitions_);
+	for (auto& probe : recorders_)
+	{
+		int i = index.Locate(probe.x, probe.y, probe.z);
+		if (i >= 0)
+		{
+			auto& partition = partitions_[i];
+			probe.part = partition;
+			probe.lx = probe.x - partition->x_start_;
+			probe.ly = probe.y - partition->y_start_;
+			probe.lz = probe.z - partition->z_start_;
+		}
+		probe.response.reserve(config_.total_steps());
+	}
+	simulation_ = std::make_shared<Simulation>(config_, partitions_, sources_);
+	simulation_->render_ = false;
+	return true;
+}
+
+int SimulationContext::Run(const Callbacks& callbacks)
+{
+	if (!simulation_ && !Build())
+	{
+		return -1;
+	}
+	int total_steps = config_.total_steps();
+	int steps = 0;
+	while (simulation_->time_step_ < total_steps)
+	{
+		int time_step = simulation_->Update();
+		steps++;
+		for (int i = 0; i < (int)recorders_.size(); i++)
+		{
+			Probe& probe = recorders_[i];
+			real_t pressure = probe.part ? probe.part->get_pressure(probe.lx, probe.ly, probe.lz) : 0.0f;
+			probe.response.push_back(pressure);
+			if (callbacks.sample)
+			{
+				callbacks.sample(i, time_step, pressure);
+			}
+		}
+		if (callbacks.progress && !callbacks.progress(time_step, total_steps))
+		{
+			break;
+		}
+	}
+	return steps;
+}
@@ -0,0 +1,89 @@
+#pragma once
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include "types.h"
+#include "simulation_config.h"
+
+class Partition;
+class Simulation;
+class SoundSource;
+
+/* The simulator as a library: one scene, its sources and pressure probes, and a run, with no
+ * process-wide state. Everything a run needs comes from the context's SimulationConfig, so
+ * several contexts with different grids can be built and run on different threads of one
+ * process (each Simulation::Update still uses OpenMP inside).
+ *
+ *   SimulationContext context(config);
+ *   context.LoadScene("scene.txt");			// or AddPartition(...) in metres
+ *   context.AddSource(1.0f, 1.0f, 1.0f);
+ *   int probe = context.AddRecorder(2.0f, 1.5f, 1.0f);
+ *   context.Run({ on_sample, on_progress });
+ *
+ * The scene, sources and recorders are fixed once Run() has built the Simulation; further Add
+ * and Load calls fail. Runs use the CPU backend.
+ */
+class SimulationContext
+{
+public:
+	struct Callbacks
+	{
+		std::function<void(int recorder, int time_step, real_t pressure)> sample;	// every recorder, every step
+		std::function<bool(int time_step, int total_steps)> progress;				// after every step, false stops the run
+	};
+
+	explicit SimulationContext(const SimulationConfig& config = SimulationConfig());
+	~SimulationContext();
+	SimulationContext(const SimulationContext&) = delete;
+	SimulationContext& operator=(const SimulationContext&) = delete;
+
+	// Positions and sizes in metres, as in the scene, source and recorder files.
+	bool LoadScene(const std::string& path);
+	bool AddPartition(real_t x, real_t y, real_t z, real_t width, real_t height, real_t depth);
+	bool LoadSources(const std::string& path);
+	int AddSource(real_t x, real_t y, real_t z);	// Gaussian pulse; source id, -1 once running
+	int AddRecorder(real_t x, real_t y, real_t z);	// pressure probe; recorder id, -1 once running
+
+	// Steps until config().total_steps() or until progress returns false; a later call continues.
+	// Returns the number of steps run by this call, -1 if the scene or the sources are empty.
+	int Run(const Callbacks& callbacks = Callbacks());
+
+	const SimulationConfig& config() const
+	{
+		return config_;
+	}
+	Simulation* simulation()	// null before the first Run()
+	{
+		return simulation_.get();
+	}
+	const std::vector<real_t>& response(int recorder) const	// one pressure per step run
+	{
+		return recorders_[recorder].response;
+	}
+	size_t num_recorders() const
+	{
+		return recorders_.size();
+	}
+	const std::vector<std::shared_ptr<SoundSource>>& sources() const
+	{
+		return sources_;
+	}
+
+private:
+	struct Probe
+	{
+		int x, y, z;						// cells
+		std::shared_ptr<Partition> part;	// null outside every partition: the probe reads 0
+		int lx{ 0 }, ly{ 0 }, lz{ 0 };		// inside part
+		std::vector<real_t> response;
+	};
+
+	bool Build();
+
+	SimulationConfig config_;
+	std::vector<std::shared_ptr<Partition>> partitions_;
+	std::vector<std::shared_ptr<SoundSource>> sources_;
+	std::vector<Probe> recorders_;
+	std::shared_ptr<Simulation> simulation_;
+};
@@ -0,0 +1,390 @@
+#include "snapshot.h"
+#include "partition.h"
+#include "simulation.h"
+#include "tracer.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+static int64_t Align(int64_t n, int64_t to)
+{
+	return (n + to - 1) / to * to;
+}
+
+/* Two passes over the partition: max |p| per block, then the codes with that block's scale. */
+template <typename Code>
+static void Quantise(const real_t* p, int w, int h, int d, int b, float* scales, Code* codes)
+{
+	const float levels = (float)std::numeric_limits<Code>::max();
+	int nx = (w + b - 1) / b, ny = (h + b - 1) / b, nz = (d + b - 1) / b;
+	size_t blocks = (size_t)nx * ny * nz;
+	std::fill(scales, scales + blocks, 0.0f);
+	for (int z = 0; z < d; z++)
+		for (int y = 0; y < h; y++)
+		{
+			float* s = scales + ((size_t)(z / b) * ny + y / b) * nx;
+			const real_t* row = p + ((size_t)z * h + y) * w;
+			for (int x = 0; x < w; x++)
+				s[x / b] = std::max(s[x / b], std::fabs(row[x]));
+		}
+
+	std::vector<float> inverse(blocks);
+	for (size_t i = 0; i < blocks; i++)
+	{
+		inverse[i] = scales[i] > 0.0f ? levels / scales[i] : 0.0f;
+		scales[i] /= levels;
+	}
+	for (int z = 0; z < d; z++)
+		for (int y = 0; y < h; y++)
+		{
+			const float* inv = &inverse[((size_t)(z / b) * ny + y / b) * nx];
+			const real_t* row = p + ((size_t)z * h + y) * w;
+			Code* out = codes + ((size_t)z * h + y) * w;
+			for (int x = 0; x < w; x++)
+				out[x] = (Code)std::lrint(std::min(levels, std::max(-levels, row[x] * inv[x / b])));
+		}
+}
+
+template <typename Code>
+static void Dequantise(const float* scales, const Code* codes, int w, int h, int d, int b, real_t* out)
+{
+	int nx = (w + b - 1) / b, ny = (h + b - 1) / b;
+	for (int z = 0; z < d; z++)
+		for (int y = 0; y < h; y++)
+		{
+			const float* s = scales + ((size_t)(z / b) * ny + y / b) * nx;
+			size_t row = ((size_t)z * h + y) * w;
+			for (int x = 0; x < w; x++)
+				out[row + x] = codes[row + x] * s[x / b];
+		}
+}
+
+size_t SnapshotWriter::BlockCount(int width, int height, int depth, int block)
+{
+	return (size_t)((width + block - 1) / block) * ((height + block - 1) / block) * ((depth + block - 1) / block);
+}
+
+SnapshotWriter::SnapshotWriter(const std::string& path, const Settings& settings)
+	: path_(path)
+	, settings_(settings)
+	, full_(std::max(1, settings.buffers))
+	, empty_(std::max(1, settings.buffers))
+{
+	settings_.bits = settings.bits > 8 ? 16 : 8;
+	settings_.block = std::max(1, settings.block);
+	settings_.every = std::max(1, settings.every);
+	settings_.buffers = std::max(1, settings.buffers);
+}
+
+SnapshotWriter::~SnapshotWriter()
+{
+	Close();
+}
+
+bool SnapshotWriter::Start(const std::vector<std::shared_ptr<Partition>>& partitions)
+{
+	file_ = fopen(path_.c_str(), "wb");
+	if (!file_)
+	{
+		std::cout << "Cannot open " << path_ << " for the snapshots." << std::endl;
+		return false;
+	}
+	file_buffer_.resize(8 << 20);
+	setvbuf(file_, file_buffer_.data(), _IOFBF, file_buffer_.size());
+
+	// Frame layout: step header, then each partition's scales and codes at an 8-byte aligned offset.
+	int code_bytes = settings_.bits / 8;
+	int64_t offset = 8;
+	offsets_.clear();
+	for (auto& p : partitions)
+	{
+		offsets_.push_back(offset);
+		offset += (int64_t)BlockCount(p->width_, p->height_, p->depth_, settings_.block) * sizeof(float);
+		offset = Align(offset + (int64_t)p->width_ * p->height_ * p->depth_ * code_bytes, 8);
+	}
+	frame_bytes_ = offset;
+	int64_t data_offset = Align(64 + 32 * (int64_t)partitions.size(), 64);
+
+	const SimulationConfig config = partitions.empty() ? SimulationConfig() : partitions.front()->config_;
+	const char magic[8] = { 'A', 'R', 'D', 'S', 'N', 'P', 0, 1 };
+	int32_t header[6] = { 1, (int32_t)partitions.size(), settings_.bits, settings_.block, settings_.every,
+		(int32_t)config.total_steps() };
+	float constants[3] = { config.dh, config.dt, config.c0 };
+	int32_t field = settings_.field;
+	int64_t sizes[2] = { frame_bytes_, data_offset };
+	fwrite(magic, 1, sizeof(magic), file_);
+	fwrite(header, sizeof(int32_t), 6, file_);
+	fwrite(constants, sizeof(float), 3, file_);
+	fwrite(&field, sizeof(int32_t), 1, file_);
+	fwrite(sizes, sizeof(int64_t), 2, file_);
+	for (size_t i = 0; i < partitions.size(); i++)
+	{
+		auto& p = partitions[i];
+		int32_t info[6] = { p->x_start_, p->y_start_, p->z_start_, p->width_, p->height_, p->depth_ };
+		fwrite(info, sizeof(int32_t), 6, file_);
+		fwrite(&offsets_[i], sizeof(int64_t), 1, file_);
+	}
+	std::vector<char> padding((size_t)(data_offset - 64 - 32 * (int64_t)partitions.size()), 0);
+	fwrite(padding.data(), 1, padding.size(), file_);
+
+	storage_.clear();
+	for (int i = 0; i < settings_.buffers; i++)
+	{
+		auto frame = std::make_unique<Frame>();
+		frame->data.assign((size_t)frame_bytes_, 0);
+		empty_.Push(frame.get());
+		storage_.push_back(std::move(frame));
+	}
+
+	running_ = true;
+	thread_ = std::thread(&SnapshotWriter::Run, this);
+	std::cout << "Snapshots every " << settings_.every << " steps, " << settings_.bits << "-bit codes in "
+		<< settings_.block << "^3 blocks, " << (double)frame_bytes_ / (1 << 20) << " MB per frame" << std::endl;
+	return true;
+}
+
+void SnapshotWriter::Capture(const std::vector<std::shared_ptr<Partition>>& partitions, int time_step)
+{
+	if (!running_ || time_step % settings_.every != 0)
+	{
+		return;
+	}
+	TraceSpan span("snapshot");
+	Frame* frame;
+	while (!empty_.Pop(frame))
+	{
+		std::this_thread::yield();	// writer is behind, wait for a buffer to come back
+	}
+	frame->time_step = time_step;
+	int32_t step_header[2] = { time_step, 0 };
+	memcpy(frame->data.data(), step_header, sizeof(step_header));
+
+	int field = partitions.empty() ? 0 : std::min(settings_.field, partitions.front()->config_.fields - 1);
+	int b = settings_.block;
+#pragma omp parallel for schedule(dynamic)
+	for (int i = 0; i < (int)partitions.size(); i++)
+	{
+		Partition& p = *partitions[i];
+		const real_t* pressure = p.get_pressure_field() + (size_t)field * p.field_stride_;
+		uint8_t* section = frame->data.data() + offsets_[i];
+		float* scales = (float*)section;
+		uint8_t* codes = section + BlockCount(p.width_, p.height_, p.depth_, b) * sizeof(float);
+		if (settings_.bits == 16)
+			Quantise(pressure, p.width_, p.height_, p.depth_, b, scales, (int16_t*)codes);
+		else
+			Quantise(pressure, p.width_, p.height_, p.depth_, b, scales, (int8_t*)codes);
+	}
+
+	while (!full_.Push(frame))
+	{
+		std::this_thread::yield();
+	}
+}
+
+void SnapshotWriter::Close()
+{
+	if (!running_)
+	{
+		return;
+	}
+	running_ = false;
+	thread_.join();
+	fclose(file_);
+	file_ = nullptr;
+	if (failed_)
+	{
+		std::cout << "Writing " << path_ << " failed, the snapshots are incomplete." << std::endl;
+	}
+}
+
+void SnapshotWriter::Run()
+{
+	for (;;)
+	{
+		// Read the flag before draining, so frames pushed before Close() are always written.
+		bool stop = !running_;
+		bool idle = true;
+		Frame* frame;
+		while (full_.Pop(frame))
+		{
+			if (!failed_ && fwrite(frame->data.data(), 1, frame->data.size(), file_) != frame->data.size())
+			{
+				failed_ = true;
+			}
+			empty_.Push(frame);
+			idle = false;
+		}
+		if (stop)
+		{
+			break;
+		}
+		if (idle)
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+	}
+}
+
+SnapshotReader::~SnapshotReader()
+{
+	Close();
+}
+
+bool SnapshotReader::Open(const std::string& path)
+{
+	Close();
+#ifdef _WIN32
+	HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		std::cout << "Cannot open " << path << std::endl;
+		return false;
+	}
+	LARGE_INTEGER size;
+	GetFileSizeEx(file, &size);
+	HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	const void* view = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+	file_ = file;
+	mapping_ = mapping;
+	map_ = (const uint8_t*)view;
+	map_size_ = (size_t)size.QuadPart;
+#else
+	int fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+	{
+		std::cout << "Cannot open " << path << std::endl;
+		return false;
+	}
+	struct stat st;
+	fstat(fd, &st);
+	void* view = st.st_size > 0 ? mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+	close(fd);	// the mapping keeps the file alive
+	if (view != MAP_FAILED)
+	{
+		madvise(view, st.st_size, MADV_RANDOM);
+		map_ = (const uint8_t*)view;
+		map_size_ = (size_t)st.st_size;
+	}
+#endif
+	if (!map_ || map_size_ < 64 || memcmp(map_, "ARDSNP\0\1", 8))
+	{
+		std::cout << path << " is not a snapshot file." << std::endl;
+		Close();
+		return false;
+	}
+
+	int32_t header[6];
+	memcpy(header, map_ + 8, sizeof(header));
+	memcpy(&frame_bytes_, map_ + 48, sizeof(int64_t));
+	memcpy(&data_offset_, map_ + 56, sizeof(int64_t));
+	int count = header[1];
+	bits_ = header[2];
+	block_ = header[3];
+	if (header[0] != 1 || (bits_ != 8 && bits_ != 16) || block_ < 1 || frame_bytes_ <= 0
+		|| (size_t)data_offset_ > map_size_ || 64 + 32 * (int64_t)count > data_offset_)
+	{
+		std::cout << path << ": unsupported or damaged snapshot header." << std::endl;
+		Close();
+		return false;
+	}
+	partitions_.resize(count);
+	for (int i = 0; i < count; i++)
+	{
+		const uint8_t* entry = map_ + 64 + 32 * (size_t)i;
+		int32_t info[6];
+		memcpy(info, entry, sizeof(info));
+		PartitionInfo& p = partitions_[i];
+		p = { info[0], info[1], info[2], info[3], info[4], info[5], 0 };
+		memcpy(&p.offset, entry + 24, sizeof(int64_t));
+	}
+	frames_ = (int)((map_size_ - data_offset_) / frame_bytes_);	// a frame cut short by a crash is ignored
+	return true;
+}
+
+void SnapshotReader::Close()
+{
+#ifdef _WIN32
+	if (map_) UnmapViewOfFile(map_);
+	if (mapping_) CloseHandle((HANDLE)mapping_);
+	if (file_) CloseHandle((HANDLE)file_);
+	file_ = nullptr;
+	mapping_ = nullptr;
+#else
+	if (map_) munmap((void*)map_, map_size_);
+#endif
+	map_ = nullptr;
+	map_size_ = 0;
+	frames_ = 0;
+	partitions_.clear();
+}
+
+int SnapshotReader::step(int frame_index) const
+{
+	int32_t time_step;
+	memcpy(&time_step, frame(frame_index), sizeof(int32_t));
+	return time_step;
+}
+
+int SnapshotReader::Find(int time_step) const
+{
+	// Steps grow with the frame index, so binary search touches log2(frames) pages.
+	int lo = 0, hi = frames_ - 1, found = -1;
+	while (lo <= hi)
+	{
+		int mid = (lo + hi) / 2;
+		if (step(mid) <= time_step)
+		{
+			found = mid;
+			lo = mid + 1;
+		}
+		else
+		{
+			hi = mid - 1;
+		}
+	}
+	return found;
+}
+
+void SnapshotReader::Decode(int frame_index, int partition_index, real_t* out) const
+{
+	const PartitionInfo& p = partitions_[partition_index];
+	const uint8_t* section = frame(frame_index) + p.offset;
+	const float* scales = (const float*)section;
+	const uint8_t* codes = section + SnapshotWriter::BlockCount(p.width, p.height, p.depth, block_) * sizeof(float);
+	if (bits_ == 16)
+		Dequantise(scales, (const int16_t*)codes, p.width, p.height, p.depth, block_, out);
+	else
+		Dequantise(scales, (const int8_t*)codes, p.width, p.height, p.depth, block_, out);
+}
+
+real_t SnapshotReader::Value(int frame_index, int x, int y, int z) const
+{
+	for (const PartitionInfo& p : partitions_)
+	{
+		int lx = x - p.x_start, ly = y - p.y_start, lz = z - p.z_start;
+		if (lx < 0 || lx >= p.width || ly < 0 || ly >= p.height || lz < 0 || lz >= p.depth)
+		{
+			continue;
+		}
+		const uint8_t* section = frame(frame_index) + p.offset;
+		const float* scales = (const float*)section;
+		const uint8_t* codes = section + SnapshotWriter::BlockCount(p.width, p.height, p.depth, block_) * sizeof(float);
+		size_t cell = ((size_t)lz * p.height + ly) * p.width + lx;
+		size_t block = ((size_t)(lz / block_) * ((p.height + block_ - 1) / block_) + ly / block_) * ((p.width + block_ - 1) / block_) + lx / block_;
+		int code = bits_ == 16 ? ((const int16_t*)codes)[cell] : ((const int8_t*)codes)[cell];
+		return code * scales[block];
+	}
+	return 0.0f;
+}
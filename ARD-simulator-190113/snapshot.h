@@ -0,0 +1,135 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "types.h"
+#include "spsc_queue.h"
+
+class Partition;
+
+/* Whole-field snapshots every N steps, for offline animation and debugging.
+ *
+ * Each partition's pressure is split into block^3 cubes; every cube stores one float scale
+ * (max |p| / (2^(bits-1) - 1)) and the cells as signed 8- or 16-bit codes, p = code * scale.
+ * That is 4x or 2x smaller than floats with an error of at most scale / 2 per cell.
+ *
+ * All frames have the same size, so frame k starts at data_offset + k * frame_bytes and a reader
+ * can map the file and jump to any step. Capture() quantises straight from the pressure arrays
+ * (OpenMP over partitions) into one of a fixed number of frame buffers and hands it to a background
+ * writer thread, so memory stays bounded by buffers * frame_bytes; when the disk falls behind the
+ * solver waits for a free buffer instead of dropping frames.
+ *
+ * snapshots.bin (native little-endian):
+ *   header:    "ARDSNP\0\1", int32 version (1), num_partitions, bits, block, every, total_steps,
+ *              float dh, dt, c0, int32 field, int64 frame_bytes, data_offset
+ *   partition: int32 x_start, y_start, z_start, width, height, depth (cells), int64 offset in the frame
+ *              (num_partitions times)
+ *   frames:    at data_offset, frame_bytes each: int32 time_step, int32 0, then per partition at its offset
+ *              float scale[blocks], code[width * height * depth] (z, y, x order), padded to 8 bytes;
+ *              blocks are numbered (bz * blocks_y + by) * blocks_x + bx
+ * SnapshotReader and matlab/read_snapshot.m read it back.
+ */
+class SnapshotWriter
+{
+public:
+	struct Settings
+	{
+		int every{ 10 };	// steps between snapshots
+		int bits{ 8 };		// 8 or 16
+		int block{ 8 };		// edge of the cubes sharing a scale
+		int buffers{ 4 };	// frames in flight between the solver and the writer
+		int field{ 0 };		// which field with batched sources
+	};
+
+	SnapshotWriter(const std::string& path, const Settings& settings);
+	~SnapshotWriter();
+
+	bool Start(const std::vector<std::shared_ptr<Partition>>& partitions);
+	void Capture(const std::vector<std::shared_ptr<Partition>>& partitions, int time_step);	// solver thread, after Update()
+	void Close();	// writes the frames still queued, joins the writer and closes the file
+
+	static size_t BlockCount(int width, int height, int depth, int block);
+
+private:
+	struct Frame
+	{
+		int time_step{ 0 };
+		std::vector<uint8_t> data;
+	};
+
+	void Run();
+
+	std::string path_;
+	Settings settings_;
+	std::vector<int64_t> offsets_;		// per partition, into the frame
+	int64_t frame_bytes_{ 0 };
+
+	std::vector<std::unique_ptr<Frame>> storage_;
+	SpscQueue<Frame*> full_;
+	SpscQueue<Frame*> empty_;
+	FILE* file_{ nullptr };
+	std::vector<char> file_buffer_;
+	std::thread thread_;
+	std::atomic<bool> running_{ false };
+	bool failed_{ false };
+};
+
+/* Read-only memory-mapped snapshots.bin. Only the frames and partitions asked for are touched. */
+class SnapshotReader
+{
+public:
+	struct PartitionInfo
+	{
+		int x_start, y_start, z_start;
+		int width, height, depth;
+		int64_t offset;
+	};
+
+	SnapshotReader() = default;
+	~SnapshotReader();
+	SnapshotReader(const SnapshotReader&) = delete;
+	SnapshotReader& operator=(const SnapshotReader&) = delete;
+
+	bool Open(const std::string& path);
+	void Close();
+
+	int frames() const
+	{
+		return frames_;
+	}
+	int partitions() const
+	{
+		return (int)partitions_.size();
+	}
+	const PartitionInfo& partition(int i) const
+	{
+		return partitions_[i];
+	}
+	int step(int frame) const;
+	int Find(int time_step) const;	// frame holding that step, or the last one before it; -1 if none
+
+	// One partition of one frame, width * height * depth values in z, y, x order.
+	void Decode(int frame, int partition, real_t* out) const;
+	real_t Value(int frame, int x, int y, int z) const;	// global cell, 0 outside every partition
+
+private:
+	const uint8_t* map_{ nullptr };
+	size_t map_size_{ 0 };
+	int bits_{ 0 }, block_{ 0 };
+	int64_t frame_bytes_{ 0 }, data_offset_{ 0 };
+	int frames_{ 0 };
+	std::vector<PartitionInfo> partitions_;
+#ifdef _WIN32
+	void* file_{ nullptr };
+	void* mapping_{ nullptr };
+#endif
+
+	const uint8_t* frame(int k) const
+	{
+		return map_ + data_offset_ + (size_t)k * frame_bytes_;
+	}
+};
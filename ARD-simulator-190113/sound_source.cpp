@@ -1,19 +1,17 @@
 #include "sound_source.h"
 #include "gaussian_source.h"
+#include "wav_source.h"
 #include "simulation.h"
 #include "partition.h"
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
 #include <iostream>
+#include <sstream>
 
 
-SoundSource::SoundSource(int x, int y, int z) :x_(x), y_(y), z_(z)
+SoundSource::SoundSource(int x, int y, int z) :id_(0), x_(x), y_(y), z_(z)
 {
-	static int id_generator = 0;
-	id_ = id_generator++;
-	std::string filename;
-	std::string dir_name = std::to_string(Simulation::m_dh) + "_" + std::to_string(Partition::m_absorption);
-	filename = "./output/" + dir_name + "/source_" + std::to_string(id_) + ".txt";
-	source_.open(filename, std::ios::out);
-
 }
 
 
@@ -21,37 +19,115 @@ SoundSource::~SoundSource()
 {
 }
 
-std::vector<std::shared_ptr<SoundSource>> SoundSource::ImportSources(std::string path)
+void SoundSource::Fill(int first, int count, real_t* out)
+{
+	for (int i = 0; i < count; i++)
+	{
+		out[i] = SampleValue((real_t)(first + i));
+	}
+}
+
+void SoundSource::Prepare(int total_steps)
+{
+	table_.assign(block_steps_ > 0 ? block_steps_ : std::max(1, total_steps), 0.0f);
+	Refill(0);
+}
+
+void SoundSource::Refill(int step)
+{
+	if (table_.empty())
+	{
+		table_.assign(block_steps_ > 0 ? block_steps_ : 1, 0.0f);	// Sample without Prepare: one step at a time
+	}
+	table_first_ = step;
+	Fill(step, (int)table_.size(), table_.data());
+}
+
+std::vector<std::shared_ptr<SoundSource>> SoundSource::ImportSources(const SimulationConfig& config, std::string path)
 {
 	std::vector<std::shared_ptr<SoundSource>> sources;
 
 	std::ifstream file;
 	file.open(path, std::ifstream::in);
-	while (file.good())
+	std::string line;
+	while (std::getline(file, line))
 	{
+		std::istringstream fields(line);
 		int x, y, z;
-		file >> x >> y >> z;
-		if (file.eof()) break;
+		if (!(fields >> x >> y >> z)) continue;
 
-		float const xh = x / Simulation::m_dh;
-		float const yh = y / Simulation::m_dh;
-		float const zh = z / Simulation::m_dh;
+		float const xh = x / config.dh;
+		float const yh = y / config.dh;
+		float const zh = z / config.dh;
 
-		sources.push_back(std::make_shared<GaussianSource>((int)xh, (int)yh, (int)zh));
+		std::string wav_path;
+		if (fields >> wav_path)
+		{
+			int channel = 0;
+			WavSource::Settings settings;
+			fields >> channel >> settings.gain;
+			auto source = std::make_shared<WavSource>((int)xh, (int)yh, (int)zh, wav_path, channel, settings, config);
+			if (!source->ok())
+			{
+				std::cout << "Cannot read " << wav_path << ", source at " << x << "," << y << "," << z << " skipped." << std::endl;
+				continue;
+			}
+			source->id_ = (int)sources.size();
+			sources.push_back(source);
+			continue;
+		}
+		sources.push_back(std::make_shared<GaussianSource>((int)xh, (int)yh, (int)zh, config));
+		sources.back()->id_ = (int)sources.size() - 1;
 	}
 	file.close();
-	for (auto source : sources)
-	{
-		source->RecordSource();
-	}
 	return sources;
 }
 
-void SoundSource::RecordSource()
+void SoundSource::BatchSources(std::vector<std::shared_ptr<SoundSource>>& sources, bool batch, SimulationConfig& config)
 {
-	for (int t = 0; t < Simulation::m_duration / Simulation::m_dt; t++)
+	if (!batch || sources.size() < 2)
 	{
-		source_ << this->SampleValue((real_t)t) << std::endl;
+		return;
 	}
-	source_.close();
+	for (int i = 0; i < (int)sources.size(); i++)
+	{
+		sources[i]->set_field(i);
+	}
+	config.fields = (int)sources.size();
+}
+
+std::future<bool> SoundSource::ExportSources(const std::vector<std::shared_ptr<SoundSource>>& sources, const std::string& path, const SimulationConfig& config)
+{
+	int total_steps = config.total_steps();
+	float dt = config.dt;
+	return std::async(std::launch::async, [sources, path, total_steps, dt]()
+	{
+		FILE* file = fopen(path.c_str(), "wb");
+		if (!file)
+		{
+			return false;
+		}
+		const char magic[8] = { 'A', 'R', 'D', 'S', 'R', 'C', 0, 1 };
+		int32_t header[3] = { 1, (int32_t)sources.size(), total_steps };
+		fwrite(magic, 1, sizeof(magic), file);
+		fwrite(header, sizeof(int32_t), 3, file);
+		fwrite(&dt, sizeof(float), 1, file);
+		for (auto& source : sources)
+		{
+			int32_t info[5] = { source->id_, source->x_, source->y_, source->z_, source->field_ };
+			fwrite(info, sizeof(int32_t), 5, file);
+		}
+		const int block = 1 << 16;
+		std::vector<real_t> buffer(block);
+		for (auto& source : sources)
+		{
+			for (int first = 0; first < total_steps; first += block)
+			{
+				int count = std::min(block, total_steps - first);
+				source->Fill(first, count, buffer.data());
+				fwrite(buffer.data(), sizeof(real_t), count, file);
+			}
+		}
+		return fclose(file) == 0;
+	});
 }
@@ -2,24 +2,66 @@
 #include <vector>
 #include <string>
 #include <memory>
-#include <fstream>
+#include <future>
 #include "types.h"
+#include "simulation_config.h"
 
+/* Sources are injected from a waveform table instead of evaluating SampleValue every step.
+ * Analytic sources fill the whole run once (Prepare); streamed ones (WavSource) set block_steps_
+ * and refill a block of that many steps whenever the step leaves it. Fill() is the only producer
+ * and must be safe to call concurrently with the simulation (the asynchronous dump uses it).
+ */
 class SoundSource
 {
 	int id_;
 	int x_, y_, z_;
-	std::fstream source_;
+	int field_{ 0 };	// which of the partitions' fields it drives (batched sources)
+
+	std::vector<real_t> table_;
+	int table_first_{ 0 };	// step of table_[0]
+
+	void Refill(int step);
+
+protected:
+	int block_steps_{ 0 };	// 0: the whole run in one table
 
 public:
 	SoundSource(int x, int y, int z);
-	~SoundSource();
+	virtual ~SoundSource();
+
+	virtual real_t SampleValue(real_t t) = 0;	// t in time steps
+	virtual void Fill(int first, int count, real_t* out);	// steps [first, first + count)
+
+	void Prepare(int total_steps);	// before the first Sample
+	real_t Sample(int step)
+	{
+		if ((unsigned)(step - table_first_) >= table_.size())
+		{
+			Refill(step);
+		}
+		return table_[step - table_first_];
+	}
 
-	virtual real_t SampleValue(real_t t) = 0;
+	/* One source per line, positions in metres: "x y z" for a Gaussian pulse, or
+	 * "x y z file.wav [channel] [gain]" for a WAV-driven source (see WavSource).
+	 * Sources are numbered in file order.
+	 */
+	static std::vector<std::shared_ptr<SoundSource>> ImportSources(const SimulationConfig& config, std::string path);
 
-	static std::vector<std::shared_ptr<SoundSource>> ImportSources(std::string path);
+	/* Batched sources (batch and at least two): source i drives field i of every partition and
+	 * config.fields becomes the source count, so K sources cost one run with K-wide transforms and
+	 * interfaces instead of K runs. Before the partitions are created, they size their fields by it.
+	 */
+	static void BatchSources(std::vector<std::shared_ptr<SoundSource>>& sources, bool batch, SimulationConfig& config);
 
-	void RecordSource();
+	/* Writes every source's waveform (config.total_steps() steps) to path from a background thread, after Prepare.
+	 * sources.bin (native little-endian, 4-byte fields):
+	 *   header: "ARDSRC\0\1", version (1), num_sources, total_steps, dt
+	 *   source: id, x, y, z (cells), field                 (num_sources times)
+	 *   data:   waveform[num_sources][total_steps]
+	 * matlab/read_sources.m reads it back.
+	 */
+	static std::future<bool> ExportSources(const std::vector<std::shared_ptr<SoundSource>>& sources, const std::string& path, const SimulationConfig& config);
 
 	int x() {
 		return x_;
@@ -30,6 +72,18 @@ public:
 	int z() {
 		return z_;
 	}
+	int id() {
+		return id_;
+	}
+	int field() {
+		return field_;
+	}
+	void set_field(int field) {
+		field_ = field;
+	}
+	void set_id(int id) {
+		id_ = id;
+	}
 
 	friend class Simulation;
 	friend class Partition;
@@ -0,0 +1,54 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+/* Bounded lock-free single-producer/single-consumer ring.
+ *
+ * One thread calls Push, one (other) thread calls Pop. Capacity is rounded up to a power of two;
+ * one slot stays empty to tell full from empty. Head and tail live on separate cache lines so the
+ * two sides do not false-share.
+ */
+template <typename T>
+class SpscQueue
+{
+	std::vector<T> slots_;
+	size_t mask_;
+	alignas(64) std::atomic<size_t> head_{ 0 };	// next slot to pop, written by the consumer
+	alignas(64) std::atomic<size_t> tail_{ 0 };	// next slot to push, written by the producer
+
+public:
+	explicit SpscQueue(size_t capacity)
+	{
+		size_t size = 2;
+		while (size < capacity + 1) size <<= 1;
+		slots_.resize(size);
+		mask_ = size - 1;
+	}
+
+	bool Push(const T& value)
+	{
+		size_t tail = tail_.load(std::memory_order_relaxed);
+		size_t next = (tail + 1) & mask_;
+		if (next == head_.load(std::memory_order_acquire))
+			return false;	// full
+		slots_[tail] = value;
+		tail_.store(next, std::memory_order_release);
+		return true;
+	}
+
+	bool Pop(T& value)
+	{
+		size_t head = head_.load(std::memory_order_relaxed);
+		if (head == tail_.load(std::memory_order_acquire))
+			return false;	// empty
+		value = slots_[head];
+		head_.store((head + 1) & mask_, std::memory_order_release);
+		return true;
+	}
+
+	bool empty() const
+	{
+		return head_.load(std::memory_order_acquire) == tail_.load(std::memory_order_acquire);
+	}
+};
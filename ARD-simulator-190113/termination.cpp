@@ -0,0 +1,186 @@
+#include "termination.h"
+#include "simulation.h"
+#include "recorder.h"
+#include "tracer.h"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+
+TerminationController::TerminationController(std::shared_ptr<Simulation> simulation, const std::vector<std::shared_ptr<Recorder>>& recorders, const Settings& settings)
+	: simulation_(simulation), settings_(settings)
+{
+	// A recorder outside every partition reads 0 forever and would never decay.
+	for (auto& recorder : recorders)
+	{
+		if (recorder->found())
+		{
+			recorders_.push_back(recorder);
+		}
+	}
+	settings_.interval = std::max(1, settings_.interval);
+	int window = std::max(1, (int)std::lround(settings_.window_seconds / (settings_.interval * simulation_->config().dt)));
+	interval_energy_.assign(recorders_.size(), 0.0);
+	ring_.assign(recorders_.size(), std::vector<double>(window, 0.0));
+	window_energy_.assign(recorders_.size(), 0.0);
+	window_peak_.assign(recorders_.size(), 0.0);
+}
+
+real_t TerminationController::RecorderLevel(size_t i) const
+{
+	if (window_peak_[i] <= 0.0)
+	{
+		return 0.0f;
+	}
+	return (real_t)(10.0 * log10(std::max(window_energy_[i], 1e-300) / window_peak_[i]));
+}
+
+// dB per second of the energy decay fitted so far, and its coefficient of determination.
+real_t TerminationController::Slope(real_t* r2) const
+{
+	*r2 = 0.0f;
+	if (n_ < 3)
+	{
+		return 0.0f;
+	}
+	double cxx = n_ * sxx_ - sx_ * sx_;
+	double cyy = n_ * syy_ - sy_ * sy_;
+	double cxy = n_ * sxy_ - sx_ * sy_;
+	if (cxx <= 0.0 || cyy <= 0.0)
+	{
+		return 0.0f;
+	}
+	*r2 = (real_t)(cxy * cxy / (cxx * cyy));
+	return (real_t)(cxy / cxx);
+}
+
+bool TerminationController::Update(int time_step)
+{
+	if (stopped_)
+	{
+		return true;
+	}
+	for (size_t i = 0; i < recorders_.size(); i++)
+	{
+		double p = recorders_[i]->pressure();
+		interval_energy_[i] += p * p;
+	}
+	if ((time_step + 1) % settings_.interval != 0)
+	{
+		return false;
+	}
+
+	TraceSpan span("termination");
+	real_t t = (time_step + 1) * simulation_->config().dt;
+
+	// Recorders: slide the window by one interval.
+	bool recorders_deep = true, recorders_reliable = true;
+	for (size_t i = 0; i < recorders_.size(); i++)
+	{
+		double& slot = ring_[i][ring_pos_];
+		window_energy_[i] = std::max(0.0, window_energy_[i] - slot + interval_energy_[i]);
+		slot = interval_energy_[i];
+		interval_energy_[i] = 0.0;
+		window_peak_[i] = std::max(window_peak_[i], window_energy_[i]);
+		real_t level = RecorderLevel(i);
+		recorders_deep = recorders_deep && level <= -settings_.decay_db;
+		recorders_reliable = recorders_reliable && level <= -settings_.reliable_db;
+	}
+	if (!recorders_.empty())
+	{
+		ring_pos_ = (ring_pos_ + 1) % (int)ring_[0].size();
+	}
+
+	// Total energy in mode space.
+	double energy = energy_tracked_ ? simulation_->Energy() : -1.0;
+	energy_tracked_ = energy >= 0.0;
+	if (energy_tracked_)
+	{
+		if (energy > energy_peak_)
+		{
+			energy_peak_ = energy;
+			sx_ = sy_ = sxx_ = sxy_ = syy_ = 0.0;	// the decay starts over from a new peak
+			n_ = 0;
+		}
+		energy_db_ = energy_peak_ > 0.0 ? (real_t)(10.0 * log10(std::max(energy, 1e-300) / energy_peak_)) : 0.0f;
+		if (energy_db_ <= -5.0f)
+		{
+			sx_ += t;
+			sy_ += energy_db_;
+			sxx_ += (double)t * t;
+			sxy_ += (double)t * energy_db_;
+			syy_ += (double)energy_db_ * energy_db_;
+			n_++;
+		}
+	}
+
+	if (t < settings_.min_seconds)
+	{
+		return false;
+	}
+	if (energy_tracked_)
+	{
+		if (energy_db_ <= -settings_.decay_db && recorders_deep)
+		{
+			reason_ = "energy and recorders decayed by " + std::to_string((int)settings_.decay_db) + " dB";
+			stopped_ = true;
+		}
+		else if (settings_.extrapolate && energy_db_ <= -settings_.reliable_db && recorders_reliable)
+		{
+			real_t r2;
+			Slope(&r2);
+			if (r2 >= settings_.min_r2)
+			{
+				reason_ = "energy decay extrapolated from " + std::to_string((int)settings_.reliable_db) + " dB";
+				stopped_ = true;
+			}
+		}
+	}
+	else if (!recorders_.empty() && recorders_deep)
+	{
+		reason_ = "recorders decayed by " + std::to_string((int)settings_.decay_db) + " dB";
+		stopped_ = true;
+	}
+	if (stopped_)
+	{
+		stop_step_ = time_step;
+		Info();
+	}
+	return stopped_;
+}
+
+void TerminationController::Info()
+{
+	int total_steps = simulation_->total_steps();
+	std::cout << "# Early termination. #######################################" << std::endl;
+	if (!stopped_)
+	{
+		std::cout << "Not triggered";
+		if (!energy_tracked_ && recorders_.empty())
+		{
+			std::cout << " (no energy on the GPU path and no recorders to watch)";
+		}
+		std::cout << "." << std::endl;
+	}
+	else
+	{
+		std::cout << "Stopped at step " << stop_step_ << "/" << total_steps << " (" << (stop_step_ + 1) * simulation_->config().dt << " s): " << reason_ << "." << std::endl;
+		std::cout << "Saved " << 100.0f * (1.0f - (real_t)(stop_step_ + 1) / total_steps) << "% of the steps." << std::endl;
+	}
+	if (energy_tracked_)
+	{
+		real_t r2;
+		real_t slope = Slope(&r2);
+		std::cout << "Energy: " << energy_db_ << " dB";
+		if (slope < 0.0f)
+		{
+			std::cout << ", T60 estimate " << -60.0f / slope << " s (r^2 " << r2 << ")";
+		}
+		std::cout << std::endl;
+	}
+	for (size_t i = 0; i < recorders_.size(); i++)
+	{
+		std::cout << "Recorder " << recorders_[i]->id() << ": " << RecorderLevel(i) << " dB" << std::endl;
+	}
+	std::cout << "############################################################" << std::endl;
+}
@@ -0,0 +1,67 @@
+#pragma once
+#include <memory>
+#include <string>
+#include <vector>
+#include "types.h"
+
+class Simulation;
+class Recorder;
+
+/* Ends a run once the room has decayed, instead of always running duration / dt steps.
+ *
+ * Every interval steps it reads the total acoustic energy, computed in mode space from the DCT
+ * partitions (Simulation::Energy), and each recorder's energy over a sliding window. Levels are
+ * taken relative to their peaks. The run stops when
+ *  - the energy and every recorder are decay_db below their peaks, or
+ *  - (extrapolate) the energy and every recorder are reliable_db down and a straight line fits the
+ *    energy decay (in dB, from -5 dB) with r^2 >= min_r2: the rest of the decay is then predictable,
+ *    and the line's slope is reported as the T60 estimate.
+ * With GPU partitions the energy is not available; only the recorders' depth criterion applies.
+ * Recorders outside every partition are ignored.
+ */
+class TerminationController
+{
+public:
+	struct Settings
+	{
+		real_t decay_db{ 60.0f };
+		bool extrapolate{ true };
+		real_t reliable_db{ 30.0f };
+		real_t min_r2{ 0.995f };
+		int interval{ 16 };					// steps between checks
+		real_t window_seconds{ 0.02f };		// recorder energy window
+		real_t min_seconds{ 0.05f };		// never stop before (source still ramping up)
+	};
+
+	TerminationController(std::shared_ptr<Simulation> simulation, const std::vector<std::shared_ptr<Recorder>>& recorders, const Settings& settings);
+
+	// Call once per step, after Simulation::Update(); true when the run can end.
+	bool Update(int time_step);
+	void Info();
+
+private:
+	std::shared_ptr<Simulation> simulation_;
+	std::vector<std::shared_ptr<Recorder>> recorders_;
+	Settings settings_;
+
+	bool stopped_{ false };
+	std::string reason_;
+	int stop_step_{ -1 };
+
+	// Total energy: peak and a running least-squares fit of level (dB) against time since the peak.
+	bool energy_tracked_{ true };
+	double energy_peak_{ 0.0 };
+	real_t energy_db_{ 0.0f };
+	double sx_{ 0 }, sy_{ 0 }, sxx_{ 0 }, sxy_{ 0 }, syy_{ 0 };
+	int n_{ 0 };
+
+	// Recorders: energy of the current interval, ring of the last windows' intervals, window peak.
+	std::vector<double> interval_energy_;
+	std::vector<std::vector<double>> ring_;
+	std::vector<double> window_energy_;
+	std::vector<double> window_peak_;
+	int ring_pos_{ 0 };
+
+	real_t RecorderLevel(size_t i) const;
+	real_t Slope(real_t* r2) const;
+};
@@ -0,0 +1,93 @@
+#include "tracer.h"
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <limits>
+
+std::atomic<bool> Tracer::m_enabled{ false };
+std::atomic<int> Tracer::m_step{ 0 };
+size_t Tracer::m_capacity = 1 << 16;
+std::mutex Tracer::m_register_mutex;
+std::vector<std::unique_ptr<Tracer::ThreadBuffer>> Tracer::m_buffers;
+
+void Tracer::Enable(size_t events_per_thread)
+{
+	m_capacity = std::max<size_t>(events_per_thread, 1);
+	m_enabled.store(true, std::memory_order_relaxed);
+}
+
+Tracer::ThreadBuffer* Tracer::LocalBuffer()
+{
+	thread_local ThreadBuffer* buffer = nullptr;
+	if (!buffer)
+	{
+		std::lock_guard<std::mutex> lock(m_register_mutex);
+		m_buffers.push_back(std::make_unique<ThreadBuffer>());
+		buffer = m_buffers.back().get();
+		buffer->tid = (int)m_buffers.size() - 1;
+		buffer->events.resize(m_capacity);
+	}
+	return buffer;
+}
+
+void Tracer::Record(const char* name, int64_t start_ns, int64_t end_ns, int id)
+{
+	ThreadBuffer* buffer = LocalBuffer();
+	uint64_t head = buffer->head.load(std::memory_order_relaxed);
+	Event& e = buffer->events[head % buffer->events.size()];	// oldest events are overwritten when full
+	e.name = name;
+	e.start_ns = start_ns;
+	e.end_ns = end_ns;
+	e.id = id;
+	e.step = m_step.load(std::memory_order_relaxed);
+	buffer->head.store(head + 1, std::memory_order_release);
+}
+
+bool Tracer::Export(std::string path)
+{
+	std::lock_guard<std::mutex> lock(m_register_mutex);
+
+	int64_t origin = std::numeric_limits<int64_t>::max();
+	for (auto& buffer : m_buffers)
+	{
+		uint64_t head = buffer->head.load(std::memory_order_acquire);
+		uint64_t count = std::min<uint64_t>(head, buffer->events.size());
+		for (uint64_t i = head - count; i < head; i++)
+		{
+			origin = std::min(origin, buffer->events[i % buffer->events.size()].start_ns);
+		}
+	}
+
+	std::ofstream file(path, std::ios::out);
+	if (!file.good())
+	{
+		std::cout << "Cannot write trace to " << path << std::endl;
+		return false;
+	}
+
+	// Complete events ("ph":"X"), timestamps in microseconds.
+	file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+	bool first = true;
+	size_t total = 0;
+	for (auto& buffer : m_buffers)
+	{
+		uint64_t head = buffer->head.load(std::memory_order_acquire);
+		uint64_t count = std::min<uint64_t>(head, buffer->events.size());
+		for (uint64_t i = head - count; i < head; i++)
+		{
+			const Event& e = buffer->events[i % buffer->events.size()];
+			file << (first ? "\n" : ",\n");
+			file << "{\"name\":\"" << e.name << "\",\"ph\":\"X\",\"pid\":0,\"tid\":" << buffer->tid
+				<< ",\"ts\":" << (e.start_ns - origin) / 1000.0
+				<< ",\"dur\":" << (e.end_ns - e.start_ns) / 1000.0
+				<< ",\"args\":{\"id\":" << e.id << ",\"step\":" << e.step << "}}";
+			first = false;
+			total++;
+		}
+	}
+	file << "\n]}\n";
+	file.close();
+
+	std::cout << "Trace: " << total << " spans from " << m_buffers.size() << " threads -> " << path << std::endl;
+	return true;
+}
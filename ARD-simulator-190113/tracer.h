@@ -0,0 +1,84 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/* Low-overhead span tracing.
+ *
+ * Every thread writes its spans into its own ring buffer (single writer, no locks on the hot path),
+ * the buffers are only walked by Export() once the run is finished.
+ * The output is Chrome-trace JSON, it can be opened with chrome://tracing or https://ui.perfetto.dev
+ */
+class Tracer
+{
+public:
+	struct Event
+	{
+		const char* name;	// string literal, never copied
+		int64_t start_ns;
+		int64_t end_ns;
+		int id;				// partition / boundary / recorder id, -1 if none
+		int step;
+	};
+
+	static void Enable(size_t events_per_thread = 1 << 16);
+	static bool enabled()
+	{
+		return m_enabled.load(std::memory_order_relaxed);
+	}
+	static void SetStep(int step)
+	{
+		m_step.store(step, std::memory_order_relaxed);
+	}
+	static int64_t Now()
+	{
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	static void Record(const char* name, int64_t start_ns, int64_t end_ns, int id);
+	static bool Export(std::string path);
+
+private:
+	struct ThreadBuffer
+	{
+		int tid;
+		std::vector<Event> events;
+		std::atomic<uint64_t> head{ 0 };	// total number of events written, wraps around events.size()
+	};
+
+	static ThreadBuffer* LocalBuffer();
+
+	static std::atomic<bool> m_enabled;
+	static std::atomic<int> m_step;
+	static size_t m_capacity;
+	static std::mutex m_register_mutex;	// only taken once per thread
+	static std::vector<std::unique_ptr<ThreadBuffer>> m_buffers;
+};
+
+/* RAII span: TraceSpan span("dct", partition_id); */
+class TraceSpan
+{
+	const char* name_;
+	int id_;
+	int64_t start_;
+
+public:
+	TraceSpan(const char* name, int id = -1)
+		: name_(name), id_(id), start_(Tracer::enabled() ? Tracer::Now() : 0)
+	{
+	}
+	~TraceSpan()
+	{
+		if (start_ != 0)
+		{
+			Tracer::Record(name_, start_, Tracer::Now(), id_);
+		}
+	}
+	TraceSpan(const TraceSpan&) = delete;
+	TraceSpan& operator=(const TraceSpan&) = delete;
+};
@@ -1,3 +1,4 @@
+#ifndef ARD_NO_VULKAN	// CPU-only builds get the stubs in utils_VkFFT.h
 #include <stdio.h>
 #include <vector>
 #include <memory>
@@ -5,6 +6,8 @@
 #include <chrono>
 #include <thread>
 #include <iostream>
+#include <mutex>
+#include <cmath>
 #ifndef __STDC_FORMAT_MACROS
 #define __STDC_FORMAT_MACROS
 #endif
@@ -688,4 +691,367 @@ VkFFTResult VkFFT_DCT::execute()
 	assert(result == VKFFT_SUCCESS);
 
 	return result;
-}
\ No newline at end of file
+}
+
+static std::mutex s_queueMutex;	// vkQueueSubmit needs external synchronization, partitions update in parallel
+
+VkFFTResult submitToQueue(VkGPU* vkGPU, VkCommandBuffer commandBuffer, VkFence fence)
+{
+	VkSubmitInfo submitInfo = { VK_STRUCTURE_TYPE_SUBMIT_INFO };
+	submitInfo.commandBufferCount = 1;
+	submitInfo.pCommandBuffers = &commandBuffer;
+	{
+		std::lock_guard<std::mutex> lock(s_queueMutex);
+		VkResult res = vkQueueSubmit(vkGPU->queue, 1, &submitInfo, fence);
+		if (res != VK_SUCCESS) return VKFFT_ERROR_FAILED_TO_SUBMIT_QUEUE;
+	}
+	VkResult res = vkWaitForFences(vkGPU->device, 1, &fence, VK_TRUE, 100000000000);
+	if (res != VK_SUCCESS) return VKFFT_ERROR_FAILED_TO_WAIT_FOR_FENCES;
+	res = vkResetFences(vkGPU->device, 1, &fence);
+	if (res != VK_SUCCESS) return VKFFT_ERROR_FAILED_TO_RESET_FENCES;
+	return VKFFT_SUCCESS;
+}
+
+VkFFTResult compileComputeShader(VkGPU* vkGPU, const char* code, std::vector<uint32_t>& spirv)
+{
+	// Same glslang path VkFFT uses for its own kernels, only the limits a compute shader needs are set.
+	glslang_resource_t resource = {};
+	resource.max_compute_work_group_count_x = (int)vkGPU->physicalDeviceProperties.limits.maxComputeWorkGroupCount[0];
+	resource.max_compute_work_group_count_y = (int)vkGPU->physicalDeviceProperties.limits.maxComputeWorkGroupCount[1];
+	resource.max_compute_work_group_count_z = (int)vkGPU->physicalDeviceProperties.limits.maxComputeWorkGroupCount[2];
+	resource.max_compute_work_group_size_x = (int)vkGPU->physicalDeviceProperties.limits.maxComputeWorkGroupSize[0];
+	resource.max_compute_work_group_size_y = (int)vkGPU->physicalDeviceProperties.limits.maxComputeWorkGroupSize[1];
+	resource.max_compute_work_group_size_z = (int)vkGPU->physicalDeviceProperties.limits.maxComputeWorkGroupSize[2];
+	resource.max_compute_uniform_components = 1024;
+	resource.limits.non_inductive_for_loops = 1;
+	resource.limits.while_loops = 1;
+	resource.limits.do_while_loops = 1;
+	resource.limits.general_uniform_indexing = 1;
+	resource.limits.general_variable_indexing = 1;
+
+	glslang_input_t input = {};
+	input.language = GLSLANG_SOURCE_GLSL;
+	input.stage = GLSLANG_STAGE_COMPUTE;
+	input.client = GLSLANG_CLIENT_VULKAN;
+	input.client_version = GLSLANG_TARGET_VULKAN_1_0;
+	input.target_language = GLSLANG_TARGET_SPV;
+	input.target_language_version = GLSLANG_TARGET_SPV_1_0;
+	input.code = code;
+	input.default_version = 450;
+	input.default_profile = GLSLANG_NO_PROFILE;
+	input.force_default_version_and_profile = 1;
+	input.forward_compatible = 0;
+	input.messages = GLSLANG_MSG_DEFAULT_BIT;
+	input.resource = &resource;
+
+	glslang_shader_t* shader = glslang_shader_create(&input);
+	if (!glslang_shader_preprocess(shader, &input) || !glslang_shader_parse(shader, &input))
+	{
+		printf("%s\n", glslang_shader_get_info_log(shader));
+		glslang_shader_delete(shader);
+		return VKFFT_ERROR_FAILED_SHADER_PARSE;
+	}
+	glslang_program_t* program = glslang_program_create();
+	glslang_program_add_shader(program, shader);
+	if (!glslang_program_link(program, GLSLANG_MSG_SPV_RULES_BIT | GLSLANG_MSG_VULKAN_RULES_BIT))
+	{
+		printf("%s\n", glslang_program_get_info_log(program));
+		glslang_shader_delete(shader);
+		glslang_program_delete(program);
+		return VKFFT_ERROR_FAILED_SHADER_LINK;
+	}
+	glslang_program_SPIRV_generate(program, input.stage);
+	uint32_t* words = glslang_program_SPIRV_get_ptr(program);
+	spirv.assign(words, words + glslang_program_SPIRV_get_size(program));
+	glslang_shader_delete(shader);
+	glslang_program_delete(program);
+	return VKFFT_SUCCESS;
+}
+
+// next = damping * (2 * p * cwt - prev + 2 * f * (1 - cwt) / w^2), with 2 * (1 - cwt) / w^2 precomputed as coef.
+// The DCT normalization of the forcing modes and the IDCT normalization of the pressure are folded in here.
+static const char* s_ardUpdateShader = R"(
+#version 450
+layout (local_size_x = 256) in;
+layout (std430, binding = 0) readonly buffer ForceModes { float force[]; };
+layout (std430, binding = 1) buffer Modes { float modes[]; };
+layout (std430, binding = 2) buffer PrevModes { float prev[]; };
+layout (std430, binding = 3) readonly buffer Cwt { float cwt[]; };
+layout (std430, binding = 4) readonly buffer Coef { float coef[]; };
+layout (std430, binding = 5) writeonly buffer Pressure { float pressure[]; };
+layout (push_constant) uniform PushConstants
+{
+	uint total;
+	float dctScale;
+	float idctScale;
+	float damping;
+} pc;
+void main()
+{
+	uint i = gl_GlobalInvocationID.x;
+	if (i >= pc.total) return;
+	float p = modes[i];
+	float next = pc.damping * (2.0 * p * cwt[i] - prev[i] + pc.dctScale * force[i] * coef[i]);
+	prev[i] = p;
+	modes[i] = next;
+	pressure[i] = pc.idctScale * next;
+}
+)";
+
+struct ArdUpdatePushConstants
+{
+	uint32_t total;
+	float dctScale;
+	float idctScale;
+	float damping;
+};
+
+VkFFT_ArdStep::VkFFT_ArdStep(VkGPU* vkGPU, int width, int height, int depth, const float* cwt, const float* w2, float* force, float* pressure)
+	: m_vkGPU(vkGPU)
+	, m_width(width)
+	, m_height(height)
+	, m_depth(depth)
+	, m_force(force)
+	, m_pressure(pressure)
+{
+	uint64_t const total = (uint64_t)width * height * depth;
+	m_bufferSize = sizeof(float) * total;
+
+	VkFFTResult resFFT = VKFFT_SUCCESS;
+	for (int i = 0; i < B_COUNT; i++)
+	{
+		resFFT = allocateBuffer(vkGPU, &m_buffers[i], &m_bufferMemory[i],
+								VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+								VK_MEMORY_HEAP_DEVICE_LOCAL_BIT, m_bufferSize);
+		assert(resFFT == VKFFT_SUCCESS);
+	}
+	resFFT = allocateBuffer(vkGPU, &m_stagingIn, &m_stagingInMemory, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+							VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, m_bufferSize);
+	assert(resFFT == VKFFT_SUCCESS);
+	resFFT = allocateBuffer(vkGPU, &m_stagingOut, &m_stagingOutMemory, VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+							VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, m_bufferSize);
+	assert(resFFT == VKFFT_SUCCESS);
+	vkMapMemory(vkGPU->device, m_stagingInMemory, 0, m_bufferSize, 0, &m_stagingInData);
+	vkMapMemory(vkGPU->device, m_stagingOutMemory, 0, m_bufferSize, 0, &m_stagingOutData);
+
+	// Initial state: zero modes, coefficient tables uploaded once.
+	std::vector<float> table(total, 0.0f);
+	resFFT = transferDataFromCPU(vkGPU, table.data(), &m_buffers[B_MODES], m_bufferSize);
+	assert(resFFT == VKFFT_SUCCESS);
+	resFFT = transferDataFromCPU(vkGPU, table.data(), &m_buffers[B_PREV_MODES], m_bufferSize);
+	assert(resFFT == VKFFT_SUCCESS);
+	memcpy(table.data(), cwt, m_bufferSize);
+	resFFT = transferDataFromCPU(vkGPU, table.data(), &m_buffers[B_CWT], m_bufferSize);
+	assert(resFFT == VKFFT_SUCCESS);
+	for (uint64_t i = 0; i < total; i++)
+		table[i] = 2.0f * (1.0f - cwt[i]) / w2[i];
+	resFFT = transferDataFromCPU(vkGPU, table.data(), &m_buffers[B_COEF], m_bufferSize);
+	assert(resFFT == VKFFT_SUCCESS);
+
+	VkFFTConfiguration config = {};
+	config.FFTdim = 3;
+	config.size[0] = width;
+	config.size[1] = height;
+	config.size[2] = depth;
+	config.device = &vkGPU->device;
+	config.queue = &vkGPU->queue;
+	config.fence = &vkGPU->fence;
+	config.commandPool = &vkGPU->commandPool;
+	config.physicalDevice = &vkGPU->physicalDevice;
+	config.isCompilerInitialized = true;
+	config.makeForwardPlanOnly = true;
+	config.bufferSize = &m_bufferSize;
+
+	config.performDCT = 2;
+	config.buffer = &m_buffers[B_FORCE];
+	resFFT = initializeVkFFT(&m_dctApp, config);
+	assert(resFFT == VKFFT_SUCCESS);
+
+	config.performDCT = 3;
+	config.buffer = &m_buffers[B_PRESSURE];
+	resFFT = initializeVkFFT(&m_idctApp, config);
+	assert(resFFT == VKFFT_SUCCESS);
+
+	VkFenceCreateInfo fenceCreateInfo = { VK_STRUCTURE_TYPE_FENCE_CREATE_INFO };
+	vkCreateFence(vkGPU->device, &fenceCreateInfo, NULL, &m_fence);
+
+	resFFT = createUpdatePipeline();
+	assert(resFFT == VKFFT_SUCCESS);
+	resFFT = recordCommandBuffer();
+	assert(resFFT == VKFFT_SUCCESS);
+}
+
+VkFFT_ArdStep::~VkFFT_ArdStep()
+{
+	VkDevice device = m_vkGPU->device;
+	vkFreeCommandBuffers(device, m_vkGPU->commandPool, 1, &m_commandBuffer);
+	vkDestroyPipeline(device, m_pipeline, NULL);
+	vkDestroyPipelineLayout(device, m_pipelineLayout, NULL);
+	vkDestroyDescriptorPool(device, m_descriptorPool, NULL);
+	vkDestroyDescriptorSetLayout(device, m_descriptorSetLayout, NULL);
+	vkDestroyFence(device, m_fence, NULL);
+	deleteVkFFT(&m_dctApp);
+	deleteVkFFT(&m_idctApp);
+	vkUnmapMemory(device, m_stagingInMemory);
+	vkUnmapMemory(device, m_stagingOutMemory);
+	vkDestroyBuffer(device, m_stagingIn, NULL);
+	vkFreeMemory(device, m_stagingInMemory, NULL);
+	vkDestroyBuffer(device, m_stagingOut, NULL);
+	vkFreeMemory(device, m_stagingOutMemory, NULL);
+	for (int i = 0; i < B_COUNT; i++)
+	{
+		vkDestroyBuffer(device, m_buffers[i], NULL);
+		vkFreeMemory(device, m_bufferMemory[i], NULL);
+	}
+}
+
+VkFFTResult VkFFT_ArdStep::createUpdatePipeline()
+{
+	VkDevice device = m_vkGPU->device;
+
+	VkDescriptorSetLayoutBinding bindings[B_COUNT] = {};
+	for (uint32_t i = 0; i < B_COUNT; i++)
+	{
+		bindings[i].binding = i;
+		bindings[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		bindings[i].descriptorCount = 1;
+		bindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	}
+	VkDescriptorSetLayoutCreateInfo layoutCreateInfo = { VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO };
+	layoutCreateInfo.bindingCount = B_COUNT;
+	layoutCreateInfo.pBindings = bindings;
+	if (vkCreateDescriptorSetLayout(device, &layoutCreateInfo, NULL, &m_descriptorSetLayout) != VK_SUCCESS)
+		return VKFFT_ERROR_FAILED_TO_CREATE_DESCRIPTOR_SET_LAYOUT;
+
+	VkDescriptorPoolSize poolSize = { VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, B_COUNT };
+	VkDescriptorPoolCreateInfo poolCreateInfo = { VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO };
+	poolCreateInfo.maxSets = 1;
+	poolCreateInfo.poolSizeCount = 1;
+	poolCreateInfo.pPoolSizes = &poolSize;
+	if (vkCreateDescriptorPool(device, &poolCreateInfo, NULL, &m_descriptorPool) != VK_SUCCESS)
+		return VKFFT_ERROR_FAILED_TO_CREATE_DESCRIPTOR_POOL;
+
+	VkDescriptorSetAllocateInfo allocateInfo = { VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO };
+	allocateInfo.descriptorPool = m_descriptorPool;
+	allocateInfo.descriptorSetCount = 1;
+	allocateInfo.pSetLayouts = &m_descriptorSetLayout;
+	if (vkAllocateDescriptorSets(device, &allocateInfo, &m_descriptorSet) != VK_SUCCESS)
+		return VKFFT_ERROR_FAILED_TO_ALLOCATE_DESCRIPTOR_SETS;
+
+	VkDescriptorBufferInfo bufferInfos[B_COUNT] = {};
+	VkWriteDescriptorSet writes[B_COUNT] = {};
+	for (uint32_t i = 0; i < B_COUNT; i++)
+	{
+		bufferInfos[i].buffer = m_buffers[i];
+		bufferInfos[i].offset = 0;
+		bufferInfos[i].range = m_bufferSize;
+		writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		writes[i].dstSet = m_descriptorSet;
+		writes[i].dstBinding = i;
+		writes[i].descriptorCount = 1;
+		writes[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		writes[i].pBufferInfo = &bufferInfos[i];
+	}
+	vkUpdateDescriptorSets(device, B_COUNT, writes, 0, NULL);
+
+	VkPushConstantRange pushConstantRange = { VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(ArdUpdatePushConstants) };
+	VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = { VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO };
+	pipelineLayoutCreateInfo.setLayoutCount = 1;
+	pipelineLayoutCreateInfo.pSetLayouts = &m_descriptorSetLayout;
+	pipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+	pipelineLayoutCreateInfo.pPushConstantRanges = &pushConstantRange;
+	if (vkCreatePipelineLayout(device, &pipelineLayoutCreateInfo, NULL, &m_pipelineLayout) != VK_SUCCESS)
+		return VKFFT_ERROR_FAILED_TO_CREATE_PIPELINE_LAYOUT;
+
+	std::vector<uint32_t> spirv;
+	VkFFTResult resFFT = compileComputeShader(m_vkGPU, s_ardUpdateShader, spirv);
+	if (resFFT != VKFFT_SUCCESS) return resFFT;
+
+	VkShaderModuleCreateInfo moduleCreateInfo = { VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO };
+	moduleCreateInfo.codeSize = spirv.size() * sizeof(uint32_t);
+	moduleCreateInfo.pCode = spirv.data();
+	VkShaderModule module = VK_NULL_HANDLE;
+	if (vkCreateShaderModule(device, &moduleCreateInfo, NULL, &module) != VK_SUCCESS)
+		return VKFFT_ERROR_FAILED_TO_CREATE_SHADER_MODULE;
+
+	VkComputePipelineCreateInfo pipelineCreateInfo = { VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO };
+	pipelineCreateInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	pipelineCreateInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+	pipelineCreateInfo.stage.module = module;
+	pipelineCreateInfo.stage.pName = "main";
+	pipelineCreateInfo.layout = m_pipelineLayout;
+	VkResult res = vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &pipelineCreateInfo, NULL, &m_pipeline);
+	vkDestroyShaderModule(device, module, NULL);
+	if (res != VK_SUCCESS) return VKFFT_ERROR_FAILED_TO_CREATE_PIPELINE;
+	return VKFFT_SUCCESS;
+}
+
+VkFFTResult VkFFT_ArdStep::recordCommandBuffer()
+{
+	VkCommandBufferAllocateInfo commandBufferAllocateInfo = { VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO };
+	commandBufferAllocateInfo.commandPool = m_vkGPU->commandPool;
+	commandBufferAllocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+	commandBufferAllocateInfo.commandBufferCount = 1;
+	if (vkAllocateCommandBuffers(m_vkGPU->device, &commandBufferAllocateInfo, &m_commandBuffer) != VK_SUCCESS)
+		return VKFFT_ERROR_FAILED_TO_ALLOCATE_COMMAND_BUFFERS;
+
+	// Recorded once and resubmitted every step: no ONE_TIME_SUBMIT flag.
+	VkCommandBufferBeginInfo commandBufferBeginInfo = { VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO };
+	if (vkBeginCommandBuffer(m_commandBuffer, &commandBufferBeginInfo) != VK_SUCCESS)
+		return VKFFT_ERROR_FAILED_TO_BEGIN_COMMAND_BUFFER;
+
+	VkBufferCopy copyRegion = { 0, 0, m_bufferSize };
+	VkMemoryBarrier barrier = { VK_STRUCTURE_TYPE_MEMORY_BARRIER };
+
+	// forcing field -> device
+	vkCmdCopyBuffer(m_commandBuffer, m_stagingIn, m_buffers[B_FORCE], 1, &copyRegion);
+	barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	vkCmdPipelineBarrier(m_commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, NULL, 0, NULL);
+
+	// forcing field -> forcing modes
+	VkFFTLaunchParams launchParams = {};
+	launchParams.commandBuffer = &m_commandBuffer;
+	VkFFTResult resFFT = VkFFTAppend(&m_dctApp, -1, &launchParams);
+	if (resFFT != VKFFT_SUCCESS) return resFFT;
+	barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	vkCmdPipelineBarrier(m_commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, NULL, 0, NULL);
+
+	// mode update, writes the new modes into the IDCT buffer
+	ArdUpdatePushConstants pc;
+	pc.total = (uint32_t)(m_width * m_height * m_depth);
+	pc.dctScale = 1.0f / (2.0f * sqrtf(2.0f * pc.total));
+	pc.idctScale = 1.0f / sqrtf(2.0f * pc.total);
+	pc.damping = 0.999f;
+	vkCmdBindPipeline(m_commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipeline);
+	vkCmdBindDescriptorSets(m_commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipelineLayout, 0, 1, &m_descriptorSet, 0, NULL);
+	vkCmdPushConstants(m_commandBuffer, m_pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(pc), &pc);
+	vkCmdDispatch(m_commandBuffer, (pc.total + 255) / 256, 1, 1);
+	vkCmdPipelineBarrier(m_commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &barrier, 0, NULL, 0, NULL);
+
+	// modes -> pressure field
+	resFFT = VkFFTAppend(&m_idctApp, -1, &launchParams);
+	if (resFFT != VKFFT_SUCCESS) return resFFT;
+	barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+	vkCmdPipelineBarrier(m_commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &barrier, 0, NULL, 0, NULL);
+
+	// pressure field -> host
+	vkCmdCopyBuffer(m_commandBuffer, m_buffers[B_PRESSURE], m_stagingOut, 1, &copyRegion);
+
+	if (vkEndCommandBuffer(m_commandBuffer) != VK_SUCCESS)
+		return VKFFT_ERROR_FAILED_TO_END_COMMAND_BUFFER;
+	return VKFFT_SUCCESS;
+}
+
+VkFFTResult VkFFT_ArdStep::execute()
+{
+	memcpy(m_stagingInData, m_force, m_bufferSize);
+	VkFFTResult result = submitToQueue(m_vkGPU, m_commandBuffer, m_fence);
+	assert(result == VKFFT_SUCCESS);
+	memcpy(m_pressure, m_stagingOutData, m_bufferSize);
+	return result;
+}
+
+#endif
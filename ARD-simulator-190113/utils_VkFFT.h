@@ -1,5 +1,47 @@
 #pragma once
 
+#ifdef ARD_NO_VULKAN
+/* CPU-only builds (headless batch runner on servers without the Vulkan SDK): the GPU types exist
+ * so the solver compiles unchanged, but initVkGPU always fails and nothing is ever created on a device.
+ */
+#include <cstdint>
+
+enum VkFFTResult
+{
+	VKFFT_SUCCESS = 0,
+	VKFFT_ERROR_FAILED_TO_INITIALIZE = 1
+};
+
+struct VkGPU
+{
+	uint64_t device_id;
+};
+
+class VkFFT_DCT
+{
+public:
+	VkFFT_DCT(VkGPU*, int, int, int, int, float*, float*) {}
+	VkFFTResult execute() { return VKFFT_ERROR_FAILED_TO_INITIALIZE; }
+};
+
+class VkFFT_ArdStep
+{
+public:
+	VkFFT_ArdStep(VkGPU*, int, int, int, const float*, const float*, float*, float*) {}
+	VkFFTResult execute() { return VKFFT_ERROR_FAILED_TO_INITIALIZE; }
+};
+
+inline VkFFTResult initVkGPU(VkGPU*)
+{
+	return VKFFT_ERROR_FAILED_TO_INITIALIZE;
+}
+inline VkFFTResult destroyVkGPU(VkGPU*)
+{
+	return VKFFT_SUCCESS;
+}
+
+#else
+
 #include "vkFFT.h"
 #include <vector>
 
@@ -59,6 +101,54 @@ private:
 	double				m_time{ 0.0 };	// last execution time
 };
 
+// One ARD time step for a DCT partition, resident on the GPU.
+// Forward DCT-II of the forcing field, the mode update and the inverse DCT-III are recorded once
+// into a single command buffer, so the modes never leave the device between the two transforms.
+// Only the forcing field is uploaded and the pressure field downloaded per step.
+class VkFFT_ArdStep
+{
+public:
+	VkFFT_ArdStep(VkGPU* vkGPU, int width, int height, int depth, const float* cwt, const float* w2, float* force, float* pressure);
+	~VkFFT_ArdStep();
+
+	VkFFTResult execute();
+
+private:
+	VkFFTResult createUpdatePipeline();
+	VkFFTResult recordCommandBuffer();
+
+	VkGPU*					m_vkGPU{ nullptr };
+	VkFFTApplication		m_dctApp{};				// forward DCT (DCT-II), in place on m_forceBuffer
+	VkFFTApplication		m_idctApp{};			// inverse DCT (DCT-III), in place on m_pressureBuffer
+	int						m_width;
+	int						m_height;
+	int						m_depth;
+	float*					m_force{ nullptr };		// host forcing field (input)
+	float*					m_pressure{ nullptr };	// host pressure field (output)
+	uint64_t				m_bufferSize{ 0 };
+
+	// device buffers: forcing/modes of force, pressure, mode state and coefficient tables
+	enum { B_FORCE, B_MODES, B_PREV_MODES, B_CWT, B_COEF, B_PRESSURE, B_COUNT };
+	VkBuffer				m_buffers[B_COUNT]{};
+	VkDeviceMemory			m_bufferMemory[B_COUNT]{};
+
+	// persistently mapped host-visible staging buffers
+	VkBuffer				m_stagingIn{ VK_NULL_HANDLE };
+	VkDeviceMemory			m_stagingInMemory{ VK_NULL_HANDLE };
+	void*					m_stagingInData{ nullptr };
+	VkBuffer				m_stagingOut{ VK_NULL_HANDLE };
+	VkDeviceMemory			m_stagingOutMemory{ VK_NULL_HANDLE };
+	void*					m_stagingOutData{ nullptr };
+
+	VkDescriptorSetLayout	m_descriptorSetLayout{ VK_NULL_HANDLE };
+	VkDescriptorPool		m_descriptorPool{ VK_NULL_HANDLE };
+	VkDescriptorSet			m_descriptorSet{ VK_NULL_HANDLE };
+	VkPipelineLayout		m_pipelineLayout{ VK_NULL_HANDLE };
+	VkPipeline				m_pipeline{ VK_NULL_HANDLE };
+	VkCommandBuffer			m_commandBuffer{ VK_NULL_HANDLE };
+	VkFence					m_fence{ VK_NULL_HANDLE };	// own fence, partitions are updated from several threads
+};
+
 VkResult CreateDebugUtilsMessengerEXT(VkGPU* vkGPU, const VkDebugUtilsMessengerCreateInfoEXT* pCreateInfo, const VkAllocationCallbacks* pAllocator, VkDebugUtilsMessengerEXT* pDebugMessenger);
 void DestroyDebugUtilsMessengerEXT(VkGPU* vkGPU, const VkAllocationCallbacks* pAllocator);
 static VKAPI_ATTR VkBool32 VKAPI_CALL debugCallback(VkDebugUtilsMessageSeverityFlagBitsEXT messageSeverity, VkDebugUtilsMessageTypeFlagsEXT messageType, const VkDebugUtilsMessengerCallbackDataEXT* pCallbackData, void* pUserData);
@@ -83,4 +173,9 @@ VkFFTResult performVulkanFFTiFFT(VkGPU* vkGPU, VkFFTApplication* app, VkFFTLaunc
 VkFFTResult initVkGPU(VkGPU* vkGPU);
 VkFFTResult destroyVkGPU(VkGPU* vkGPU);
 
-VkFFTResult initVkFFT_DCT(VkGPU* vkGPU, VkFFTApplication* app, int dctType, int width, int height, int depth, float* input, float* output);
\ No newline at end of file
+VkFFTResult compileComputeShader(VkGPU* vkGPU, const char* code, std::vector<uint32_t>& spirv);
+VkFFTResult submitToQueue(VkGPU* vkGPU, VkCommandBuffer commandBuffer, VkFence fence);
+
+VkFFTResult initVkFFT_DCT(VkGPU* vkGPU, VkFFTApplication* app, int dctType, int width, int height, int depth, float* input, float* output);
+
+#endif
@@ -0,0 +1,308 @@
+#include "wav_file.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+static void PutU16(std::vector<uint8_t>& out, uint32_t v)
+{
+	out.push_back(v & 0xff);
+	out.push_back((v >> 8) & 0xff);
+}
+
+static void PutU32(std::vector<uint8_t>& out, uint32_t v)
+{
+	PutU16(out, v & 0xffff);
+	PutU16(out, v >> 16);
+}
+
+static void PutTag(std::vector<uint8_t>& out, const char* tag)
+{
+	out.insert(out.end(), tag, tag + 4);
+}
+
+static uint32_t GetU16(const uint8_t* p)
+{
+	return p[0] | (p[1] << 8);
+}
+
+static uint32_t GetU32(const uint8_t* p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+std::vector<uint8_t> WavFile::Header(Format format, int channels, int sample_rate, uint32_t frames)
+{
+	uint32_t bytes_per_sample = (format == PCM_24) ? 3 : 4;
+	uint32_t data_bytes = frames * channels * bytes_per_sample;
+
+	std::vector<uint8_t> out;
+	// Float files carry a fact chunk (required for non-PCM formats).
+	uint32_t riff_bytes = 4 + (8 + 16) + (format == FLOAT_32 ? 8 + 4 : 0) + (8 + data_bytes);
+	PutTag(out, "RIFF");
+	PutU32(out, riff_bytes);
+	PutTag(out, "WAVE");
+
+	PutTag(out, "fmt ");
+	PutU32(out, 16);
+	PutU16(out, format == PCM_24 ? 1 : 3);	// WAVE_FORMAT_PCM, WAVE_FORMAT_IEEE_FLOAT
+	PutU16(out, channels);
+	PutU32(out, sample_rate);
+	PutU32(out, sample_rate * channels * bytes_per_sample);
+	PutU16(out, channels * bytes_per_sample);
+	PutU16(out, bytes_per_sample * 8);
+
+	if (format == FLOAT_32)
+	{
+		PutTag(out, "fact");
+		PutU32(out, 4);
+		PutU32(out, frames);
+	}
+
+	PutTag(out, "data");
+	PutU32(out, data_bytes);
+	return out;
+}
+
+bool WavFile::Write(const std::string& path, const std::vector<float>& samples, int channels, int sample_rate, Format format)
+{
+	uint32_t frames = (uint32_t)(samples.size() / channels);
+	std::vector<uint8_t> out = Header(format, channels, sample_rate, frames);
+	out.reserve(out.size() + (size_t)frames * channels * 4);
+	for (uint32_t i = 0; i < frames * channels; i++)
+	{
+		float v = samples[i];
+		if (format == PCM_24)
+		{
+			v = std::max(-1.0f, std::min(1.0f, v));
+			int32_t q = (int32_t)std::lround(v * 8388607.0f);
+			out.push_back(q & 0xff);
+			out.push_back((q >> 8) & 0xff);
+			out.push_back((q >> 16) & 0xff);
+		}
+		else
+		{
+			uint32_t bits;
+			memcpy(&bits, &v, 4);
+			PutU32(out, bits);
+		}
+	}
+
+	FILE* file = fopen(path.c_str(), "wb");
+	if (!file)
+	{
+		std::cout << "Cannot write " << path << std::endl;
+		return false;
+	}
+	bool ok = fwrite(out.data(), 1, out.size(), file) == out.size();
+	fclose(file);
+	return ok;
+}
+
+WavReader::~WavReader()
+{
+	Close();
+}
+
+bool WavReader::Open(const std::string& path)
+{
+	Close();
+#ifdef _WIN32
+	HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		std::cout << "Cannot open " << path << std::endl;
+		return false;
+	}
+	LARGE_INTEGER size;
+	GetFileSizeEx(file, &size);
+	HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	const void* view = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+	file_ = file;
+	mapping_ = mapping;
+	map_ = (const uint8_t*)view;
+	map_size_ = (size_t)size.QuadPart;
+#else
+	int fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+	{
+		std::cout << "Cannot open " << path << std::endl;
+		return false;
+	}
+	struct stat st;
+	fstat(fd, &st);
+	void* view = st.st_size > 0 ? mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+	close(fd);	// the mapping keeps the file alive
+	if (view != MAP_FAILED)
+	{
+		madvise(view, st.st_size, MADV_SEQUENTIAL);
+		map_ = (const uint8_t*)view;
+		map_size_ = (size_t)st.st_size;
+	}
+#endif
+	if (!map_ || map_size_ < 12 || memcmp(map_, "RIFF", 4) || memcmp(map_ + 8, "WAVE", 4))
+	{
+		std::cout << path << " is not a WAV file." << std::endl;
+		Close();
+		return false;
+	}
+
+	// Walk the chunks for "fmt " and "data".
+	size_t pos = 12;
+	int format = 0;
+	while (pos + 8 <= map_size_)
+	{
+		const uint8_t* chunk = map_ + pos;
+		size_t size = GetU32(chunk + 4);
+		if (!memcmp(chunk, "fmt ", 4) && size >= 16)
+		{
+			format = GetU16(chunk + 8);
+			channels_ = GetU16(chunk + 10);
+			sample_rate_ = GetU32(chunk + 12);
+			bits_ = GetU16(chunk + 22);
+			if (format == 0xFFFE && size >= 40)	// WAVE_FORMAT_EXTENSIBLE, sub-format GUID starts with the format tag
+				format = GetU16(chunk + 32);
+		}
+		else if (!memcmp(chunk, "data", 4))
+		{
+			samples_ = chunk + 8;
+			size = std::min(size, map_size_ - pos - 8);
+			if (channels_ > 0 && bits_ > 0)
+				frames_ = size / (channels_ * (bits_ / 8));
+			break;
+		}
+		pos += 8 + size + (size & 1);
+	}
+	float_ = (format == 3);
+	bool supported = (format == 1 && (bits_ == 16 || bits_ == 24 || bits_ == 32)) || (format == 3 && bits_ == 32);
+	if (!samples_ || channels_ <= 0 || !supported)
+	{
+		std::cout << path << ": unsupported WAV format " << format << " (" << bits_ << " bit)." << std::endl;
+		Close();
+		return false;
+	}
+	return true;
+}
+
+void WavReader::Close()
+{
+#ifdef _WIN32
+	if (map_) UnmapViewOfFile(map_);
+	if (mapping_) CloseHandle((HANDLE)mapping_);
+	if (file_) CloseHandle((HANDLE)file_);
+	file_ = nullptr;
+	mapping_ = nullptr;
+#else
+	if (map_) munmap((void*)map_, map_size_);
+#endif
+	map_ = nullptr;
+	map_size_ = 0;
+	samples_ = nullptr;
+	frames_ = 0;
+}
+
+void WavReader::Read(int channel, size_t first, size_t count, float* out) const
+{
+	int bytes = bits_ / 8;
+	size_t stride = (size_t)channels_ * bytes;
+	size_t available = first < frames_ ? std::min(count, frames_ - first) : 0;
+	const uint8_t* p = samples_ + first * stride + (size_t)channel * bytes;
+	for (size_t i = 0; i < available; i++, p += stride)
+	{
+		if (float_)
+		{
+			memcpy(&out[i], p, 4);
+		}
+		else if (bits_ == 16)
+		{
+			out[i] = (int16_t)GetU16(p) / 32768.0f;
+		}
+		else if (bits_ == 24)
+		{
+			int32_t v = (int32_t)((p[0] << 8) | (p[1] << 16) | ((uint32_t)p[2] << 24)) >> 8;
+			out[i] = v / 8388608.0f;
+		}
+		else
+		{
+			out[i] = (int32_t)GetU32(p) / 2147483648.0f;
+		}
+	}
+	std::fill(out + available, out + count, 0.0f);
+}
+
+std::vector<float> WavReader::ReadChannel(int channel) const
+{
+	std::vector<float> samples(frames_);
+	Read(channel, 0, frames_, samples.data());
+	return samples;
+}
+
+WavWriter::~WavWriter()
+{
+	Close();
+}
+
+bool WavWriter::Open(const std::string& path, int channels, int sample_rate)
+{
+	file_ = fopen(path.c_str(), "w+b");		// read back by Close() when rescaling
+	if (!file_)
+	{
+		std::cout << "Cannot write " << path << std::endl;
+		return false;
+	}
+	buffer_.resize(4 << 20);
+	setvbuf(file_, buffer_.data(), _IOFBF, buffer_.size());
+	channels_ = channels;
+	sample_rate_ = sample_rate;
+	frames_ = 0;
+	ok_ = true;
+	auto header = WavFile::Header(WavFile::FLOAT_32, channels_, sample_rate_, 0);
+	ok_ = fwrite(header.data(), 1, header.size(), file_) == header.size();
+	data_offset_ = (long)header.size();
+	return ok_;
+}
+
+bool WavWriter::Write(const float* interleaved, size_t frames)
+{
+	if (!file_) return false;
+	size_t n = frames * channels_;
+	ok_ = ok_ && fwrite(interleaved, sizeof(float), n, file_) == n;	// little-endian host, as everywhere in this code
+	frames_ += (uint32_t)frames;
+	return ok_;
+}
+
+bool WavWriter::Close(float gain)
+{
+	if (!file_) return ok_;
+	if (gain != 1.0f && ok_)
+	{
+		std::vector<float> block(1 << 16);
+		size_t total = (size_t)frames_ * channels_;
+		for (size_t done = 0; done < total && ok_; done += block.size())
+		{
+			size_t n = std::min(block.size(), total - done);
+			long offset = data_offset_ + (long)(done * sizeof(float));
+			fseek(file_, offset, SEEK_SET);
+			ok_ = fread(block.data(), sizeof(float), n, file_) == n;
+			for (size_t i = 0; i < n; i++)
+				block[i] *= gain;
+			fseek(file_, offset, SEEK_SET);
+			ok_ = ok_ && fwrite(block.data(), sizeof(float), n, file_) == n;
+		}
+	}
+	auto header = WavFile::Header(WavFile::FLOAT_32, channels_, sample_rate_, frames_);
+	fseek(file_, 0, SEEK_SET);
+	ok_ = ok_ && fwrite(header.data(), 1, header.size(), file_) == header.size();
+	fclose(file_);
+	file_ = nullptr;
+	return ok_;
+}
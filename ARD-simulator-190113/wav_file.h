@@ -0,0 +1,89 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+/* Minimal RIFF/WAVE writer: interleaved samples in [-1, 1], 24-bit PCM or 32-bit float. */
+class WavFile
+{
+public:
+	enum Format {
+		PCM_24,
+		FLOAT_32
+	};
+
+	static bool Write(const std::string& path, const std::vector<float>& samples, int channels, int sample_rate, Format format = PCM_24);
+	static std::vector<uint8_t> Header(Format format, int channels, int sample_rate, uint32_t frames);
+};
+
+/* Read-only memory-mapped WAV file (16/24/32-bit PCM, 32-bit float, plain or extensible header).
+ * Samples are converted to float on demand, so arbitrarily long files can be streamed.
+ */
+class WavReader
+{
+public:
+	WavReader() = default;
+	~WavReader();
+	WavReader(const WavReader&) = delete;
+	WavReader& operator=(const WavReader&) = delete;
+
+	bool Open(const std::string& path);
+	void Close();
+
+	// Frames [first, first + count) of one channel, zero past the end.
+	void Read(int channel, size_t first, size_t count, float* out) const;
+	std::vector<float> ReadChannel(int channel) const;
+
+	int channels() const
+	{
+		return channels_;
+	}
+	int sample_rate() const
+	{
+		return sample_rate_;
+	}
+	size_t frames() const
+	{
+		return frames_;
+	}
+
+private:
+	const uint8_t* map_{ nullptr };
+	size_t map_size_{ 0 };
+	const uint8_t* samples_{ nullptr };
+	int channels_{ 0 };
+	int sample_rate_{ 0 };
+	int bits_{ 0 };
+	bool float_{ false };
+	size_t frames_{ 0 };
+#ifdef _WIN32
+	void* file_{ nullptr };
+	void* mapping_{ nullptr };
+#endif
+};
+
+/* Streaming 32-bit float WAV writer; sizes are patched in on Close(). */
+class WavWriter
+{
+public:
+	WavWriter() = default;
+	~WavWriter();
+	WavWriter(const WavWriter&) = delete;
+	WavWriter& operator=(const WavWriter&) = delete;
+
+	bool Open(const std::string& path, int channels, int sample_rate);
+	bool Write(const float* interleaved, size_t frames);
+	// gain != 1 rescales the written data in place (e.g. peak normalisation once the peak is known).
+	bool Close(float gain = 1.0f);
+
+private:
+	FILE* file_{ nullptr };
+	int channels_{ 0 };
+	int sample_rate_{ 0 };
+	uint32_t frames_{ 0 };
+	long data_offset_{ 0 };
+	std::vector<char> buffer_;
+	bool ok_{ true };
+};
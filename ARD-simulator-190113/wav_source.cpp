@@ -0,0 +1,69 @@
+#define _USE_MATH_DEFINES
+#include <cmath>
+#include "wav_source.h"
+#include "impulse_response.h"
+#include <algorithm>
+#include <vector>
+
+
+WavSource::WavSource(int x, int y, int z, const std::string& path, int channel, const Settings& settings, const SimulationConfig& config)
+	: SoundSource(x, y, z), gain_(settings.gain)
+{
+	block_steps_ = settings.block_steps;
+	if (!reader_.Open(path))
+	{
+		ratio_ = 1.0;
+		cutoff_ = 1.0;
+		support_ = 1.0;
+		channel_ = 0;
+		return;
+	}
+	channel_ = std::min(std::max(channel, 0), reader_.channels() - 1);
+	double in_rate = reader_.sample_rate();
+	double band = std::min((double)config.c0 / (settings.cells_per_wavelength * config.dh), 0.5 / config.dt);
+	ratio_ = in_rate * config.dt;
+	cutoff_ = std::min(1.0, 2.0 * band / in_rate);
+	support_ = settings.half_width / cutoff_;
+}
+
+WavSource::~WavSource()
+{
+}
+
+real_t WavSource::SampleValue(real_t t)
+{
+	real_t value = 0.0f;
+	Fill((int)t, 1, &value);
+	return value;
+}
+
+void WavSource::Fill(int first, int count, real_t* out)
+{
+	if (!ok())
+	{
+		std::fill(out, out + count, 0.0f);
+		return;
+	}
+	// Input span covering the kernels of all count steps; before the file and past its end read as zero.
+	long long in_first = (long long)floor(first * ratio_ - support_);
+	long long in_last = (long long)ceil((first + count - 1) * ratio_ + support_);
+	std::vector<float> input((size_t)(in_last - in_first + 1), 0.0f);
+	long long skip = std::max(0LL, -in_first);
+	if (skip < (long long)input.size())
+	{
+		reader_.Read(channel_, (size_t)(in_first + skip), input.size() - (size_t)skip, input.data() + skip);
+	}
+
+	for (int i = 0; i < count; i++)
+	{
+		double t = (first + i) * ratio_;
+		long long k0 = (long long)ceil(t - support_);
+		long long k1 = (long long)floor(t + support_);
+		double acc = 0.0;
+		for (long long k = k0; k <= k1; k++)
+		{
+			acc += input[(size_t)(k - in_first)] * ImpulseResponse::SincKernel(t - k, cutoff_, support_);
+		}
+		out[i] = (real_t)(gain_ * acc);
+	}
+}
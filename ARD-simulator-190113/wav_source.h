@@ -0,0 +1,42 @@
+#pragma once
+#include <string>
+#include "sound_source.h"
+#include "wav_file.h"
+
+/* A source driven by one channel of a WAV file, streamed from the memory-mapped file.
+ *
+ * The file is band-limited to what the grid carries (c0 / (cells_per_wavelength * dh), as in
+ * ImpulseResponse) and resampled to the simulation rate with a Blackman-windowed sinc, one block of
+ * block_steps steps at a time, so only the block in use is resident however long the file is.
+ * Past the end of the file the source is silent.
+ */
+class WavSource : public SoundSource
+{
+public:
+	struct Settings
+	{
+		real_t gain{ 1e9f };					// full scale, the same peak as the Gaussian pulse
+		real_t cells_per_wavelength{ 2.3f };
+		int block_steps{ 4096 };
+		int half_width{ 32 };					// kernel half-width, in samples at the lower of the two rates
+	};
+
+	WavSource(int x, int y, int z, const std::string& path, int channel, const Settings& settings, const SimulationConfig& config);
+	~WavSource();
+
+	virtual real_t SampleValue(real_t t);
+	virtual void Fill(int first, int count, real_t* out);
+
+	bool ok() const
+	{
+		return reader_.frames() > 0;
+	}
+
+private:
+	WavReader reader_;
+	int channel_;
+	real_t gain_;
+	double ratio_;		// input samples per time step
+	double cutoff_;		// relative to the input Nyquist
+	double support_;	// kernel half-width in input samples
+};
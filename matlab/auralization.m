@@ -19,8 +19,20 @@ end
         
 
 
-rr = load([num2str(dh) '_' num2str(absorp)  '/response_0.txt']);
-src = load([num2str(dh) '_' num2str(absorp) '/source_0.txt']);
+rec = [num2str(dh) '_' num2str(absorp) '/record.bin'];
+if exist(rec, 'file')
+    response = read_record(rec);
+    rr = response{1};
+else
+    rr = load([num2str(dh) '_' num2str(absorp)  '/response_0.txt']);
+end
+srcs = [num2str(dh) '_' num2str(absorp) '/sources.bin'];
+if exist(srcs, 'file')
+    src = read_sources(srcs);
+    src = double(src(:, 1));
+else
+    src = load([num2str(dh) '_' num2str(absorp) '/source_0.txt']);
+end
 Ns = size(rr,1);
 
 rt =int16(0.16*7600/2720/absorp*sr);
@@ -0,0 +1,35 @@
+function [pressure, info] = read_receivers(path)
+% Read receivers.bin written by ReceiverArray (see receiver_array.h for the layout).
+%   pressure: total_steps x num_receivers x num_fields, one column per receiver and field
+%             (num_fields > 1 with batched sources: field k is the response to source k)
+%   info:     dh, dt, c0, and per receiver [id x y z] (cells); ids are the order the points were added
+
+fid = fopen(path, 'r', 'ieee-le');
+magic = fread(fid, 8, 'uint8=>uint8')';
+assert(isequal(magic, uint8(['ARDRCV' 0 1])), 'not a receiver file');
+version = fread(fid, 1, 'int32');
+h = fread(fid, 3, 'int32');
+num_receivers = h(1);
+total_steps = h(3);
+num_fields = 1;
+if version >= 2
+    num_fields = fread(fid, 1, 'int32');
+end
+c = fread(fid, 3, 'float32');
+info.dh = c(1); info.dt = c(2); info.c0 = c(3);
+info.receivers = reshape(fread(fid, 4 * num_receivers, 'int32'), 4, [])';
+
+columns = num_receivers * num_fields;
+pressure = zeros(total_steps, columns, 'single');
+while true
+    b = fread(fid, 2, 'int32');
+    if numel(b) < 2
+        break;
+    end
+    steps = b(1) + (1:b(2));
+    pressure(steps, :) = reshape(fread(fid, b(2) * columns, 'float32=>single'), b(2), columns);
+end
+fclose(fid);
+pressure = reshape(pressure, total_steps, num_receivers, num_fields);
+
+end
@@ -0,0 +1,45 @@
+function [response, field, info] = read_record(path)
+% Read record.bin written by RecordWriter (see record_writer.h for the layout).
+%   response{c}: total_steps x 1 pressure at recorder c
+%   field{c}:    total_steps x samples per step: the 1000 neighbourhood pressures (z, y, x order),
+%                [p, rho0*c0*v] or the ambisonic channels (ACN / SN3D), like out_N.txt
+%   info:        dh, dt, c0, encoding ('cube', 'pressure-velocity', 'ambisonics'), ambisonic
+%                order and per-recorder positions (cells)
+
+fid = fopen(path, 'r', 'ieee-le');
+magic = fread(fid, 8, 'uint8=>uint8')';
+assert(isequal(magic, uint8(['ARDREC' 0 1])), 'not a record file');
+h = fread(fid, 5, 'int32');
+num_channels = h(2);
+samples = h(4);
+encodings = {'cube', 'pressure-velocity', 'ambisonics'};
+if h(1) >= 2
+    info.encoding = encodings{h(5) + 1};
+else
+    info.encoding = 'cube';     % version 1 stored the cube edge here
+end
+info.order = sqrt(samples) - 1;
+c = fread(fid, 3, 'float32');
+info.dh = c(1); info.dt = c(2); info.c0 = c(3);
+info.channels = reshape(fread(fid, 11 * num_channels, 'int32'), 11, [])';
+
+response = cell(num_channels, 1);
+field = cell(num_channels, 1);
+for ch = 1:num_channels
+    response{ch} = zeros(info.channels(ch, 2), 1);
+    field{ch} = zeros(info.channels(ch, 2), samples);
+end
+
+while true
+    b = fread(fid, 3, 'int32');
+    if numel(b) < 3
+        break;
+    end
+    ch = b(1) + 1;
+    steps = b(2) + (1:b(3));
+    response{ch}(steps) = fread(fid, b(3), 'float32');
+    field{ch}(steps, :) = reshape(fread(fid, b(3) * samples, 'float32'), b(3), samples);
+end
+fclose(fid);
+
+end
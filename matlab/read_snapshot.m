@@ -0,0 +1,47 @@
+function [volumes, step, info] = read_snapshot(path, k)
+% Read frame k (1-based) of snapshots.bin written by SnapshotWriter (see snapshot.h for the layout).
+%   volumes: one width x height x depth array per partition (x, y, z indexing), pressure
+%   step:    the time step of the frame
+%   info:    dh, dt, c0, every, bits, block, frames, and per partition [x y z width height depth] (cells)
+% Only frame k is read: frames have a fixed size, so it is a single seek.
+
+fid = fopen(path, 'r', 'ieee-le');
+magic = fread(fid, 8, 'uint8=>uint8')';
+assert(isequal(magic, uint8(['ARDSNP' 0 1])), 'not a snapshot file');
+h = fread(fid, 6, 'int32');
+assert(h(1) == 1, 'unsupported snapshot version');
+num_partitions = h(2);
+info.bits = h(3); info.block = h(4); info.every = h(5);
+c = fread(fid, 3, 'float32');
+info.dh = c(1); info.dt = c(2); info.c0 = c(3);
+info.field = fread(fid, 1, 'int32');
+sizes = fread(fid, 2, 'int64');
+frame_bytes = sizes(1); data_offset = sizes(2);
+info.partitions = zeros(num_partitions, 6);
+offsets = zeros(num_partitions, 1);
+for i = 1:num_partitions
+    info.partitions(i, :) = fread(fid, 6, 'int32')';
+    offsets(i) = fread(fid, 1, 'int64');
+end
+fseek(fid, 0, 'eof');
+info.frames = floor((ftell(fid) - data_offset) / frame_bytes);
+assert(k >= 1 && k <= info.frames, 'frame out of range');
+
+base = data_offset + (k - 1) * frame_bytes;
+fseek(fid, base, 'bof');
+step = fread(fid, 1, 'int32');
+code_type = sprintf('int%d=>single', info.bits);
+b = info.block;
+volumes = cell(num_partitions, 1);
+for i = 1:num_partitions
+    w = info.partitions(i, 4); hh = info.partitions(i, 5); d = info.partitions(i, 6);
+    nb = ceil([w hh d] / b);
+    fseek(fid, base + offsets(i), 'bof');
+    scales = reshape(fread(fid, prod(nb), 'float32=>single'), nb);
+    codes = reshape(fread(fid, w * hh * d, code_type), w, hh, d);
+    [bx, by, bz] = ndgrid(floor((0:w-1) / b) + 1, floor((0:hh-1) / b) + 1, floor((0:d-1) / b) + 1);
+    volumes{i} = codes .* scales(sub2ind(nb, bx, by, bz));
+end
+fclose(fid);
+
+end
@@ -0,0 +1,17 @@
+function [waveforms, info] = read_sources(path)
+% Read sources.bin written by SoundSource::ExportSources (see sound_source.h for the layout).
+%   waveforms: total_steps x num_sources, the signal injected at each source
+%   info:      dt, and per source [id x y z field] (cells)
+
+fid = fopen(path, 'r', 'ieee-le');
+magic = fread(fid, 8, 'uint8=>uint8')';
+assert(isequal(magic, uint8(['ARDSRC' 0 1])), 'not a source file');
+h = fread(fid, 3, 'int32');
+num_sources = h(2);
+total_steps = h(3);
+info.dt = fread(fid, 1, 'float32');
+info.sources = reshape(fread(fid, 5 * num_sources, 'int32'), 5, [])';
+waveforms = reshape(fread(fid, total_steps * num_sources, 'float32=>single'), total_steps, num_sources);
+fclose(fid);
+
+end